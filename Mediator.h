@@ -14,22 +14,68 @@
 #include <libledger/DBInitializer.h>
 #include <libmptstate/Eurasure.h>
 #include <libmptstate/MPTState.h>
+#include <libmptstate/NodeRebuilder.h>
+#include <libmptstate/ShardedCache.h>
 #include <libdevcore/RLP.h>
+#include <libdevcore/ThreadPool.h>
 #include <tbb/tbb.h>
 #include <tbb/parallel_for.h>
 // #include <tbb/global_control.h>
 #include <tbb/task_scheduler_init.h>
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
 
 class Mediator{
 public:
+    typedef std::function<std::string(size_t, std::atomic<bool> const&)> ChunkReader;
+
     dev::mptstate::MPTState* mpt_ptr;
-    atomic<int> malicious_nodes{0};
+    atomic<int> malicious_nodes{0}; // 已加入黑名单的节点个数
+    double byzantine_ratio = 0; // 模拟返回错误数据的节点比例
     // std::unordered_map<dev::h256, StateLocation>* location_ptr;
 
-    Mediator(dev::mptstate::MPTState &mptstate){
+    // 先请求的 k 个 chunk 超过其预计延迟的 hedge_factor 倍仍未收齐时，向其余节点补发请求
+    double hedge_factor = 1.5;
+    std::shared_ptr<dev::ThreadPool> fetch_pool;
+    std::map<int, double> peer_latency; // 节点 -> 响应延迟（毫秒，指数滑动平均）
+    std::mutex x_peer_latency;
+    static const size_t c_fetchThreads = 32;
+    static constexpr double c_failedPeerLatency = 1000; // 无响应或数据无效的节点按该延迟（毫秒）计入
+
+    // 各次恢复共享的 chunk 缓存（读到的和解码出的），按 chunk hash 索引，容量按字节计
+    ShardedCache<dev::h256, std::string> chunk_cache;
+    static const size_t c_chunkCacheBytes = (size_t)64 << 20; // 64MB
+
+    // 返回过错误 chunk 的节点，之后的恢复不再向其请求
+    std::set<int> blacklist;
+    std::mutex x_blacklist;
+    static const size_t c_maxLocateAttempts = 256; // 定位错误 chunk 时最多尝试的解码次数
+
+    Mediator(dev::mptstate::MPTState &mptstate, size_t chunk_cache_bytes = c_chunkCacheBytes)
+      : fetch_pool(std::make_shared<dev::ThreadPool>("Recover", c_fetchThreads)),
+        chunk_cache(chunk_cache_bytes, 16, [](std::string const& s){ return s.size(); }){
         mpt_ptr = &mptstate;
         // location_ptr = mptstate.stateHashToInfoMap;
+        if(mpt_ptr->retention){
+            // 温区恢复缺少的 chunk 从持有节点读取，不再经过 retention，避免递归恢复
+            mpt_ptr->retention->setFetcher([this](dev::h256 const& key, int block_number, int holder){
+                return readChunk(key, block_number, holder, false);
+            });
+        }
+    }
+
+    // 对冲 / 落后的请求仍在 fetch_pool 中运行时会访问 peer_latency、blacklist 等成员，
+    // 先停止并等待它们结束，再析构这些成员（fetch_pool 声明在前，默认最后析构）
+    ~Mediator(){
+        if(mpt_ptr->retention){
+            mpt_ptr->retention->setFetcher(dev::mptstate::ChunkRetention::ChunkFetcher());
+        }
+        fetch_pool->stop();
     }
     
     // string at(h256 m_root, u160 _key) const
@@ -83,38 +129,10 @@ public:
     //     }
     // }
 
-    // 补0并且生成新的字符串
-    string padWithNullBytes(const string& str, size_t offset){
-        return string(offset, '\0') + str;
-    }
-
-    // 解除chunk中某一段字符串
-    string getSubstring(const string input, size_t offset, size_t len){
-        if(offset >= input.size()){
-            auto s = string(len + offset, '\0');
-            // cout << "OverCut String " << offset << "-" << input.size() 
-            //     << "+" << len
-            //     << "New str len "<< s.size() << endl;
-            return s;
-        }
-        auto str = input.substr(offset, len);
-        // cout << "After cutting in get substring len:" << str.size() << " len " << len << endl;
-        return padWithNullBytes(str, offset);
-    }
-
     NodeMetadata readStateNodeMeta(dev::h256 target) {
         // 从目标节点读取 节点id 区块编号
-        NodeMetadata rlt; // 返回值放入其中 若为空则找不到
-        auto& dataSet = mpt_ptr->versionManager.dataSet;
-        if(dataSet.find(target) != dataSet.end()){
-            auto it = dataSet.find(target);
-            return it->second.second;
-        }
-        else{
-            // cout << "Can't not find NodeMetaData." << endl;
-        }
-        // std::string ret; // 返回值放入其中 若为空则找不到
-        return rlt;
+        // 找不到时返回默认构造的 NodeMetadata
+        return mpt_ptr->versionManager.getNodeMetadata(target);
     }
 
     int locationChunk(dev::h256& target, int location){
@@ -130,7 +148,45 @@ public:
         return -1;
     }
 
-    std::string readChunk(dev::h256 target, int location = 0, int nodeId = -1) {
+    // ×伪造节点沉默现象
+    bool isSilentNode(int nodeId){
+        int f = 32 * 0.3;
+        return nodeId % 32 < f && (nodeId!=-1);
+    }
+
+    // ×伪造拜占庭节点：紧接在沉默节点之后的 byzantine_ratio 比例的节点返回被篡改的数据
+    bool isByzantineNode(int nodeId){
+        int f = 32 * 0.3;
+        return nodeId != -1 && nodeId % 32 >= f && nodeId % 32 < f + (int)(32 * byzantine_ratio);
+    }
+
+    static void tamper(std::string& data){
+        if(!data.empty()){
+            data[data.size() / 2] ^= 0x5a;
+        }
+    }
+
+    bool isBlacklisted(int peer){
+        std::lock_guard<std::mutex> l(x_blacklist);
+        return blacklist.count(peer) != 0;
+    }
+
+    void blacklistPeer(int peer, dev::h256 const& chunk){
+        if(peer < 0){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> l(x_blacklist);
+            if(!blacklist.insert(peer).second){
+                return;
+            }
+        }
+        malicious_nodes++;
+        writeToLog("Blacklist node " + dev::toString(peer) + " for invalid chunk " + dev::toString(chunk), "output_decode_log.txt");
+    }
+
+    // via_retention 为 false 时不读取 retention（供 retention 恢复时向持有节点取 chunk）
+    std::string readChunk(dev::h256 target, int location = 0, int nodeId = -1, bool via_retention = true) {
         // auto state_location = mpt_ptr->stateHashToInfoMap[target];
         // 从目标节点读取 节点id 区块编号
         std::string ret = ""; // 返回值放入其中 若为空则找不到
@@ -139,15 +195,25 @@ public:
         if(location){
 
             auto chunk_location = locationChunk(target, location);
-            // ×伪造节点沉默现象
-            int f = 32 * 0.3;
             // cout << "chunk location :" << nodeId 
             //     << " ,f :" << f << endl;
-            if(nodeId % 32 < f && (nodeId!=-1)){
+            if(isSilentNode(nodeId)){
                 return ret;
             }
 
-            ret = mpt_ptr->getState().db().lookup(target);
+            if(via_retention && mpt_ptr->retention){
+                // 已淘汰的 chunk 会被透明地恢复
+                ret = mpt_ptr->retention->read(target, location);
+            }
+            else if(mpt_ptr->chunkStore){
+                ret = mpt_ptr->chunkStore->lookup(target);
+            }
+            if(ret == ""){
+                ret = mpt_ptr->getState().db().lookup(target);
+            }
+            if(ret == "" && mpt_ptr->chunkDB){
+                ret = mpt_ptr->chunkDB->lookup(target);
+            }
             if(ret == ""){
                 // cout<< "state size : " << (mpt_ptr->BMT_map[1]).state_cache << endl;
                 auto tt = (mpt_ptr->BMT_map[location]).state_cache;
@@ -168,10 +234,384 @@ public:
             // 从远程读取
         }
 
+        if(isByzantineNode(nodeId)){
+            tamper(ret);
+        }
         // std::string ret; // 返回值放入其中 若为空则找不到
         return ret;
     }
 
+    /**
+    * @brief 只读取 chunk 的 [offset, offset + len) 区间，用于只恢复一个 MPT 节点
+    *
+    * 来源顺序与 readChunk 相同，retention 热区、段存储、chunkDB 与 state_cache 都只取出区间内的字节；
+    * OverlayDB 没有区间读取，以及归档 / 已淘汰的 chunk 需要整块解压或恢复，这两种情况取出整块后截取。
+    * chunk 存在但区间超出其末尾的部分补 0（与编码时短 chunk 的补齐方式一致），找不到 chunk 时返回空。
+    */
+    std::string readChunkRange(dev::h256 target, size_t offset, size_t len, int location = 0, int nodeId = -1){
+        std::string ret;
+        if(!location || isSilentNode(nodeId)){
+            return ret;
+        }
+        bool found = false;
+        if(mpt_ptr->retention){
+            found = mpt_ptr->retention->readRange(target, location, offset, len, ret);
+        }
+        else if(mpt_ptr->chunkStore){
+            found = mpt_ptr->chunkStore->read(target, [&](dev::bytesConstRef data){
+                ret = dev::mptstate::ChunkStore::slice(data, offset, len);
+            });
+        }
+        if(!found){
+            auto whole = mpt_ptr->getState().db().lookup(target);
+            found = !whole.empty();
+            ret = dev::mptstate::ChunkStore::slice(dev::bytesConstRef(&whole), offset, len);
+        }
+        if(!found && mpt_ptr->chunkDB){
+            found = mpt_ptr->chunkDB->lookupRange(target, offset, len, ret);
+        }
+        if(!found){
+            auto const& cache = mpt_ptr->BMT_map[location].state_cache;
+            auto it = cache.find(target);
+            if(it != cache.end()){
+                found = true;
+                ret = dev::mptstate::ChunkStore::slice(dev::bytesConstRef(&it->second), offset, len);
+            }
+        }
+        if(!found){
+            return std::string();
+        }
+        ret.resize(len, '\0');
+        if(isByzantineNode(nodeId)){
+            tamper(ret);
+        }
+        return ret;
+    }
+
+    // 区间切片在缓存中的 key：不同区间的切片互不覆盖，也不会被当作整块读出
+    static dev::h256 chunkRangeKey(dev::h256 const& hash, size_t offset, size_t len){
+        return dev::sha3(hash.hex() + "@" + dev::toString(offset) + "+" + dev::toString(len));
+    }
+
+    // 整块数据块用 chunk 的 Merkle 根校验，校验块用 sha3 校验
+    static bool validChunk(dev::h256 const& hash, std::string const& data, bool parity){
+        return parity ? dev::sha3(data) == hash : dev::BMT::chunkRoot(data) == hash;
+    }
+
+    /**
+    * @brief 从共享缓存读取 chunk；ranged 为 true 时读取 [offset, offset + len) 区间
+    *
+    * 区间先按区间 key 查找，找不到时从缓存的整块中截取。
+    */
+    bool lookupCachedChunk(dev::h256 const& hash, bool ranged, size_t offset, size_t len, std::string& out){
+        if(!ranged){
+            return chunk_cache.get(hash, out);
+        }
+        if(chunk_cache.get(chunkRangeKey(hash, offset, len), out)){
+            return true;
+        }
+        std::string whole;
+        if(!chunk_cache.get(hash, whole)){
+            return false;
+        }
+        out = offset >= whole.size() ? std::string() : whole.substr(offset, len);
+        out.resize(len, '\0');
+        return true;
+    }
+
+    // 整块只有通过校验才放入缓存；区间切片无法单独校验，与整块分开存放
+    void cacheChunk(dev::h256 const& hash, bool ranged, size_t offset, size_t len, std::string const& data, bool parity){
+        if(data.empty()){
+            return;
+        }
+        if(ranged){
+            chunk_cache.put(chunkRangeKey(hash, offset, len), data);
+        }
+        else if(validChunk(hash, data, parity)){
+            chunk_cache.put(hash, data);
+        }
+    }
+
+    /**
+    * @brief 解码结果的校验：取出目标状态的 value，与状态 hash 比对
+    *
+    * 整块解码时 value 位于 chunk 的 offset 处，区间解码时位于切片开头。没有该状态的 metadata 时无法校验，总是通过。
+    */
+    std::function<bool(std::string const&)> stateVerifier(dev::h256 const& target_state, NodeMetadata const& d, bool ranged){
+        size_t offset = ranged ? 0 : d.m_offset;
+        size_t data_len = d.getDataLength();
+        bool unframe = !ranged && mpt_ptr->state_erasure->compressChunks();
+        return [target_state, offset, data_len, unframe](std::string const& decoded){
+            if(!data_len){
+                return true;
+            }
+            auto chunk = unframe ? ec::Eurasure::unframeChunk(decoded) : decoded;
+            auto value = offset >= chunk.size() ? std::string() : chunk.substr(offset, data_len);
+            value.resize(data_len, '\0');
+            return dev::sha3(value) == target_state;
+        };
+    }
+
+    /**
+    * @brief 解码第 lost 个 chunk 并校验；校验失败时用多余的 chunk 定位错误的 chunk，并把其持有节点加入黑名单
+    *
+    * 收到的 chunk 多于 k 个时，依次只用其中 k 个解码，第一个通过校验的组合中的 chunk 都是正确的；
+    * 再把组合外的 chunk 逐个替换进去解码，不能通过校验的即为错误的 chunk。
+    * 只有 k 个 chunk 且校验失败时无法定位，由调用者再多请求一个 chunk 后重试。
+    *
+    * @param peers 每个位置所在的节点，用于加入黑名单
+    * @param out 通过校验的解码结果
+    * @return 是否得到通过校验的结果
+    */
+    bool decodeVerified(std::vector<std::string> const& raw_data, size_t p_number, int lost, size_t range_len,
+        std::function<bool(std::string const&)> const& verify, std::vector<int> const& peers,
+        std::vector<dev::h256> const& hashes, std::string& out){
+        size_t k = raw_data.size() - p_number;
+        std::vector<size_t> present;
+        for(size_t i = 0; i < raw_data.size(); i++){
+            if((int)i != lost && !raw_data[i].empty()){
+                present.push_back(i);
+            }
+        }
+        if(lost < 0 || present.size() < k){
+            return false;
+        }
+        auto attempt = [&](std::vector<size_t> const& use, std::string& ret){
+            std::vector<std::string> subset(raw_data.size());
+            for(auto i : use){
+                subset[i] = raw_data[i];
+            }
+            ret = mpt_ptr->state_erasure->decodeFromMPT(subset, p_number, lost, range_len);
+            return verify(ret);
+        };
+        if(attempt(present, out)){
+            return true;
+        }
+
+        // 按字典序枚举 present 中的 k 个位置
+        std::vector<size_t> pick(k);
+        for(size_t n = 0; n < k; n++){
+            pick[n] = n;
+        }
+        for(size_t tries = 0; tries < c_maxLocateAttempts && present.size() > k; tries++){
+            std::vector<size_t> use;
+            for(auto n : pick){
+                use.push_back(present[n]);
+            }
+            if(attempt(use, out)){
+                std::string ignored;
+                for(auto i : present){
+                    if(std::find(use.begin(), use.end(), i) != use.end()){
+                        continue;
+                    }
+                    auto swapped = use;
+                    swapped[0] = i;
+                    if(!attempt(swapped, ignored)){
+                        blacklistPeer(peers[i], hashes[i]);
+                    }
+                }
+                return true;
+            }
+            int n = (int)k - 1;
+            while(n >= 0 && pick[n] == present.size() - k + n){
+                n--;
+            }
+            if(n < 0){
+                break;
+            }
+            pick[n]++;
+            for(size_t m = n + 1; m < k; m++){
+                pick[m] = pick[m - 1] + 1;
+            }
+        }
+        return false;
+    }
+
+    // 节点的预计响应延迟（毫秒），没有记录时返回 -1
+    double expectedLatency(int peer){
+        std::lock_guard<std::mutex> l(x_peer_latency);
+        auto it = peer_latency.find(peer);
+        return it == peer_latency.end() ? -1 : it->second;
+    }
+
+    void recordLatency(int peer, double ms, bool ok){
+        if(!ok){
+            ms = std::max(ms, c_failedPeerLatency);
+        }
+        std::lock_guard<std::mutex> l(x_peer_latency);
+        auto it = peer_latency.find(peer);
+        if(it == peer_latency.end()){
+            peer_latency[peer] = ms;
+        }
+        else{
+            it->second = 0.7 * it->second + 0.3 * ms;
+        }
+    }
+
+    // 模拟网络往返延迟，请求被取消后立即返回
+    static void simulatedDelay(std::atomic<bool> const& cancelled, std::chrono::microseconds delay){
+        auto until = std::chrono::steady_clock::now() + delay;
+        while(!cancelled){
+            auto now = std::chrono::steady_clock::now();
+            if(now >= until){
+                break;
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - now, std::chrono::milliseconds(1)));
+        }
+    }
+
+    /**
+    * @brief 向编码组的各持有节点请求 chunk，收到 need 个有效 chunk 后立即返回并取消其余请求
+    *
+    * 按节点的历史延迟从快到慢排序，先向最快的 need 个节点请求；这批节点中有请求失败时立即向下一个节点补发，
+    * 超过这批节点中最慢者预计延迟的 hedge_factor 倍仍未收齐时向其余全部节点补发。
+    * 有节点没有延迟记录时不做对冲，直接向全部节点请求。
+    * 请求在 fetch_pool 中执行，返回后仍在进行的请求只会写入共享状态，read 需按值捕获所需的数据。
+    *
+    * @param peers 每个位置所在的节点
+    * @param need 解码需要的 chunk 个数
+    * @param raw_data 已有的 chunk（非空的位置不再请求），返回时填入收到的 chunk
+    * @param skip 不需要请求的位置（待恢复的 chunk），没有时为 -1
+    * @param read 读取第 i 个位置的 chunk，无效时返回空；cancelled 置位后应尽快返回
+    * @return raw_data 中非空的 chunk 个数
+    */
+    size_t fetchFirstK(std::vector<int> const& peers, size_t need, std::vector<std::string>& raw_data, int skip, ChunkReader read){
+        struct FetchState {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<std::string> results;
+            size_t valid = 0;
+            size_t failed = 0;
+            size_t finished = 0;
+            std::atomic<bool> cancelled{false};
+        };
+        auto state = std::make_shared<FetchState>();
+        state->results.resize(raw_data.size());
+
+        size_t present = 0;
+        std::vector<size_t> order;
+        for(size_t i = 0; i < raw_data.size(); i++){
+            if(!raw_data[i].empty()){
+                present++;
+            }
+            else if((int)i != skip){
+                order.push_back(i);
+            }
+        }
+        if(present >= need){
+            return present;
+        }
+        std::vector<double> latency(raw_data.size(), 0);
+        bool hedge = true;
+        for(auto i : order){
+            latency[i] = expectedLatency(peers[i]);
+            hedge = hedge && latency[i] >= 0;
+        }
+        std::stable_sort(order.begin(), order.end(), [&latency](size_t a, size_t b){ return latency[a] < latency[b]; });
+
+        auto issue = [this, state, &peers, read](size_t i){
+            int peer = peers[i];
+            fetch_pool->enqueue([this, state, read, i, peer](){
+                std::string ret;
+                auto t = std::chrono::steady_clock::now();
+                if(!state->cancelled){
+                    ret = read(i, state->cancelled);
+                }
+                if(state->cancelled){
+                    return;
+                }
+                auto ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t).count() / 1000.0;
+                recordLatency(peer, ms, !ret.empty());
+                {
+                    std::lock_guard<std::mutex> l(state->mutex);
+                    if(ret.empty()){
+                        state->failed++;
+                    }
+                    else{
+                        state->results[i] = std::move(ret);
+                        state->valid++;
+                    }
+                    state->finished++;
+                }
+                state->cv.notify_all();
+            });
+        };
+
+        size_t wanted = need - present;
+        size_t issued = hedge ? std::min(wanted, order.size()) : order.size();
+        double slowest = 0;
+        for(size_t n = 0; n < issued; n++){
+            slowest = std::max(slowest, latency[order[n]]);
+            issue(order[n]);
+        }
+        auto hedge_at = std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(slowest * hedge_factor * 1000));
+
+        std::vector<std::string> results;
+        {
+            std::unique_lock<std::mutex> l(state->mutex);
+            size_t replaced = 0; // 已为失败的请求补发的个数
+            while(state->valid < wanted){
+                if(issued < order.size() && state->failed > replaced){
+                    replaced++;
+                    issue(order[issued++]);
+                    continue;
+                }
+                if(issued == order.size() && state->finished == issued){
+                    break;
+                }
+                if(issued < order.size()){
+                    if(state->cv.wait_until(l, hedge_at) == std::cv_status::timeout && state->valid < wanted){
+                        while(issued < order.size()){
+                            issue(order[issued++]);
+                        }
+                    }
+                }
+                else{
+                    state->cv.wait(l);
+                }
+            }
+            state->cancelled = true;
+            results = std::move(state->results);
+            state->results.assign(raw_data.size(), std::string());
+        }
+        for(size_t i = 0; i < results.size(); i++){
+            if(!results[i].empty()){
+                raw_data[i] = std::move(results[i]);
+                present++;
+            }
+        }
+        return present;
+    }
+
+    // 编码前压缩过 chunk 时，校验块是由帧计算的，读到的前 n 个数据块需转成帧后再解码
+    void frameDataChunks(std::vector<std::string>& raw_data, size_t n){
+        if(!mpt_ptr->state_erasure->compressChunks()){
+            return;
+        }
+        for(size_t i = 0; i < n && i < raw_data.size(); i++){
+            if(!raw_data[i].empty()){
+                auto frame = ec::Eurasure::frameChunk(dev::bytesConstRef(&raw_data[i]), true);
+                raw_data[i].assign(frame.begin(), frame.end());
+            }
+        }
+    }
+
+    /**
+    * @brief 重建失效节点 failed_node 在 BMT_map 全部区块中负责的 chunk 与校验块，写入本地 chunkStore / chunkDB
+    *
+    * 与 recoverState 逐个状态恢复不同，每个编码组最多解码一次，其余节点的 chunk 经 readChunk 读取，
+    * 同时进行的请求不超过 concurrency 个。
+    */
+    dev::mptstate::RebuildMetrics rebuildNode(int failed_node, int node_number, size_t concurrency = 8){
+        dev::mptstate::RebuildConfig config;
+        config.node_number = node_number;
+        config.failed_node = failed_node;
+        config.concurrency = concurrency;
+        dev::mptstate::NodeRebuilder rebuilder(mpt_ptr->chunkStore, mpt_ptr->chunkDB, mpt_ptr->state_erasure, config,
+            [this](dev::h256 const& key, int block_number, int holder){ return readChunk(key, block_number, holder); });
+        return rebuilder.rebuild(mpt_ptr->BMT_map);
+    }
+
     void recoverState(dev::h256& target_state, int idx, int location = 0){
         
         // 记录时间和状态大小
@@ -205,9 +645,16 @@ public:
         
         // std::cout<< tree.bmt_root <<std::endl;
         
-        auto encoded_sets = tree.findAncestorsAndLeaves(target);
+        // 是否只读取每个 chunk 中 [offset, offset + len) 的区间进行恢复；编码前压缩过 chunk 时偏移失效，只能整块恢复
+        bool Is_Substr_Coding = !mpt_ptr->state_erasure->compressChunks();
 
-        std::unordered_map<dev::h256, std::string> chunks_pool;
+        // 之前的恢复已经读到或解码出目标 chunk 时直接从内存返回
+        std::string cached;
+        if(lookupCachedChunk(target, Is_Substr_Coding, _offset, len, cached)){
+            return;
+        }
+
+        auto encoded_sets = tree.findAncestorsAndLeaves(target);
 
         for(const auto& set: encoded_sets){
             auto ancestor = tree.search(set.first);
@@ -226,22 +673,25 @@ public:
             std::vector<std::string> raw_data;
             // 测试选项
             bool Is_Test_Coding = true; // 解码完成后仍要继续往根编码组恢复
-            bool Is_Substr_Coding = true; // 是否将整个 chunk 切成 small_chunk 进行恢复
+            int lost = -1; // 目标 chunk 在编码组中的位置
+            // 各位置的持有节点与 hash，整块读取的 chunk 校验失败时把持有节点加入黑名单
+            auto first = set.second[0];
+            int nodeId_start = locationChunk(first, bmt_index);
+            std::vector<int> peers;
+            std::vector<dev::h256> hashes(set.second.begin(), set.second.end());
+            hashes.insert(hashes.end(), ancestor->p.begin(), ancestor->p.end());
+            for(size_t i = 0; i < hashes.size(); i++){
+                peers.push_back(nodeId_start + i);
+            }
 
             for(const auto& _target: set.second){
                 std::cout<<"---The Target of This round---\n" << _target <<std::endl;
                 // 后期可以改成并行请求  
                 // 之前已经读取过对应的 chunk
-                if(chunks_pool.count(_target)) {
+                std::string pooled;
+                if(_target != target && lookupCachedChunk(_target, Is_Substr_Coding, _offset, len, pooled)) {
                     std::cout<<"The chunk is already in Pool" << std::endl;
-                    auto ret = chunks_pool[_target];
-                    
-                    // 切成 小块
-                    if(Is_Substr_Coding){
-                        ret = getSubstring(ret, _offset, len);
-                    }
-
-                    raw_data.push_back(ret);
+                    raw_data.push_back(pooled);
                     cnt++;
                 }
                 else{
@@ -250,27 +700,47 @@ public:
                     if(_target != target){
                         
                         // 从本地磁盘或者其他节点获取
-                        ret = readChunk(_target, bmt_index);
+                        int peer = peers[raw_data.size()];
+                        if(!isBlacklisted(peer)){
+                            ret = Is_Substr_Coding ? readChunkRange(_target, _offset, len, bmt_index) : readChunk(_target, bmt_index);
+                        }
+                        if(!Is_Substr_Coding && !ret.empty() && !validChunk(_target, ret, false)){
+                            blacklistPeer(peer, _target);
+                            ret.clear();
+                        }
                         if(!ret.empty()){
                             std::cout<<"The Size of " << "dev::RLP(ret)" << " is " << ret.size() 
                                 << ":" <<_target <<std::endl;
-                            chunks_pool[_target] = ret;
+                            // 整块已按 hash 校验，可以立即缓存；区间切片要等解码校验通过后再缓存
+                            if(!Is_Substr_Coding){
+                                cacheChunk(_target, Is_Substr_Coding, _offset, len, ret, false);
+                            }
                             cnt++;
                         }
-                        // 切成 小块
-                        if(Is_Substr_Coding){
-                            ret = getSubstring(ret, _offset, len);
-                        }
                         else
                             std::cout << "Not Found!" << std::endl;
                     }
+                    else{
+                        lost = raw_data.size();
+                    }
                     raw_data.push_back(ret);
                 }
                 std::cout<<"-------------------------------" << std::endl;
             }
-            // 插入冗余块，但是他不需要插入内存中
+            // 插入冗余块，上层编码组的恢复还会用到同一个校验块，同样放入缓存
             for(const auto _p: ancestor->p){
-                auto _ret = readChunk(_p, bmt_index);
+                std::string _ret;
+                int peer = peers[raw_data.size()];
+                if(!lookupCachedChunk(_p, Is_Substr_Coding, _offset, len, _ret) && !isBlacklisted(peer)){
+                    _ret = Is_Substr_Coding ? readChunkRange(_p, _offset, len, bmt_index) : readChunk(_p, bmt_index);
+                    if(!Is_Substr_Coding && !_ret.empty() && !validChunk(_p, _ret, true)){
+                        blacklistPeer(peer, _p);
+                        _ret.clear();
+                    }
+                    if(!Is_Substr_Coding){
+                        cacheChunk(_p, Is_Substr_Coding, _offset, len, _ret, true);
+                    }
+                }
 
                 if(!_ret.empty()){
                     cnt++;
@@ -279,10 +749,6 @@ public:
                 else{
                     std::cout << "Not Found!" << std::endl;
                 }
-                // 切成 小块
-                if(Is_Substr_Coding){
-                    _ret = getSubstring(_ret, _offset, len);
-                }
                 raw_data.push_back(_ret);
             }
             // 如果收到的 chunks 数量满足该编码组的恢复阈值（总数：set.second.size()， 容错：(ancestor->p).size()
@@ -290,7 +756,24 @@ public:
                 // 开始针对编码组来构造编码结构（如数据所在的位置）
                 std::cout << "It is ready to decoding!"<< std::endl;
                 std::cout << "Raw_data lengh is "<< raw_data.size() << ", p number is " << ancestor->p.size() << std::endl;
-                auto _str = mpt_ptr->state_erasure->decodeFromMPT(raw_data, ancestor->p.size());
+                auto framed = raw_data;
+                frameDataChunks(framed, set.second.size());
+                std::string _str;
+                if(!decodeVerified(framed, ancestor->p.size(), lost, Is_Substr_Coding ? len : 0,
+                    stateVerifier(target_state, d, Is_Substr_Coding), peers, hashes, _str)){
+                    raw_data.clear();
+                    writeToLog("Decoded chunk failed verification, turn to next round. " + toString(target),"output_decode_log.txt");
+                    continue;
+                }
+                // 解码通过校验后才缓存区间切片，decodeVerified 定位出的错误切片（其节点已进黑名单）不进入缓存
+                if(Is_Substr_Coding){
+                    for(size_t i = 0; i < raw_data.size(); i++){
+                        if((int)i != lost && !raw_data[i].empty() && !isBlacklisted(peers[i])){
+                            cacheChunk(hashes[i], Is_Substr_Coding, _offset, len, raw_data[i], i >= set.second.size());
+                        }
+                    }
+                }
+                cacheChunk(target, Is_Substr_Coding, _offset, len, _str, false);
                 // cout << _offset << " " << d.getDataLength() << " " << _str.size() << endl;
                 // cout << " Decode result :"<< RLP(_str.substr(_offset, d.getDataLength())) << endl;
                 
@@ -343,15 +826,8 @@ public:
 
         // 测试选项
         bool Is_Test_Coding = false; // 解码完成后仍要继续往根编码组恢复
-        bool Is_Substr_Coding = false; // 是否将整个 chunk 切成 small_chunk 进行恢复
-
-        // 因为我们采用在前面的补0的策略，但是在实际中0依然消耗编码时间
-        // 为了测试切小块后的效果，我们将其转化成仅仅测试 offset = 0 的状态，以达到相同效果
-        if(Is_Substr_Coding){
-            if(_offset != 0){
-                return;
-            }
-        }
+        // 是否只读取每个 chunk 中 [offset, offset + len) 的区间进行恢复；编码前压缩过 chunk 时偏移失效，只能整块恢复
+        bool Is_Substr_Coding = !mpt_ptr->state_erasure->compressChunks();
 
         // cout << " Target State :" << target_state << " Node:" << idx << " Location:" << location << endl;
         // cout << " offset :" << _offset << " len:" << len << endl;
@@ -377,9 +853,12 @@ public:
         
         // std::cout<< tree.bmt_root <<std::endl;
         
-        auto encoded_sets = tree.findAncestorsAndLeaves(target);
+        std::string cached;
+        if(lookupCachedChunk(target, Is_Substr_Coding, _offset, len, cached)){
+            return;
+        }
 
-        std::unordered_map<dev::h256, std::string> chunks_pool;
+        auto encoded_sets = tree.findAncestorsAndLeaves(target);
 
         auto t1_3 = std::chrono::steady_clock::now();
 
@@ -396,7 +875,6 @@ public:
             //     continue;
             // }
             
-            atomic<int> cnt(0);
             std::vector<std::string> raw_data(set.second.size() + ancestor->p.size());
             // cout<< "lengh dc:" << set.second.size() << "and and pc " <<  ancestor->p.size() << endl; 
             
@@ -407,86 +885,70 @@ public:
 
             auto t1_4 = std::chrono::steady_clock::now();
 
-            // 并行请求
-            tbb::parallel_for(size_t(0), set.second.size() + ancestor->p.size(), [&](size_t i){
-                
-                // 插入冗余块，但是他不需要插入内存中
-                if(i >= set.second.size()){
-                    
-                    auto _p = (ancestor->p)[i - set.second.size()];
-                    auto _ret = readChunk(_p, bmt_index, nodeId_start + i);
-                    // cout<< " 校验块大小 before" << _ret.size() <<endl;
-                    if(!_ret.empty()){
-                        cnt++;
-                        // std::cout<<"encoded chunk insert!"<<std::endl;
-                    } 
-                    else{
-                        // std::cout << "Not Found!" << std::endl;
-                    }
-                    // 切成 小块
-                    if(Is_Substr_Coding){
-                        _ret = getSubstring(_ret, _offset, len);
-                        // cout << "After cutting len:" << _ret.size() << endl;
-                    }
-                    std::this_thread::sleep_for(std::chrono::microseconds(10000 * 2));
-                    raw_data[i] = _ret;
-                    // cout<< " 校验块大小 " << _ret.size() <<endl;
+            // 之前已经读取过的 chunk 直接放入，目标 chunk 不请求
+            int lost = -1;
+            std::vector<dev::h256> hashes;
+            std::vector<int> peers;
+            for(size_t i = 0; i < raw_data.size(); i++){
+                hashes.push_back(i < set.second.size() ? set.second[i] : ancestor->p[i - set.second.size()]);
+                peers.push_back(nodeId_start + i);
+                if(hashes[i] == target){
+                    lost = i;
                 }
                 else{
-                    auto _target = (set.second)[i];
-                    // std::cout<<"---The Target of This round---" << _target <<std::endl;
-
-                    // 之前已经读取过对应的 chunk
-                    if(chunks_pool.find(_target) != chunks_pool.end()) {
-                        // std::cout<<"The chunk is already in Pool" << std::endl;
-                        auto ret = chunks_pool[_target];
-                        
-                        // 切成 小块
-                        if(Is_Substr_Coding){
-                            ret = getSubstring(ret, _offset, len);
-                            // cout << "After cutting len:" << ret.size() << endl;
-                        }
+                    lookupCachedChunk(hashes[i], Is_Substr_Coding, _offset, len, raw_data[i]);
+                }
+            }
 
-                        raw_data[i] = ret;
-                        cnt++;
-                    }
-                    else{
-                        std::string ret;
-                        
-                        if(_target != target){
-                            
-                            // 从本地磁盘或者其他节点获取
-                            ret = readChunk(_target, bmt_index, nodeId_start + i);
-                            if(!ret.empty()){
-                                // std::cout<<"The Size of " << "dev::RLP(ret)" << " is " << ret.size() 
-                                //     << ":" <<_target <<std::endl;
-                                chunks_pool[_target] = ret;
-                                cnt++;
-                            }
-                            // 切成 小块
-                            if(Is_Substr_Coding){
-                                ret = getSubstring(ret, _offset, len);
-                                // cout << "After cutting len:" << ret.size() << endl;
-                            }
-                            else{
-                                // std::cout << "Not Found!" << std::endl;
-                            }
-                        }
-                        std::this_thread::sleep_for(std::chrono::microseconds(10000 * 2));
-                        raw_data[i] = ret;
-                    }
+            // 向全部持有节点请求，收到 k 个有效 chunk 即开始解码；整块读取时用 chunk 的 hash 校验，区间读取在解码后校验
+            size_t data_number = set.second.size();
+            ChunkReader read = [this, hashes, peers, data_number, bmt_index, Is_Substr_Coding, _offset, len](size_t i, std::atomic<bool> const& cancelled){
+                if(isBlacklisted(peers[i])){
+                    return std::string();
                 }
-                // std::cout<<"-------------------------------" << std::endl;
-            });
+                auto ret = Is_Substr_Coding ? readChunkRange(hashes[i], _offset, len, bmt_index, peers[i])
+                    : readChunk(hashes[i], bmt_index, peers[i]);
+                simulatedDelay(cancelled, std::chrono::microseconds(10000 * 2));
+                if(!Is_Substr_Coding && !ret.empty() && !validChunk(hashes[i], ret, i >= data_number)){
+                    blacklistPeer(peers[i], hashes[i]);
+                    ret.clear();
+                }
+                return ret;
+            };
+            size_t cnt = fetchFirstK(peers, data_number, raw_data, lost, read);
+
+            // 区间切片只能在解码后校验：校验失败时每次多请求一个 chunk，直到能定位出错误的切片
+            std::string _str;
+            bool decoded = false;
+            auto verify = stateVerifier(target_state, d, Is_Substr_Coding);
+            while(cnt >= data_number){
+                auto framed = raw_data;
+                frameDataChunks(framed, data_number);
+                decoded = decodeVerified(framed, ancestor->p.size(), lost, Is_Substr_Coding ? len : 0, verify, peers, hashes, _str);
+                if(decoded){
+                    break;
+                }
+                auto more = fetchFirstK(peers, cnt + 1, raw_data, lost, read);
+                if(more <= cnt){
+                    break;
+                }
+                cnt = more;
+            }
+            // 请求已全部返回或取消，只有当前线程写缓存
+            for(size_t i = 0; i < raw_data.size(); i++){
+                if((int)i != lost && decoded && !isBlacklisted(peers[i])){
+                    cacheChunk(hashes[i], Is_Substr_Coding, _offset, len, raw_data[i], i >= data_number);
+                }
+            }
 
             auto t1_5 = std::chrono::steady_clock::now();
 
-            // 如果收到的 chunks 数量满足该编码组的恢复阈值（总数：set.second.size()， 容错：(ancestor->p).size()
-            if(cnt >= raw_data.size() - ancestor->p.size()){
+            // 收到的 chunk 满足该编码组的恢复阈值且解码结果通过校验
+            if(decoded){
                 // 开始针对编码组来构造编码结构（如数据所在的位置）
                 // std::cout << "It is ready to decoding!"<< std::endl;
                 // std::cout << "Raw_data lengh is "<< raw_data.size() << ", p number is " << ancestor->p.size() << std::endl;
-                auto _str = mpt_ptr->state_erasure->decodeFromMPT(raw_data, ancestor->p.size(), idx);
+                cacheChunk(target, Is_Substr_Coding, _offset, len, _str, false);
                 // cout << _offset << " " << d.getDataLength() << " " << _str.size() << endl;
                 // cout << " Decode result :"<< RLP(_str.substr(_offset, d.getDataLength())) << endl;
                 
@@ -520,7 +982,6 @@ public:
             }
             else{
                 raw_data.clear();
-                malicious_nodes = 0;
                 // std::cout << "No ready to decoding, turn to next round." << std::endl;
                 // writeToLog("No ready to decoding, turn to next round. " + toString(target),"output_decode_log.txt");
             }
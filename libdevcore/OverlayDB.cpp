@@ -20,6 +20,7 @@
 #include "TrieCommon.h"
 #include "db.h"
 #include <thread>
+#include <unordered_set>
 
 namespace dev
 {
@@ -106,12 +107,14 @@ void OverlayDB::commit()
 }
 
 // 将内存内容与编码内容一起写入db
-void OverlayDB::commit(std::unordered_map<h256, std::string> totalEncodedData, std::vector<std::vector<h256>> partition_result, int node_index){
+void OverlayDB::commit(std::unordered_map<h256, std::string> const& totalEncodedData, std::vector<std::vector<h256>> const& partition_result, int node_index){
     if (m_db)
     {
         auto writeBatch = m_db->createWriteBatch();
 //      cnote << "Committing nodes to disk DB:";
         std::cout<<"Committing nodes to disk DB:"<<std::endl;
+        // 本节点负责的 key，避免对每个 key 线性查找划分结果
+        std::unordered_set<h256> owned(partition_result[node_index].begin(), partition_result[node_index].end());
 #if DEV_GUARDED_DB
         DEV_READ_GUARDED(x_this)
 #endif
@@ -121,8 +124,7 @@ void OverlayDB::commit(std::unordered_map<h256, std::string> totalEncodedData, s
                 // std::cout<<"Item in m_main:"<< i.first<<std::endl;
                 // std::cout<<" || Value:"<< m_main[i.first].first << ", " << m_main[i.first].second << std::endl;
                 if (i.second.second){
-                    auto it = std::find(partition_result[node_index].begin(), partition_result[node_index].end(), i.first);
-                    if(it != partition_result[node_index].end()){
+                    if(owned.count(i.first)){
                         // 该值属于该节点
                         writeBatch->insert(toSlice(i.first), toSlice(i.second.first));
                         // std::cout << "Item in m_main:" <<i.first << std::endl;
@@ -140,8 +142,7 @@ void OverlayDB::commit(std::unordered_map<h256, std::string> totalEncodedData, s
                 }
             
             for(auto const& i : totalEncodedData){
-                auto it = std::find(partition_result[node_index].begin(), partition_result[node_index].end(), i.first);
-                if(it != partition_result[node_index].end()){
+                if(owned.count(i.first)){
                     // 该值属于该节点
                     writeBatch->insert(toSlice(i.first), toSlice(i.second));
                     // std::cout<<"A Encoded Data is :"<< i.first << " # " << i.second << std::endl;
@@ -180,7 +181,7 @@ void OverlayDB::commit(std::unordered_map<h256, std::string> totalEncodedData, s
     }
 }
 
-void OverlayDB::commit(std::unordered_map<h256, std::string> totalEncodedData)
+void OverlayDB::commit(std::unordered_map<h256, std::string> const& totalEncodedData)
 {
     if (m_db)
     {
@@ -263,6 +264,37 @@ bytes OverlayDB::lookupAux(h256 const& _h) const
     return asBytes(v);
 }
 
+void OverlayDB::commitEncoded(std::unordered_map<h256, std::string> const& totalEncodedData)
+{
+    if (!m_db || totalEncodedData.empty())
+        return;
+
+    auto writeBatch = m_db->createWriteBatch();
+    for (auto const& i : totalEncodedData)
+        writeBatch->insert(toSlice(i.first), toSlice(i.second));
+
+    for (unsigned i = 0; i < 10; ++i)
+    {
+        try
+        {
+            m_db->commit(std::move(writeBatch));
+            break;
+        }
+        catch (boost::exception const& ex)
+        {
+            if (i == 9)
+            {
+                LOG(WARNING) << "Fail writing to state database. Bombing out.";
+                exit(-1);
+            }
+            LOG(WARNING) << "Error writing to state database: "
+                         << boost::diagnostic_information(ex);
+            LOG(WARNING) << "Sleeping for" << (i + 1) << "seconds, then retrying.";
+            std::this_thread::sleep_for(std::chrono::seconds(i + 1));
+        }
+    }
+}
+
 void OverlayDB::rollback()
 {
 #if DEV_GUARDED_DB
@@ -44,9 +44,11 @@ public:
 
     void commit();
     // 2024/10/24 与编码块一起提交
-    void commit(std::unordered_map<h256, std::string> totalEncodedData, std::vector<std::vector<h256>> partition_result, int node_index);
+    void commit(std::unordered_map<h256, std::string> const& totalEncodedData, std::vector<std::vector<h256>> const& partition_result, int node_index);
     // 2025/01/09 仅仅与编码块一起提交
-    void commit(std::unordered_map<h256, std::string> totalEncodedData);
+    void commit(std::unordered_map<h256, std::string> const& totalEncodedData);
+    // 2025/03/16 仅写入编码块，不触碰内存中的状态节点（流水线持久化阶段使用）
+    void commitEncoded(std::unordered_map<h256, std::string> const& totalEncodedData);
 
     void rollback();
 
@@ -9,6 +9,7 @@
  * @author qqf
  * @date 2024-10-30
  */
+#pragma once
 
 #include "Account.h"
 #include "CodeSizeCache.h"
@@ -40,6 +41,10 @@ namespace dev{
         std::vector<h256> p; // 校验块
         std::shared_ptr<Node> left_child;  // 子节点（二叉） 如果是空的那么就是
         std::shared_ptr<Node> right_child;
+        // 子树覆盖的叶子在 BMT::leaves 中的区间 [_begin, _end)
+        // 奇数时最后一个节点会与前一个节点再配对一次，左右子树区间相接，父节点区间仍然连续
+        uint _begin = 0;
+        uint _end = 0;
 
         Node(h256 h, uint i): _index(i), _hash(h), left_child(nullptr), right_child(nullptr) {
             // std::cout << "叶子节点hash:"<< _hash << "#" << _index << std::endl;
@@ -48,6 +53,8 @@ namespace dev{
             _hash = sha3(dev::toString(l->_hash) + dev::toString(r->_hash));
             left_child = l;
             right_child = r;
+            _begin = l->_begin;
+            _end = r->_end;
             // std::cout << "节点hash:"<< _hash << "#" << _index << std::endl;
         }
 
@@ -187,36 +194,54 @@ namespace dev{
         std::shared_ptr<Node> bmt_root; // 根哈希
         // std::unordered_map<h256, uint> account_to_num; // 状态数据到编号的映射
         std::unordered_map<h256, std::string> state_cache; // MPT节点的KV表现形式 其中string为编码过的数据 需要调用RLP解码
-        std::map<h256, std::vector<h256>> ancestors_leaves;
+        std::vector<h256> leaves; // 按编号排序的叶子，祖先节点以区间引用
+        std::vector<uint> leaf_chunk; // 叶子位置 -> chunk 下标（MerkleTrees 的下标）
         vector<_MerkleTree> MerkleTrees;
         int l = 0; // 树的高度
 
         BMT(const std::unordered_map<h256, uint> data_list) {
             buildTree(data_list);
-            traverseNonLeafNodes(bmt_root);
         } 
         // 真实系统返回的存储在系统的 cache 为 std::unordered_map<h256, std::string>
         BMT(std::unordered_map<h256, std::string>& get_cache) {
             state_cache = get_cache;
             buildTree(assignIndices(state_cache));
-            traverseNonLeafNodes(bmt_root);
             std::cout<<"BMTRoot make from each state = "<< bmt_root -> _hash <<std::endl;
         }
         // 已经制作好的 chunks
-        BMT(vector<string> chunks) {
+        // size_aware 为 true 时叶子按 chunk 大小排序，使大小相近的 chunk 落入同一编码组，减少补 0；
+        // MerkleTrees 仍按 chunk 原顺序保存，叶子与 chunk 的对应关系见 leaf_chunk
+        BMT(vector<string> chunks, bool size_aware = false) {
             std::unordered_map<h256, uint> chunk_to_node;
             int cnt = 0;
             // 计算耗时
             auto t1 = std::chrono::steady_clock::now();
             auto _max = t1 - t1;
 
+            // chunk 下标 -> 叶子编号
+            std::vector<uint> rank(chunks.size());
+            for(size_t i = 0; i < rank.size(); i++){
+                rank[i] = i;
+            }
+            if(size_aware){
+                std::vector<uint> order(rank);
+                std::stable_sort(order.begin(), order.end(), [&](uint a, uint b){
+                    return chunks[a].size() < chunks[b].size();
+                });
+                for(size_t i = 0; i < order.size(); i++){
+                    rank[order[i]] = i;
+                }
+            }
+            std::unordered_map<h256, uint> chunk_index;
+
             for(auto& chunk : chunks){
 
                 _MerkleTree mTree(splitStr(chunk, 100)); // chunk 切分为n块
                 auto chunk_hash = mTree.root->hash;
                 state_cache[chunk_hash] = chunk;
                 
-                chunk_to_node[chunk_hash] = cnt++;
+                chunk_index[chunk_hash] = cnt;
+                chunk_to_node[chunk_hash] = rank[cnt++];
                 MerkleTrees.push_back(mTree);
 
                 // 记录耗时最高的 build chunk
@@ -230,6 +255,10 @@ namespace dev{
             auto t2 = std::chrono::steady_clock::now();
 
             buildTree(chunk_to_node);
+            leaf_chunk.clear();
+            for(auto const& leaf : leaves){
+                leaf_chunk.push_back(chunk_index[leaf]);
+            }
 
             // 记录构建BMT的耗时
             auto t3 = std::chrono::steady_clock::now();
@@ -240,7 +269,6 @@ namespace dev{
                 + "Sum:" + dev::toString(BMT_time + MPT_time);
             writeToLog(logStr,"output_log.txt");
 
-            traverseNonLeafNodes(bmt_root);
             std::cout<<"BMTRoot make from chunks = "<< bmt_root -> _hash <<std::endl;
         }
         BMT(){}   
@@ -316,6 +344,12 @@ namespace dev{
             std::sort(current_level.begin(),current_level.end(), [](const std::shared_ptr<Node>& a, const std::shared_ptr<Node>& b){
                 return a->_index < b->_index; // 按照int升序排序
             });
+            leaves.clear();
+            for(auto& leaf : current_level){
+                leaf->_begin = leaves.size();
+                leaf->_end = leaf->_begin + 1;
+                leaves.push_back(leaf->_hash);
+            }
 
             // 构建树的各个层级
             while (current_level.size()>1){
@@ -457,45 +491,37 @@ namespace dev{
         */
         void recordLeaves(const std::shared_ptr<Node>& node, std::vector<h256>& leaves) const {
             if(!node) return;
+            leaves.insert(leaves.end(), this->leaves.begin() + node->_begin, this->leaves.begin() + node->_end);
+        }
 
-            // 叶子节点
-            if(!node->left_child && !node->right_child){
-                // std::cout << "Leaf Hash:" << node->_hash << " # " << node->_index << std::endl;
-                if(std::find(leaves.begin(), leaves.end(), node->_hash) == leaves.end())
-                    leaves.push_back(node->_hash);
+        /**
+        * @brief 与 BMT(vector<string> chunks) 相同：chunk 按 100 字节切分后的 Merkle 根，即叶子 hash
+        */
+        static h256 chunkRoot(std::string const& chunk) {
+            std::vector<h256> level;
+            for(size_t i = 0; i < chunk.size(); i += 100){
+                level.push_back(sha3(chunk.substr(i, 100)));
             }
-
-            else{
-                // 递归遍历左右子树，直到找到叶子节点
-                recordLeaves(node->left_child, leaves);
-                recordLeaves(node->right_child, leaves);
+            while(level.size() > 1){
+                std::vector<h256> next;
+                for(size_t i = 0; i < level.size(); i += 2){
+                    auto const& right = i + 1 < level.size() ? level[i + 1] : level[i];
+                    next.push_back(sha3(toString(level[i]) + toString(right)));
+                }
+                level.swap(next);
             }
+            return level.empty() ? h256() : level[0];
         }
 
         /**
-        * @brief 遍历BMT
-        * 
-        * 将每一个子树的根节点和叶子节点记录在 this.ancestors_leaves 中
-        * 
-        * @param node 当前节点指针
+        * @brief 第 i 个叶子（chunk）的数据，不拷贝
         */
-        void traverseNonLeafNodes(const std::shared_ptr<Node>& node){
-            
-            // 如果节点为空
-            if(node == nullptr){
-                return;
-            }
-            
-            if(node->left_child != nullptr || node->right_child != nullptr){
-                std::vector<h256> leaves;
-                // std::cout << "Ancestors Node Hash:" << node->_hash << " # " << node->_index <<std::endl;
-                // std::cout << "Leaves in this subtree:\n";
-                recordLeaves(node, leaves);
-                ancestors_leaves.insert(make_pair(node->_hash, leaves));
+        bytesConstRef leafData(size_t i) const {
+            auto it = state_cache.find(leaves[i]);
+            if(it == state_cache.end()){
+                return bytesConstRef();
             }
-
-            traverseNonLeafNodes(node->left_child);
-            traverseNonLeafNodes(node->right_child);
+            return bytesConstRef((byte const*)it->second.data(), it->second.size());
         }
 
         /**
@@ -0,0 +1,251 @@
+/**
+ * @编码块的 RocksDB 持久化层
+ *功能包括：
+ * 1. 数据块（chunk）、校验块（parity）和元数据（BMT 结构）分别存放在三个列族中
+ * 2. 每个列族单独配置压缩与布隆过滤器：数据块压缩，校验块近似随机数据不压缩，元数据不建布隆过滤器
+ * 3. 一个区块的全部数据块、校验块和元数据在同一个 WriteBatch 中写入，只产生一次顺序写
+ *
+ * 元数据列族中：
+ *   "block|<区块号>" -> RLP[BMT 根, [叶子 chunk hash...]]
+ *   祖先节点 hash    -> RLP[校验块 hash...]
+ *
+ * @file ChunkDB.h
+ * @author qqf
+ * @date 2025-03-17
+ */
+#pragma once
+
+#include "BMT.h"
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/RLP.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rocksdb/db.h"
+#include "rocksdb/filter_policy.h"
+#include "rocksdb/options.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/table.h"
+#include "rocksdb/write_batch.h"
+
+namespace dev
+{
+namespace mptstate
+{
+
+class ChunkDB
+{
+public:
+    enum Column {
+        Data = 0,   // 数据块
+        Parity = 1, // 校验块
+        Meta = 2    // BMT 元数据
+    };
+
+    ChunkDB() {}
+    ~ChunkDB() { close(); }
+
+    ChunkDB(ChunkDB const&) = delete;
+    ChunkDB& operator=(ChunkDB const&) = delete;
+
+    /**
+    * @brief 打开（或创建）数据库及三个列族
+    *
+    * @param path 数据库目录
+    * @return 是否成功
+    */
+    bool open(std::string const& path)
+    {
+        rocksdb::DBOptions options;
+        options.create_if_missing = true;
+        options.create_missing_column_families = true;
+
+        std::vector<rocksdb::ColumnFamilyDescriptor> columns;
+        columns.emplace_back(rocksdb::kDefaultColumnFamilyName, rocksdb::ColumnFamilyOptions());
+        columns.emplace_back("data", columnOptions(rocksdb::kLZ4Compression, true));
+        columns.emplace_back("parity", columnOptions(rocksdb::kNoCompression, true));
+        columns.emplace_back("meta", columnOptions(rocksdb::kSnappyCompression, false));
+
+        std::vector<rocksdb::ColumnFamilyHandle*> handles;
+        auto status = rocksdb::DB::Open(options, path, columns, &handles, &m_db);
+        if(!status.ok()){
+            std::cout << "Open chunk db " << path << " failed: " << status.ToString() << std::endl;
+            m_db = nullptr;
+            return false;
+        }
+        m_handles = handles;
+        return true;
+    }
+
+    void close()
+    {
+        if(!m_db){
+            return;
+        }
+        for(auto handle : m_handles){
+            m_db->DestroyColumnFamilyHandle(handle);
+        }
+        m_handles.clear();
+        delete m_db;
+        m_db = nullptr;
+    }
+
+    bool isOpen() const { return m_db != nullptr; }
+
+    /**
+    * @brief 持久化一个区块的数据块、校验块和 BMT 元数据（单个 WriteBatch）
+    *
+    * @param block_number 区块编号
+    * @param bmt 该区块的 BMT（叶子为数据块，祖先节点的 p 为校验块 hash）
+    * @param parity 校验块 hash -> 校验块
+    * @return 是否写入成功
+    */
+    bool writeBlock(int block_number, BMT const& bmt, std::unordered_map<h256, std::string> const& parity)
+    {
+        if(!m_db){
+            return false;
+        }
+        rocksdb::WriteBatch batch;
+
+        RLPStream leaves(bmt.leaves.size());
+        for(size_t i = 0; i < bmt.leaves.size(); i++){
+            auto const& hash = bmt.leaves[i];
+            leaves << hash;
+            auto data = bmt.leafData(i);
+            batch.Put(column(Data), toSlice(hash), rocksdb::Slice((char const*)data.data(), data.size()));
+        }
+
+        for(auto const& i : parity){
+            batch.Put(column(Parity), toSlice(i.first), rocksdb::Slice(i.second));
+        }
+
+        // 祖先节点 -> 校验块 hash
+        std::vector<std::shared_ptr<Node>> stack;
+        if(bmt.bmt_root){
+            stack.push_back(bmt.bmt_root);
+        }
+        while(!stack.empty()){
+            auto node = stack.back();
+            stack.pop_back();
+            if(!node->p.empty()){
+                RLPStream s;
+                s.appendVector(node->p);
+                batch.Put(column(Meta), toSlice(node->_hash), rocksdb::Slice((char const*)s.out().data(), s.out().size()));
+            }
+            // 奇数时节点会被两个父节点共享，重复写入同一个 key 无妨
+            if(node->left_child) stack.push_back(node->left_child);
+            if(node->right_child) stack.push_back(node->right_child);
+        }
+
+        RLPStream block(2);
+        block << (bmt.bmt_root ? bmt.bmt_root->_hash : h256());
+        block.appendRaw(leaves.out());
+        batch.Put(column(Meta), blockKey(block_number), rocksdb::Slice((char const*)block.out().data(), block.out().size()));
+
+        rocksdb::WriteOptions options;
+        options.sync = false;
+        auto status = m_db->Write(options, &batch);
+        if(!status.ok()){
+            std::cout << "Write block " << block_number << " to chunk db failed: " << status.ToString() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 读取某一列族中的值，找不到时返回空串
+    std::string get(Column c, h256 const& key) const
+    {
+        std::string value;
+        if(m_db){
+            m_db->Get(rocksdb::ReadOptions(), column(c), toSlice(key), &value);
+        }
+        return value;
+    }
+
+    // 覆盖写入单个值（修复损坏的 chunk）
+    bool put(Column c, h256 const& key, bytesConstRef value)
+    {
+        if(!m_db){
+            return false;
+        }
+        return m_db->Put(rocksdb::WriteOptions(), column(c), toSlice(key),
+            rocksdb::Slice((char const*)value.data(), value.size())).ok();
+    }
+
+    // 先查数据块，再查校验块
+    std::string lookup(h256 const& key) const
+    {
+        auto value = get(Data, key);
+        return value.empty() ? get(Parity, key) : value;
+    }
+
+    /**
+    * @brief 只取出 chunk 的 [offset, offset + len) 区间（先查数据块，再查校验块）
+    *
+    * 用 PinnableSlice 读取，值留在 block cache 中，只拷贝区间内的字节；超出末尾的部分截断。
+    * @return chunk 是否存在
+    */
+    bool lookupRange(h256 const& key, size_t offset, size_t len, std::string& out) const
+    {
+        if(!m_db){
+            return false;
+        }
+        for(auto c : {Data, Parity}){
+            rocksdb::PinnableSlice value;
+            if(!m_db->Get(rocksdb::ReadOptions(), column(c), toSlice(key), &value).ok() || value.size() == 0){
+                continue;
+            }
+            out = offset >= value.size() ? std::string()
+                : std::string(value.data() + offset, std::min(len, value.size() - offset));
+            return true;
+        }
+        return false;
+    }
+
+    // 区块的 BMT 根与叶子顺序
+    bool blockMeta(int block_number, h256& root, std::vector<h256>& leaves) const
+    {
+        std::string value;
+        if(!m_db || !m_db->Get(rocksdb::ReadOptions(), column(Meta), blockKey(block_number), &value).ok() || value.empty()){
+            return false;
+        }
+        RLP r(value);
+        root = r[0].toHash<h256>();
+        leaves = r[1].toVector<h256>();
+        return true;
+    }
+
+private:
+    static rocksdb::ColumnFamilyOptions columnOptions(rocksdb::CompressionType compression, bool bloom)
+    {
+        rocksdb::ColumnFamilyOptions options;
+        options.compression = compression;
+        if(bloom){
+            rocksdb::BlockBasedTableOptions table;
+            table.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+            options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table));
+        }
+        return options;
+    }
+
+    static rocksdb::Slice toSlice(h256 const& h)
+    {
+        return rocksdb::Slice((char const*)h.data(), h256::size);
+    }
+
+    static std::string blockKey(int block_number)
+    {
+        return "block|" + std::to_string(block_number);
+    }
+
+    // m_handles[0] 为默认列族
+    rocksdb::ColumnFamilyHandle* column(Column c) const { return m_handles[c + 1]; }
+
+    rocksdb::DB* m_db = nullptr;
+    std::vector<rocksdb::ColumnFamilyHandle*> m_handles;
+};
+
+}  // namespace mptstate
+}  // namespace dev
@@ -0,0 +1,380 @@
+/**
+ * @分层的 chunk 保留策略
+ *功能包括：
+ * 1. 热区：最近 hot_window 个区块的数据块与校验块全部保留在 ChunkStore 中
+ * 2. 温区：更早的区块只保留本节点负责的数据块（第 i 个 chunk 属于节点 i % node_number，i 为 chunk 下标而非叶子位置）和全部校验块
+ * 3. 冷区：超过 archive_after 个区块后，剩余的 chunk 以 snappy 压缩移入归档段（archive 目录下的另一个 ChunkStore）
+ * 4. 读取已被淘汰的 chunk 时，沿 BMT 自底向上找到包含它的编码组，读取同组的其他 chunk 与校验块后纠删码恢复；
+ *    温区每组本地只剩约 k / node_number 个数据块，不足的部分经 ChunkFetcher 从持有节点读取（按 Merkle 根 / sha3 校验）
+ *
+ * 每个区块只记录恢复需要的 BMT 结构（根节点、叶子顺序和长度），不依赖 MPTState::BMT_map，
+ * 因此可以在流水线的持久化阶段调用。恢复不会递归：ChunkFetcher 不能再经过 ChunkRetention::read。
+ * 持有位置（holder）与 NodeRebuilder 相同：数据块为其 chunk 下标，第 j 个校验块为组内第一个数据块的 chunk 下标 + k + j。
+ *
+ * @file ChunkRetention.h
+ * @author qqf
+ * @date 2025-03-19
+ */
+#pragma once
+
+#include "BMT.h"
+#include "ChunkStore.h"
+#include "Eurasure.h"
+#include <libdevcore/SnappyCompress.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace dev
+{
+namespace mptstate
+{
+
+struct RetentionConfig {
+    int hot_window = 0;    // 保留全部 chunk 的最近区块数，0 表示不启用
+    int archive_after = 0; // 超过该区块数移入归档段，0 表示不归档
+    int node_number = 1;
+    int node_index = 0;    // 本节点编号
+};
+
+class ChunkRetention
+{
+public:
+    enum Tier {
+        Hot = 0,
+        Warm = 1,
+        Cold = 2
+    };
+
+    ChunkRetention(std::shared_ptr<ChunkStore> store, std::string const& archive_dir, ec::Eurasure* erasure,
+        RetentionConfig const& config)
+      : m_store(store), m_erasure(erasure), m_config(config)
+    {
+        if(m_config.node_number <= 0){
+            m_config.node_number = 1;
+        }
+        if(m_config.archive_after > 0 && !m_archive.open(archive_dir)){
+            m_config.archive_after = 0;
+        }
+    }
+
+    // 从 holder 处读取 chunk，读不到时返回空串
+    typedef std::function<std::string(h256 const& key, int block_number, int holder)> ChunkFetcher;
+
+    bool enabled() const { return m_config.hot_window > 0 && m_store && m_store->isOpen(); }
+
+    // 未设置时只用本地的 chunk 恢复，温区的 chunk 通常无法恢复
+    void setFetcher(ChunkFetcher fetch)
+    {
+        std::lock_guard<std::mutex> l(x_fetch);
+        m_fetch = fetch;
+    }
+
+    /**
+    * @brief 区块的 chunk 已写入 ChunkStore 后调用：记录其 BMT 结构，并按新的高度调整各区块所在的层
+    */
+    void onBlockPersisted(int block_number, BMT const& bmt)
+    {
+        if(!enabled()){
+            return;
+        }
+        BlockLayout layout;
+        layout.root = bmt.bmt_root;
+        layout.leaves = bmt.leaves;
+        layout.leaf_chunk = bmt.leaf_chunk;
+        layout.lengths.reserve(bmt.leaves.size());
+        for(size_t i = 0; i < bmt.leaves.size(); i++){
+            layout.lengths.push_back(bmt.leafData(i).size());
+        }
+        std::lock_guard<std::mutex> l(x_blocks);
+        m_blocks[block_number] = std::move(layout);
+        apply(block_number);
+    }
+
+    /**
+    * @brief 读取 chunk：热区 -> 归档段 -> 纠删码恢复
+    *
+    * @param key chunk hash
+    * @param block_number chunk 所在区块，用于恢复；未知时只读本地
+    */
+    std::string read(h256 const& key, int block_number = 0)
+    {
+        auto ret = readLocal(key);
+        if(!ret.empty() || !enabled()){
+            return ret;
+        }
+        return recoverEvicted(key, block_number);
+    }
+
+    /**
+    * @brief 只读取 chunk 的 [offset, offset + len) 区间
+    *
+    * 热区直接从映射内存截取；归档段按块压缩、淘汰的 chunk 需整块恢复，只能取出整块后截取。
+    * @return chunk 是否存在（区间超出 chunk 末尾时 out 为空）
+    */
+    bool readRange(h256 const& key, int block_number, size_t offset, size_t len, std::string& out)
+    {
+        if(m_store->read(key, [&](bytesConstRef data){ out = ChunkStore::slice(data, offset, len); })){
+            return true;
+        }
+        auto whole = readArchived(key);
+        if(whole.empty() && enabled()){
+            whole = recoverEvicted(key, block_number);
+        }
+        if(whole.empty()){
+            return false;
+        }
+        out = ChunkStore::slice(bytesConstRef(&whole), offset, len);
+        return true;
+    }
+
+    // 本节点在热区与归档段中占用的 chunk 字节数
+    size_t diskUsage() const { return m_store->dataSize() + m_archive.dataSize(); }
+    size_t recoveredCount() const { return m_recovered; }
+    size_t fetchedCount() const { return m_fetched; }
+
+private:
+    struct BlockLayout {
+        std::shared_ptr<Node> root;
+        std::vector<h256> leaves;
+        std::vector<uint32_t> lengths;
+        std::vector<uint> leaf_chunk;
+        Tier tier = Hot;
+    };
+
+    Tier tierOf(int age) const
+    {
+        if(m_config.archive_after > 0 && age >= m_config.archive_after){
+            return Cold;
+        }
+        return age >= m_config.hot_window ? Warm : Hot;
+    }
+
+    static size_t chunkOf(BlockLayout const& layout, size_t leaf)
+    {
+        return leaf < layout.leaf_chunk.size() ? layout.leaf_chunk[leaf] : leaf;
+    }
+
+    bool owned(BlockLayout const& layout, size_t leaf) const
+    {
+        return (int)(chunkOf(layout, leaf) % m_config.node_number) == m_config.node_index;
+    }
+
+    // 需持有 x_blocks
+    void apply(int latest)
+    {
+        size_t evicted = 0;
+        size_t archived = 0;
+        for(auto& b : m_blocks){
+            auto target = tierOf(latest - b.first);
+            auto& layout = b.second;
+            if(layout.tier < Warm && target >= Warm){
+                // 淘汰不属于本节点的数据块，校验块保留
+                std::vector<h256> keys;
+                for(size_t i = 0; i < layout.leaves.size(); i++){
+                    if(!owned(layout, i)){
+                        keys.push_back(layout.leaves[i]);
+                    }
+                }
+                evicted += m_store->remove(keys);
+                layout.tier = Warm;
+            }
+            if(layout.tier < Cold && target >= Cold){
+                // 剩余的数据块与校验块压缩后移入归档段
+                std::vector<h256> keys;
+                for(size_t i = 0; i < layout.leaves.size(); i++){
+                    if(owned(layout, i)){
+                        keys.push_back(layout.leaves[i]);
+                    }
+                }
+                collectParity(layout.root, keys);
+                archived += archive(keys);
+                layout.tier = Cold;
+            }
+        }
+        if(evicted || archived){
+            writeToLog("Retention at block " + toString(latest) + ": evicted " + toString(evicted)
+                + " chunks, archived " + toString(archived) + " chunks, disk "
+                + printMemorySize(diskUsage()), "ouput_log.txt");
+        }
+    }
+
+    size_t archive(std::vector<h256> const& keys)
+    {
+        std::vector<bytes> compressed(keys.size());
+        std::vector<std::pair<h256, bytesConstRef>> items;
+        for(size_t i = 0; i < keys.size(); i++){
+            m_store->read(keys[i], [&](bytesConstRef data){
+                if(data.size()){
+                    compress::SnappyCompress::compress(data, compressed[i]);
+                    items.push_back(std::make_pair(keys[i], bytesConstRef(&compressed[i])));
+                }
+            });
+        }
+        if(!m_archive.append(items)){
+            return 0;
+        }
+        std::vector<h256> moved;
+        for(auto const& i : items){
+            moved.push_back(i.first);
+        }
+        return m_store->remove(moved);
+    }
+
+    std::string readLocal(h256 const& key) const
+    {
+        auto data = m_store->lookup(key);
+        return data.empty() ? readArchived(key) : data;
+    }
+
+    std::string readArchived(h256 const& key) const
+    {
+        bytes raw;
+        m_archive.read(key, [&raw](bytesConstRef packed){
+            if(packed.size()){
+                compress::SnappyCompress::uncompress(packed, raw);
+            }
+        });
+        return std::string(raw.begin(), raw.end());
+    }
+
+    // 已淘汰的 chunk 按所在区块的编码组恢复，不在该区块中时返回空
+    std::string recoverEvicted(h256 const& key, int block_number)
+    {
+        // 恢复时可能要从其他节点读取，拷贝一份布局后释放锁
+        BlockLayout layout;
+        {
+            std::lock_guard<std::mutex> l(x_blocks);
+            auto it = m_blocks.find(block_number);
+            if(it == m_blocks.end()){
+                return std::string();
+            }
+            layout = it->second;
+        }
+        auto const& leaves = layout.leaves;
+        for(size_t i = 0; i < leaves.size(); i++){
+            if(leaves[i] == key){
+                ++m_recovered;
+                return recover(layout, block_number, i);
+            }
+        }
+        return std::string();
+    }
+
+    static void collectParity(std::shared_ptr<Node> const& root, std::vector<h256>& out)
+    {
+        std::unordered_set<Node*> visited;
+        std::vector<std::shared_ptr<Node>> stack;
+        if(root){
+            stack.push_back(root);
+        }
+        while(!stack.empty()){
+            auto node = stack.back();
+            stack.pop_back();
+            if(!visited.insert(node.get()).second){
+                continue;
+            }
+            out.insert(out.end(), node->p.begin(), node->p.end());
+            if(node->left_child) stack.push_back(node->left_child);
+            if(node->right_child) stack.push_back(node->right_child);
+        }
+    }
+
+    // 从持有节点读取 chunk 并校验，失败返回空串
+    std::string fetch(h256 const& key, int block_number, size_t holder, bool parity)
+    {
+        ChunkFetcher fetch;
+        {
+            std::lock_guard<std::mutex> l(x_fetch);
+            fetch = m_fetch;
+        }
+        if(!fetch){
+            return std::string();
+        }
+        auto ret = fetch(key, block_number, (int)holder);
+        if(ret.empty() || (parity ? sha3(ret) != key : BMT::chunkRoot(ret) != key)){
+            return std::string();
+        }
+        ++m_fetched;
+        return ret;
+    }
+
+    /**
+    * @brief 恢复第 leaf 个 chunk
+    *
+    * 从包含该叶子的最小编码组开始尝试，先用本地的数据块与校验块，不足 k 个时再从持有节点补齐，凑够 k 个即可解码。
+    * 解码结果去掉了末尾的 0，按记录的长度补齐后用 chunk 的 Merkle 根校验。
+    * 编码前压缩了 chunk 时的帧转换由 Eurasure::recoverFromMPT 处理。
+    */
+    std::string recover(BlockLayout const& layout, int block_number, size_t leaf)
+    {
+        std::vector<std::shared_ptr<Node>> ancestors;
+        auto node = layout.root;
+        while(node && (node->left_child || node->right_child)){
+            if(!node->p.empty()){
+                ancestors.push_back(node);
+            }
+            auto const& left = node->left_child;
+            node = (left && leaf >= left->_begin && leaf < left->_end) ? left : node->right_child;
+        }
+
+        for(auto it = ancestors.rbegin(); it != ancestors.rend(); ++it){
+            auto const& group = *it;
+            size_t k = group->_end - group->_begin;
+            size_t present = 0;
+            std::vector<std::string> data;
+            std::vector<std::string> parity;
+            for(auto i = group->_begin; i < group->_end; i++){
+                data.push_back(i == leaf ? std::string() : readLocal(layout.leaves[i]));
+                present += !data.back().empty();
+            }
+            for(auto const& p : group->p){
+                parity.push_back(readLocal(p));
+                present += !parity.back().empty();
+            }
+            // 本地不足 k 个时依次从持有节点补齐，先数据块后校验块
+            for(auto i = group->_begin; i < group->_end && present < k; i++){
+                auto& d = data[i - group->_begin];
+                if(i != leaf && d.empty()){
+                    d = fetch(layout.leaves[i], block_number, chunkOf(layout, i), false);
+                    present += !d.empty();
+                }
+            }
+            for(size_t j = 0; j < parity.size() && present < k; j++){
+                if(parity[j].empty()){
+                    parity[j] = fetch(group->p[j], block_number, chunkOf(layout, group->_begin) + k + j, true);
+                    present += !parity[j].empty();
+                }
+            }
+            if(present < k){
+                continue;
+            }
+            auto ret = m_erasure->recoverFromMPT(data, parity, leaf - group->_begin, m_erasure->policy());
+            ret.resize(layout.lengths[leaf], '\0');
+            if(BMT::chunkRoot(ret) == layout.leaves[leaf]){
+                return ret;
+            }
+        }
+        writeToLog("Retention failed to recover chunk " + toString(layout.leaves[leaf]), "output_decode_log.txt");
+        return std::string();
+    }
+
+    std::shared_ptr<ChunkStore> m_store;
+    ChunkStore m_archive;
+    ec::Eurasure* m_erasure;
+    RetentionConfig m_config;
+    std::map<int, BlockLayout> m_blocks;
+    std::mutex x_blocks;
+    ChunkFetcher m_fetch;
+    std::mutex x_fetch;
+    std::atomic<size_t> m_recovered{0};
+    std::atomic<size_t> m_fetched{0};
+};
+
+}  // namespace mptstate
+}  // namespace dev
@@ -0,0 +1,408 @@
+/**
+ * @后台 chunk 巡检与修复
+ *功能包括：
+ * 1. 后台线程按区块轮询本地存储（ChunkStore / ChunkDB）中的数据块，重新计算 chunk 的 Merkle 根并与 BMT 叶子比对
+ * 2. 每个编码组的校验块按 BMT 中记录的 hash 校验；每 parity_sample 个编码组抽查一次，由数据块重新编码推导校验块
+ * 3. 发现损坏的数据块时用同组其他块纠删码恢复并写回，损坏的校验块由数据块重新编码后写回
+ * 4. 按 bytes_per_second 限速，进度与吞吐通过 metrics() 读取
+ *
+ * 与 ChunkRetention 一样只记录每个区块恢复所需的 BMT 结构，由持久化阶段登记，不读 MPTState::BMT_map。
+ * 已被保留策略淘汰或归档的 chunk 不在本地存储中，巡检时跳过。
+ *
+ * @file ChunkScrubber.h
+ * @author qqf
+ * @date 2025-03-21
+ */
+#pragma once
+
+#include "BMT.h"
+#include "ChunkDB.h"
+#include "ChunkStore.h"
+#include "Eurasure.h"
+#include <tbb/parallel_for.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace dev
+{
+namespace mptstate
+{
+
+struct ScrubConfig {
+    size_t bytes_per_second = 0; // 巡检速率上限，0 表示不启用
+    int parity_sample = 8;       // 每多少个编码组重新推导一次校验块
+    int pass_interval = 60;      // 两轮巡检之间的间隔（秒）
+};
+
+// 巡检统计，各字段单调递增（bytes_per_second 为最近一轮的速率）
+struct ScrubMetrics {
+    size_t passes = 0;
+    size_t blocks = 0;
+    size_t chunks_checked = 0;
+    size_t parity_checked = 0;
+    size_t parity_derived = 0; // 重新编码推导校验块的编码组数
+    size_t bytes_checked = 0;
+    size_t corrupt_chunks = 0;
+    size_t corrupt_parity = 0;
+    size_t repaired = 0;
+    size_t unrepairable = 0;
+    double bytes_per_second = 0;
+};
+
+class ChunkScrubber
+{
+public:
+    ChunkScrubber(std::shared_ptr<ChunkStore> store, std::shared_ptr<ChunkDB> db, ec::Eurasure* erasure,
+        ScrubConfig const& config)
+      : m_store(store), m_db(db), m_erasure(erasure), m_config(config), m_stopped(false)
+    {
+        if(m_config.parity_sample <= 0){
+            m_config.parity_sample = 1;
+        }
+    }
+
+    ~ChunkScrubber() { stop(); }
+
+    bool enabled() const
+    {
+        return m_config.bytes_per_second > 0 && ((m_store && m_store->isOpen()) || (m_db && m_db->isOpen()));
+    }
+
+    void start()
+    {
+        if(enabled() && !m_worker.joinable()){
+            m_worker = std::thread(&ChunkScrubber::run, this);
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> l(x_blocks);
+            if(m_stopped){
+                return;
+            }
+            m_stopped = true;
+        }
+        m_wakeup.notify_all();
+        if(m_worker.joinable()){
+            m_worker.join();
+        }
+    }
+
+    // 区块的 chunk 持久化后登记其 BMT 结构
+    void onBlockPersisted(int block_number, BMT const& bmt)
+    {
+        if(!enabled()){
+            return;
+        }
+        auto layout = std::make_shared<BlockLayout>();
+        layout->root = bmt.bmt_root;
+        layout->leaves = bmt.leaves;
+        layout->lengths.reserve(bmt.leaves.size());
+        for(size_t i = 0; i < bmt.leaves.size(); i++){
+            layout->lengths.push_back(bmt.leafData(i).size());
+        }
+        std::lock_guard<std::mutex> l(x_blocks);
+        m_blocks[block_number] = layout;
+    }
+
+    ScrubMetrics metrics() const
+    {
+        std::lock_guard<std::mutex> l(x_metrics);
+        return m_metrics;
+    }
+
+    /**
+    * @brief 巡检并修复一个区块
+    *
+    * @return 本区块读取的字节数
+    */
+    size_t scrubBlock(int block_number)
+    {
+        std::shared_ptr<BlockLayout> layout;
+        {
+            std::lock_guard<std::mutex> l(x_blocks);
+            auto it = m_blocks.find(block_number);
+            if(it == m_blocks.end()){
+                return 0;
+            }
+            layout = it->second;
+        }
+        ScrubMetrics delta;
+        delta.blocks = 1;
+
+        // 1. 批量校验数据块：先读出，再并行计算 Merkle 根
+        auto const& leaves = layout->leaves;
+        std::vector<std::string> data(leaves.size());
+        for(size_t i = 0; i < leaves.size(); i++){
+            data[i] = readLocal(leaves[i]);
+        }
+        std::vector<char> bad(leaves.size(), 0);
+        tbb::parallel_for(size_t(0), leaves.size(), [&](size_t i){
+            bad[i] = !data[i].empty() && BMT::chunkRoot(data[i]) != leaves[i];
+        });
+        for(size_t i = 0; i < leaves.size(); i++){
+            if(data[i].empty()){
+                continue;
+            }
+            delta.chunks_checked++;
+            delta.bytes_checked += data[i].size();
+            if(bad[i]){
+                delta.corrupt_chunks++;
+                data[i].clear();
+            }
+        }
+
+        // 2. 校验各编码组的校验块，并修复本组损坏的数据块
+        size_t group_index = 0;
+        forEachGroup(layout->root, [&](std::shared_ptr<Node> const& group){
+            bool derive = group_index++ % m_config.parity_sample == 0;
+            scrubGroup(*layout, group, data, bad, derive, delta);
+        });
+
+        for(size_t i = 0; i < leaves.size(); i++){
+            if(bad[i]){
+                delta.unrepairable++;
+                writeToLog("Scrub failed to repair chunk " + toString(leaves[i]) + " of block "
+                    + toString(block_number), "output_decode_log.txt");
+            }
+        }
+
+        std::lock_guard<std::mutex> l(x_metrics);
+        m_metrics.blocks += delta.blocks;
+        m_metrics.chunks_checked += delta.chunks_checked;
+        m_metrics.parity_checked += delta.parity_checked;
+        m_metrics.parity_derived += delta.parity_derived;
+        m_metrics.bytes_checked += delta.bytes_checked;
+        m_metrics.corrupt_chunks += delta.corrupt_chunks;
+        m_metrics.corrupt_parity += delta.corrupt_parity;
+        m_metrics.repaired += delta.repaired;
+        m_metrics.unrepairable += delta.unrepairable;
+        return delta.bytes_checked;
+    }
+
+private:
+    struct BlockLayout {
+        std::shared_ptr<Node> root;
+        std::vector<h256> leaves;
+        std::vector<uint32_t> lengths;
+    };
+
+    void run()
+    {
+        while(true){
+            std::vector<int> blocks;
+            {
+                std::lock_guard<std::mutex> l(x_blocks);
+                for(auto const& b : m_blocks){
+                    blocks.push_back(b.first);
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            size_t bytes = 0;
+            for(auto b : blocks){
+                if(m_stopped){
+                    return;
+                }
+                bytes += scrubBlock(b);
+                throttle(start, bytes);
+            }
+            auto seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count() / 1000000.0;
+            ScrubMetrics m;
+            {
+                std::lock_guard<std::mutex> l(x_metrics);
+                m_metrics.passes++;
+                m_metrics.bytes_per_second = seconds > 0 ? bytes / seconds : 0;
+                m = m_metrics;
+            }
+            if(!blocks.empty()){
+                writeToLog("Scrub pass " + toString(m.passes) + ": " + toString(blocks.size()) + " blocks, "
+                    + printMemorySize(bytes) + " at " + printMemorySize((size_t)m.bytes_per_second) + "/s, corrupt "
+                    + toString(m.corrupt_chunks) + " chunks / " + toString(m.corrupt_parity) + " parity, repaired "
+                    + toString(m.repaired) + ", unrepairable " + toString(m.unrepairable), "ouput_log.txt");
+            }
+
+            std::unique_lock<std::mutex> l(x_blocks);
+            m_wakeup.wait_for(l, std::chrono::seconds(m_config.pass_interval), [this](){ return m_stopped.load(); });
+            if(m_stopped){
+                return;
+            }
+        }
+    }
+
+    // 已读 bytes 字节时，按限速应至少经过的时间不足则休眠
+    void throttle(std::chrono::steady_clock::time_point start, size_t bytes)
+    {
+        auto expected = std::chrono::microseconds((int64_t)(bytes * 1000000.0 / m_config.bytes_per_second));
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if(expected > elapsed){
+            std::unique_lock<std::mutex> l(x_blocks);
+            m_wakeup.wait_for(l, expected - elapsed, [this](){ return m_stopped.load(); });
+        }
+    }
+
+    template <class F>
+    static void forEachGroup(std::shared_ptr<Node> const& root, F f)
+    {
+        std::unordered_set<Node*> visited;
+        std::vector<std::shared_ptr<Node>> stack;
+        if(root){
+            stack.push_back(root);
+        }
+        while(!stack.empty()){
+            auto node = stack.back();
+            stack.pop_back();
+            if(!visited.insert(node.get()).second){
+                continue;
+            }
+            if(!node->p.empty()){
+                f(node);
+            }
+            if(node->left_child) stack.push_back(node->left_child);
+            if(node->right_child) stack.push_back(node->right_child);
+        }
+    }
+
+    /**
+    * @brief 校验一个编码组
+    *
+    * data 中损坏或缺失的数据块为空串，bad 标记尚未修复的损坏数据块。
+    * 组内有损坏的数据块时先用校验块恢复；数据块完整时才能重新推导校验块。
+    */
+    void scrubGroup(BlockLayout const& layout, std::shared_ptr<Node> const& group, std::vector<std::string>& data,
+        std::vector<char>& bad, bool derive, ScrubMetrics& delta)
+    {
+        size_t k = group->_end - group->_begin;
+        std::vector<std::string> parity;
+        std::vector<char> parity_bad;
+        size_t present = 0;
+        for(auto const& p : group->p){
+            parity.push_back(readLocal(p));
+            parity_bad.push_back(!parity.back().empty() && sha3(parity.back()) != p);
+            if(!parity.back().empty()){
+                delta.parity_checked++;
+                delta.bytes_checked += parity.back().size();
+            }
+            if(parity_bad.back()){
+                delta.corrupt_parity++;
+                parity.back().clear();
+            }
+            present += !parity.back().empty();
+        }
+
+        std::vector<std::string> group_data(data.begin() + group->_begin, data.begin() + group->_end);
+        for(auto const& d : group_data){
+            present += !d.empty();
+        }
+
+        // 修复损坏的数据块
+        for(auto i = group->_begin; i < group->_end; i++){
+            if(!bad[i] || present < k){
+                continue;
+            }
+            auto ret = m_erasure->recoverFromMPT(group_data, parity, i - group->_begin, m_erasure->policy());
+            ret.resize(layout.lengths[i], '\0');
+            if(BMT::chunkRoot(ret) == layout.leaves[i] && writeBack(layout.leaves[i], ret, ChunkDB::Data)){
+                data[i] = group_data[i - group->_begin] = ret;
+                bad[i] = 0;
+                delta.repaired++;
+            }
+        }
+
+        bool complete = true;
+        for(auto const& d : group_data){
+            complete = complete && !d.empty();
+        }
+        bool need_parity = false;
+        for(auto b : parity_bad){
+            need_parity = need_parity || b;
+        }
+        if(!complete || (!derive && !need_parity)){
+            for(auto b : parity_bad){
+                delta.unrepairable += b;
+            }
+            return;
+        }
+
+        // 由数据块重新编码推导校验块
+        auto policy = m_erasure->policy().withGroup(k, group->p.size());
+        std::vector<bytes> framed;
+        std::vector<bytesConstRef> refs;
+        for(auto const& d : group_data){
+            if(policy.compress){
+                framed.push_back(ec::Eurasure::frameChunk(bytesConstRef(&d), true));
+            }
+            else{
+                refs.push_back(bytesConstRef(&d));
+            }
+        }
+        for(auto const& f : framed){
+            refs.push_back(bytesConstRef(&f));
+        }
+        auto derived = m_erasure->parityFromMPT(refs, policy);
+        delta.parity_derived += derive;
+        for(size_t j = 0; j < group->p.size(); j++){
+            bool match = j < derived.size() && sha3(derived[j]) == group->p[j];
+            if(!match){
+                writeToLog("Scrub derived parity " + toString(j) + " mismatch for group " + toString(group->_hash),
+                    "output_decode_log.txt");
+            }
+            if(parity_bad[j]){
+                if(match && writeBack(group->p[j], derived[j], ChunkDB::Parity)){
+                    delta.repaired++;
+                }
+                else{
+                    delta.unrepairable++;
+                }
+            }
+        }
+    }
+
+    std::string readLocal(h256 const& key) const
+    {
+        if(m_store && m_store->isOpen()){
+            auto data = m_store->lookup(key);
+            if(!data.empty()){
+                return data;
+            }
+        }
+        return m_db && m_db->isOpen() ? m_db->lookup(key) : std::string();
+    }
+
+    // 写回到当前持有该 chunk 的存储；检查与替换在 ChunkStore 内一次完成，期间被归档移出的 chunk 不会写回热区
+    bool writeBack(h256 const& key, std::string const& value, ChunkDB::Column c)
+    {
+        if(m_store && m_store->replaceIfPresent(key, bytesConstRef(&value))){
+            return true;
+        }
+        return m_db && m_db->put(c, key, bytesConstRef(&value));
+    }
+
+    std::shared_ptr<ChunkStore> m_store;
+    std::shared_ptr<ChunkDB> m_db;
+    ec::Eurasure* m_erasure;
+    ScrubConfig m_config;
+
+    std::map<int, std::shared_ptr<BlockLayout>> m_blocks;
+    std::mutex x_blocks;
+    std::condition_variable m_wakeup;
+    std::atomic<bool> m_stopped;
+    std::thread m_worker;
+
+    ScrubMetrics m_metrics;
+    mutable std::mutex x_metrics;
+};
+
+}  // namespace mptstate
+}  // namespace dev
@@ -0,0 +1,481 @@
+/**
+ * @内存映射的只追加 chunk 段存储
+ *功能包括：
+ * 1. 区块编码完成后 chunk 与校验块不再修改，直接顺序追加到大的段文件中，不经过 LSM 的 compaction
+ * 2. 索引 chunk hash -> (段号, 偏移, 长度)，同时追加到 index.log，重启时回放重建
+ * 3. 段文件整体 mmap，read 在读锁内把映射内存直接交给回调，不拷贝；lookup 在读锁内拷贝出来
+ *
+ * 段文件在创建时 ftruncate 到段容量（稀疏文件，实际占用只有写入的部分），写入即对映射内存 memcpy，
+ * 以 MS_SYNC 落盘后才写索引记录并发布到索引中，因此读者不会看到写了一半的数据，崩溃后索引也不会指向未写入的数据。
+ * remove / replace 在写锁内对旧数据打洞释放磁盘（打洞后该处读出为 0），读取都在读锁内完成，
+ * 因此不会读到被打洞的数据；映射内存不能在锁外保留。
+ *
+ * @file ChunkStore.h
+ * @author qqf
+ * @date 2025-03-18
+ */
+#pragma once
+
+#include <libdevcore/Common.h>
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/Guards.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dev
+{
+namespace mptstate
+{
+
+class ChunkStore
+{
+public:
+    struct Location {
+        uint32_t segment = 0;
+        uint32_t length = 0;
+        uint64_t offset = 0;
+    };
+
+    static const size_t c_defaultSegmentSize = (size_t)1 << 28; // 256MB
+
+    ChunkStore() {}
+    ~ChunkStore() { close(); }
+
+    ChunkStore(ChunkStore const&) = delete;
+    ChunkStore& operator=(ChunkStore const&) = delete;
+
+    /**
+    * @brief 打开（或创建）存储目录，回放 index.log 重建索引
+    *
+    * @param dir 存储目录
+    * @param segment_size 单个段文件的容量
+    * @return 是否成功
+    */
+    bool open(std::string const& dir, size_t segment_size = c_defaultSegmentSize)
+    {
+        WriteGuard l(x_store);
+        if(m_indexFd >= 0){
+            return true;
+        }
+        m_dir = dir;
+        m_segmentSize = segment_size;
+        ::mkdir(dir.c_str(), 0755);
+
+        m_indexFd = ::open((dir + "/index.log").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if(m_indexFd < 0){
+            std::cout << "Open chunk store " << dir << " failed" << std::endl;
+            return false;
+        }
+
+        // 回放索引，同时得到每个段已写入的长度
+        std::vector<uint64_t> used;
+        IndexRecord r;
+        ::lseek(m_indexFd, 0, SEEK_SET);
+        while(::read(m_indexFd, &r, sizeof(r)) == (ssize_t)sizeof(r)){
+            h256 key(r.key, h256::ConstructFromPointer);
+            if(r.length == c_removed){
+                m_index.erase(key);
+                continue;
+            }
+            Location loc;
+            loc.segment = r.segment;
+            loc.offset = r.offset;
+            loc.length = r.length;
+            m_index[key] = loc;
+            if(used.size() <= r.segment){
+                used.resize(r.segment + 1, 0);
+            }
+            used[r.segment] = std::max<uint64_t>(used[r.segment], r.offset + r.length);
+        }
+
+        for(size_t i = 0; i < used.size(); i++){
+            if(!mapSegment(i, 0)){
+                return false;
+            }
+        }
+        m_used = used.empty() ? 0 : used.back();
+        for(auto const& i : m_index){
+            m_bytes += i.second.length;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        WriteGuard l(x_store);
+        for(auto& s : m_segments){
+            if(s.data){
+                ::munmap(s.data, s.capacity);
+            }
+            if(s.fd >= 0){
+                ::close(s.fd);
+            }
+        }
+        m_segments.clear();
+        m_index.clear();
+        m_used = 0;
+        m_bytes = 0;
+        if(m_indexFd >= 0){
+            ::close(m_indexFd);
+            m_indexFd = -1;
+        }
+    }
+
+    bool isOpen() const { return m_indexFd >= 0; }
+
+    /**
+    * @brief 追加一批 chunk（通常是一个区块的数据块与校验块），索引记录一次写入 index.log
+    *
+    * 已存在的 hash 不会重复写入。
+    * @return 是否成功
+    */
+    bool append(std::vector<std::pair<h256, bytesConstRef>> const& items)
+    {
+        WriteGuard l(x_store);
+        if(m_indexFd < 0){
+            return false;
+        }
+        std::vector<IndexRecord> records;
+        records.reserve(items.size());
+        std::vector<std::pair<h256, Location>> added;
+        for(auto const& item : items){
+            if(m_index.count(item.first)){
+                continue;
+            }
+            Location loc;
+            if(!writeData(item.second, loc)){
+                return false;
+            }
+            added.push_back(std::make_pair(item.first, loc));
+            records.push_back(toRecord(item.first, loc));
+        }
+        if(records.empty()){
+            return true;
+        }
+        // 先落数据，再落索引
+        std::vector<Location> written;
+        for(auto const& a : added){
+            written.push_back(a.second);
+        }
+        syncData(written);
+        if(!writeRecords(records)){
+            return false;
+        }
+        for(auto const& a : added){
+            m_index[a.first] = a.second;
+            m_bytes += a.second.length;
+        }
+        return true;
+    }
+
+    /**
+    * @brief 删除一批 chunk：写入删除记录，并对其所占的整页打洞释放磁盘空间
+    *
+    * @return 实际删除的个数
+    */
+    size_t remove(std::vector<h256> const& keys)
+    {
+        WriteGuard l(x_store);
+        if(m_indexFd < 0){
+            return 0;
+        }
+        std::vector<IndexRecord> records;
+        for(auto const& key : keys){
+            auto it = m_index.find(key);
+            if(it == m_index.end()){
+                continue;
+            }
+            auto loc = it->second;
+            m_index.erase(it);
+            m_bytes -= loc.length;
+            punchHole(loc);
+            loc.length = c_removed;
+            records.push_back(toRecord(key, loc));
+        }
+        if(!records.empty()){
+            writeRecords(records);
+        }
+        return records.size();
+    }
+
+    bool put(h256 const& key, bytesConstRef value)
+    {
+        return append(std::vector<std::pair<h256, bytesConstRef>>{std::make_pair(key, value)});
+    }
+
+    // 写入或替换：段文件只追加，新值落盘后再删除旧记录（打洞释放），整个过程持写锁，读者只会看到旧值或新值
+    bool replace(h256 const& key, bytesConstRef value)
+    {
+        WriteGuard l(x_store);
+        return replaceLocked(key, value);
+    }
+
+    // 只替换仍在存储中的 chunk，与 remove（如归档）互斥，不存在时返回 false 且不写入
+    bool replaceIfPresent(h256 const& key, bytesConstRef value)
+    {
+        WriteGuard l(x_store);
+        return m_index.count(key) && replaceLocked(key, value);
+    }
+
+    /**
+    * @brief 零拷贝读取：持读锁调用 f(bytesConstRef)，引用不能在 f 之外保留
+    *
+    * @return 是否找到
+    */
+    template <class F>
+    bool read(h256 const& key, F f) const
+    {
+        ReadGuard l(x_store);
+        auto it = m_index.find(key);
+        if(it == m_index.end()){
+            return false;
+        }
+        f(at(it->second));
+        return true;
+    }
+
+    bool contains(h256 const& key) const
+    {
+        ReadGuard l(x_store);
+        return m_index.count(key) != 0;
+    }
+
+    // 拷贝读取，找不到时返回空串
+    std::string lookup(h256 const& key) const
+    {
+        std::string ret;
+        read(key, [&ret](bytesConstRef data){ ret = data.toString(); });
+        return ret;
+    }
+
+    // 只读取 [offset, offset + len) 区间，超出 chunk 末尾的部分截断
+    std::string lookupRange(h256 const& key, size_t offset, size_t len) const
+    {
+        std::string ret;
+        read(key, [&](bytesConstRef data){ ret = slice(data, offset, len); });
+        return ret;
+    }
+
+    // 截取 data 的 [offset, offset + len) 区间，超出末尾的部分截断
+    static std::string slice(bytesConstRef data, size_t offset, size_t len)
+    {
+        if(offset >= data.size()){
+            return std::string();
+        }
+        return data.cropped(offset, std::min(len, data.size() - offset)).toString();
+    }
+
+    size_t size() const
+    {
+        ReadGuard l(x_store);
+        return m_index.size();
+    }
+
+    // 索引中仍有效的 chunk 总字节数
+    size_t dataSize() const
+    {
+        ReadGuard l(x_store);
+        return m_bytes;
+    }
+
+private:
+    // index.log 中的一条记录，length 为 c_removed 表示删除
+    struct IndexRecord {
+        byte key[32];
+        uint64_t offset;
+        uint32_t segment;
+        uint32_t length;
+    };
+    static_assert(sizeof(IndexRecord) == 48, "IndexRecord must be packed");
+
+    static const uint32_t c_removed = 0xFFFFFFFF;
+    static const uint64_t c_page = 4096;
+
+    struct Segment {
+        int fd = -1;
+        byte* data = nullptr;
+        size_t capacity = 0;
+    };
+
+    static IndexRecord toRecord(h256 const& key, Location const& loc)
+    {
+        IndexRecord r;
+        memcpy(r.key, key.data(), sizeof(r.key));
+        r.offset = loc.offset;
+        r.segment = loc.segment;
+        r.length = loc.length;
+        return r;
+    }
+
+    std::string segmentPath(size_t i) const { return m_dir + "/segment-" + std::to_string(i) + ".dat"; }
+
+    // 打开并映射第 i 个段；min_capacity 为 0 时使用已有文件大小（至少为段容量）
+    bool mapSegment(size_t i, size_t min_capacity)
+    {
+        int fd = ::open(segmentPath(i).c_str(), O_RDWR | O_CREAT, 0644);
+        if(fd < 0){
+            std::cout << "Open chunk segment " << segmentPath(i) << " failed" << std::endl;
+            return false;
+        }
+        struct stat st;
+        ::fstat(fd, &st);
+        size_t capacity = std::max<size_t>(std::max<size_t>(st.st_size, m_segmentSize), min_capacity);
+        if((size_t)st.st_size < capacity && ::ftruncate(fd, capacity) != 0){
+            ::close(fd);
+            return false;
+        }
+        void* data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(data == MAP_FAILED){
+            std::cout << "Map chunk segment " << segmentPath(i) << " failed" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        if(m_segments.size() <= i){
+            m_segments.resize(i + 1);
+        }
+        m_segments[i].fd = fd;
+        m_segments[i].data = (byte*)data;
+        m_segments[i].capacity = capacity;
+        return true;
+    }
+
+    // 在当前段中分配 len 字节，放不下时开启新段（超过段容量的 chunk 单独占一段）
+    bool reserve(size_t len, Location& loc)
+    {
+        if(m_segments.empty() || m_used + len > m_segments.back().capacity){
+            if(!mapSegment(m_segments.size(), len)){
+                return false;
+            }
+            m_used = 0;
+        }
+        loc.segment = m_segments.size() - 1;
+        loc.offset = m_used;
+        loc.length = len;
+        m_used += len;
+        return true;
+    }
+
+    // 只释放完全落在 chunk 内的页，与相邻 chunk 共享的页保留
+    void punchHole(Location const& loc)
+    {
+#ifdef FALLOC_FL_PUNCH_HOLE
+        uint64_t begin = (loc.offset + c_page - 1) / c_page * c_page;
+        uint64_t end = (loc.offset + loc.length) / c_page * c_page;
+        if(end > begin){
+            ::fallocate(m_segments[loc.segment].fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, begin, end - begin);
+        }
+#else
+        (void)loc;
+#endif
+    }
+
+    bytesConstRef at(Location const& loc) const
+    {
+        return bytesConstRef(m_segments[loc.segment].data + loc.offset, loc.length);
+    }
+
+    // 分配空间并写入映射内存，尚未落盘和发布
+    bool writeData(bytesConstRef value, Location& loc)
+    {
+        if(!reserve(value.size(), loc)){
+            return false;
+        }
+        if(value.size()){
+            memcpy(m_segments[loc.segment].data + loc.offset, value.data(), value.size());
+        }
+        return true;
+    }
+
+    // 把写入的区间所在的页同步写回（MS_SYNC），之后才能写索引记录
+    void syncData(std::vector<Location> const& locs)
+    {
+        std::unordered_map<uint32_t, std::pair<uint64_t, uint64_t>> ranges;
+        for(auto const& loc : locs){
+            auto it = ranges.find(loc.segment);
+            if(it == ranges.end()){
+                ranges[loc.segment] = std::make_pair(loc.offset, loc.offset + loc.length);
+                continue;
+            }
+            it->second.first = std::min(it->second.first, loc.offset);
+            it->second.second = std::max<uint64_t>(it->second.second, loc.offset + loc.length);
+        }
+        for(auto const& r : ranges){
+            uint64_t begin = r.second.first / c_page * c_page;
+            if(r.second.second > begin){
+                ::msync(m_segments[r.first].data + begin, r.second.second - begin, MS_SYNC);
+            }
+        }
+    }
+
+    // 需持有写锁；旧值（若有）的删除记录与新值的记录一起写入，回放时先删后加
+    bool replaceLocked(h256 const& key, bytesConstRef value)
+    {
+        if(m_indexFd < 0){
+            return false;
+        }
+        Location loc;
+        if(!writeData(value, loc)){
+            return false;
+        }
+        syncData(std::vector<Location>{loc});
+        std::vector<IndexRecord> records;
+        auto it = m_index.find(key);
+        bool had = it != m_index.end();
+        Location old;
+        if(had){
+            old = it->second;
+            Location removed = old;
+            removed.length = c_removed;
+            records.push_back(toRecord(key, removed));
+        }
+        records.push_back(toRecord(key, loc));
+        if(!writeRecords(records)){
+            return false;
+        }
+        if(had){
+            m_bytes -= old.length;
+            punchHole(old);
+        }
+        m_index[key] = loc;
+        m_bytes += loc.length;
+        return true;
+    }
+
+    bool writeRecords(std::vector<IndexRecord> const& records)
+    {
+        size_t total = records.size() * sizeof(IndexRecord);
+        auto p = (char const*)records.data();
+        while(total){
+            auto n = ::write(m_indexFd, p, total);
+            if(n <= 0){
+                std::cout << "Write chunk store index failed" << std::endl;
+                return false;
+            }
+            p += n;
+            total -= n;
+        }
+        return true;
+    }
+
+    std::string m_dir;
+    size_t m_segmentSize = c_defaultSegmentSize;
+    std::vector<Segment> m_segments;
+    uint64_t m_used = 0; // 最后一个段已写入的字节数
+    int m_indexFd = -1;
+    std::unordered_map<h256, Location> m_index;
+    size_t m_bytes = 0;
+    mutable SharedMutex x_store;
+};
+
+}  // namespace mptstate
+}  // namespace dev
@@ -0,0 +1,68 @@
+/**
+ * @纠删码编码策略
+ *功能包括：
+ * 1. 把 k、m、副本数、编码实现、编码块长度粒度、渐进式编码层数和是否压缩 chunk 收拢为一个值对象
+ * 2. 编码 / 解码接口按次传入策略，不再读取 Eurasure 中可被修改的字段，同一节点上编码与恢复可以并发
+ * 3. 需要不同参数时用 withGroup / withLevels 复制出新的策略，原策略不变
+ *
+ * @file CodingPolicy.h
+ * @author qqf
+ * @date 2025-03-22
+ */
+#pragma once
+
+#include <erasure-codes/liberasure.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace ec
+{
+
+struct CodingPolicy {
+    int64_t k = 3;   // 数据块个数（渐进式编码中为编码组的叶子数）
+    int64_t m = 1;   // 校验块个数（渐进式编码中为最上层编码组的校验块数，即容错个数）
+    int64_t c = 1;   // 副本个数
+    erasure_encoder_flags codec = ERASURE_FORCE_ADV_IMPL; // 编码实现
+    size_t chunk_size = 0; // 编码块长度取整到 chunk_size 的整数倍，0 表示按组内最长的 chunk
+    int levels = 2;        // 渐进式编码的层数
+    bool compress = false; // 编码前逐个压缩 chunk（帧格式见 Eurasure::frameChunk）
+
+    CodingPolicy() {}
+    CodingPolicy(int64_t _k, int64_t _m, int64_t _c = 1) : k(_k), m(_m), c(_c) {}
+
+    // 一个编码组的策略：k 个数据块，m 个校验块，其余参数不变
+    CodingPolicy withGroup(int64_t _k, int64_t _m) const
+    {
+        CodingPolicy p(*this);
+        p.k = _k;
+        p.m = _m;
+        return p;
+    }
+
+    // 一个区块的渐进式编码策略：fault_tolerance 为最上层的校验块数，levels 为编码层数
+    CodingPolicy withLevels(int64_t fault_tolerance, int _levels) const
+    {
+        CodingPolicy p(*this);
+        p.m = fault_tolerance;
+        p.levels = _levels;
+        return p;
+    }
+
+    CodingPolicy withCompress(bool _compress) const
+    {
+        CodingPolicy p(*this);
+        p.compress = _compress;
+        return p;
+    }
+
+    // 按 chunk_size 取整后的编码块长度
+    size_t blockLength(size_t max_len) const
+    {
+        if(chunk_size == 0 || max_len == 0){
+            return max_len;
+        }
+        return (max_len + chunk_size - 1) / chunk_size * chunk_size;
+    }
+};
+
+}  // namespace ec
@@ -0,0 +1,105 @@
+/**
+ * @编码临时缓冲区的区域分配器
+ *功能包括：
+ * 1. 按 64 字节对齐分配编码 / 解码过程中的数据块、指针数组和 present 数组，满足纠删码库 SIMD 的对齐要求
+ * 2. 内存从大块（slab）中顺序切分，同一区块的各编码组并行编码时只在切分时短暂加锁
+ * 3. 不单独释放，区块编码结束时 release() 一次性归还（析构时也会归还）
+ *
+ * 编码结果（校验块）在 arena 释放前已拷贝到 std::string 中，因此 arena 的生命周期只需覆盖一次 makeECFromMPT / decodeFromMPT。
+ *
+ * @file EncodingArena.h
+ * @author qqf
+ * @date 2025-03-23
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ec
+{
+
+class EncodingArena
+{
+public:
+    static const size_t c_alignment = 64;
+    static const size_t c_defaultSlabSize = (size_t)1 << 22; // 4MB
+
+    explicit EncodingArena(size_t slab_size = c_defaultSlabSize) : m_slabSize(slab_size) {}
+    ~EncodingArena() { release(); }
+
+    EncodingArena(EncodingArena const&) = delete;
+    EncodingArena& operator=(EncodingArena const&) = delete;
+
+    static size_t align(size_t n) { return (n + c_alignment - 1) / c_alignment * c_alignment; }
+
+    /**
+    * @brief 分配 bytes 字节，起始地址 64 字节对齐，内容清零
+    *
+    * 超过 slab 容量的请求单独占一个 slab。
+    */
+    void* allocate(size_t bytes)
+    {
+        bytes = align(bytes ? bytes : 1);
+        void* ret = nullptr;
+        {
+            std::lock_guard<std::mutex> l(x_arena);
+            if(m_slabs.empty() || m_used + bytes > m_slabs.back().size){
+                Slab s;
+                s.size = bytes > m_slabSize ? bytes : m_slabSize;
+                if(::posix_memalign(&s.data, c_alignment, s.size) != 0){
+                    throw std::bad_alloc();
+                }
+                m_slabs.push_back(s);
+                m_used = 0;
+                m_capacity += s.size;
+            }
+            ret = (uint8_t*)m_slabs.back().data + m_used;
+            m_used += bytes;
+            m_allocated += bytes;
+        }
+        memset(ret, 0, bytes);
+        return ret;
+    }
+
+    template <class T>
+    T* allocate(size_t n)
+    {
+        return (T*)allocate(n * sizeof(T));
+    }
+
+    // 一次性归还全部内存，之前分配的指针全部失效
+    void release()
+    {
+        std::lock_guard<std::mutex> l(x_arena);
+        for(auto& s : m_slabs){
+            ::free(s.data);
+        }
+        m_slabs.clear();
+        m_used = 0;
+        m_allocated = 0;
+        m_capacity = 0;
+    }
+
+    size_t allocated() const { return m_allocated; }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    struct Slab {
+        void* data = nullptr;
+        size_t size = 0;
+    };
+
+    size_t m_slabSize;
+    std::vector<Slab> m_slabs;
+    size_t m_used = 0; // 最后一个 slab 已切分的字节数
+    size_t m_allocated = 0;
+    size_t m_capacity = 0;
+    std::mutex x_arena;
+};
+
+}  // namespace ec
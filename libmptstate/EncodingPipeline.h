@@ -0,0 +1,207 @@
+/**
+ * @流水线式状态编码，与区块提交解耦
+ *功能包括：
+ * 1. 提交阶段在执行线程上截取本区块修改的 MPT 节点并落盘，随后执行线程即可继续下一个区块
+ * 2. 划分 → chunk 构建 → BMT → 编码 → 持久化 各阶段各占一个工作线程，阶段之间使用有界队列（满时阻塞，形成反压）
+ * 3. 每个区块持久化完成后原子地发布该区块的编码快照
+ *
+ * 各阶段按区块顺序处理，且每份共享数据只被一个阶段修改：
+ * 划分阶段独占 incrementalPartitioner，chunk 阶段独占 versionManager，BMT 阶段只读本区块的 chunk，编码阶段独占 state_erasure / BMT_map，
+ * 持久化阶段独占存储统计。读取 versionManager / BMT_map 之前需先调用 drain()。
+ *
+ * @file EncodingPipeline.h
+ * @author qqf
+ * @date 2025-03-16
+ */
+#pragma once
+
+#include "MPTState.h"
+#include <tbb/concurrent_queue.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace dev
+{
+namespace mptstate
+{
+
+// 一个区块在流水线中传递的全部数据
+struct EncodingJob {
+    int block_number = 0;
+    int node_number = 0;
+    int fault_tolerance = 0;
+    int encoding_level = 0;
+    int partition_mode = 1;
+    h256 root;
+
+    std::unordered_map<h256, std::string> mut_map; // 本区块修改的 MPT 节点
+    StatePartition sp;
+    std::unique_ptr<ChunkBuilder> cb;
+    std::vector<std::string> chunks;
+    BMT bmt;
+    std::unordered_map<h256, std::string> encoded; // 编码结果
+
+    double vm_time = 0; // ms
+    double sp_time = 0;
+    double cb_time = 0;
+
+    EncodingJob(int _block_number, std::vector<int> const& config)
+      : block_number(_block_number),
+        node_number(config[0]),
+        fault_tolerance(config[1]),
+        encoding_level(config[2]),
+        partition_mode(config.size() > 3 ? config[3] : 1)
+    {}
+};
+typedef std::shared_ptr<EncodingJob> EncodingJobPtr;
+
+// 已持久化区块的编码快照
+struct EncodedSnapshot {
+    int block_number = 0;
+    h256 root;
+    size_t chunk_number = 0;
+    size_t encoded_number = 0;
+};
+
+class EncodingPipeline
+{
+public:
+    /**
+    * @param state 被编码的状态
+    * @param config {节点个数, 容错个数, 编码层数[, 划分模式]}
+    * @param depth 每个阶段队列的容量
+    */
+    EncodingPipeline(MPTState& state, std::vector<int> const& config, size_t depth = 2)
+      : m_state(state), m_config(config), m_submitted(0), m_persisted(0), m_published(0), m_stopped(false)
+    {
+        m_partitionQueue.set_capacity(depth);
+        m_chunkQueue.set_capacity(depth);
+        m_bmtQueue.set_capacity(depth);
+        m_encodeQueue.set_capacity(depth);
+        m_persistQueue.set_capacity(depth);
+
+        m_workers.emplace_back(&EncodingPipeline::stageLoop, this, std::ref(m_partitionQueue), &m_chunkQueue,
+            [this](EncodingJob& job){ m_state.partitionStage(job); });
+        m_workers.emplace_back(&EncodingPipeline::stageLoop, this, std::ref(m_chunkQueue), &m_bmtQueue,
+            [this](EncodingJob& job){ m_state.chunkStage(job); });
+        m_workers.emplace_back(&EncodingPipeline::stageLoop, this, std::ref(m_bmtQueue), &m_encodeQueue,
+            [this](EncodingJob& job){ m_state.bmtStage(job); });
+        m_workers.emplace_back(&EncodingPipeline::stageLoop, this, std::ref(m_encodeQueue), &m_persistQueue,
+            [this](EncodingJob& job){ m_state.encodeStage(job); });
+        m_workers.emplace_back(&EncodingPipeline::stageLoop, this, std::ref(m_persistQueue), nullptr,
+            [this](EncodingJob& job){ persist(job); });
+    }
+
+    ~EncodingPipeline() { stop(); }
+
+    /**
+    * @brief 提交一个区块（在 mptState.commit() 之后、执行下一个区块之前调用）
+    *
+    * 截取本区块修改的节点和 MPT 根，并把状态节点写入 DB 清空 overlay；
+    * 编码数据之后由持久化阶段单独写入。第一个队列满时阻塞。
+    */
+    void submit(int block_number)
+    {
+        auto job = std::make_shared<EncodingJob>(block_number, m_config);
+        job->mut_map = m_state.collectDirtyNodes();
+        job->root = m_state.getState().rootHash();
+        m_state.getState().db().commit();
+        {
+            std::lock_guard<std::mutex> l(x_persisted);
+            ++m_submitted;
+        }
+        m_partitionQueue.push(job);
+    }
+
+    // 等待所有已提交的区块持久化完成
+    void drain()
+    {
+        std::unique_lock<std::mutex> l(x_persisted);
+        m_persistedCv.wait(l, [this](){ return m_persisted == m_submitted; });
+    }
+
+    void stop()
+    {
+        if(m_stopped.exchange(true)){
+            return;
+        }
+        // 空指针沿着各阶段依次传递，作为退出信号
+        m_partitionQueue.push(EncodingJobPtr());
+        for(auto& t : m_workers){
+            t.join();
+        }
+    }
+
+    int publishedBlock() const { return m_published; }
+
+    std::shared_ptr<EncodedSnapshot const> snapshot() const { return std::atomic_load(&m_snapshot); }
+
+private:
+    typedef tbb::concurrent_bounded_queue<EncodingJobPtr> JobQueue;
+
+    void stageLoop(JobQueue& in, JobQueue* out, std::function<void(EncodingJob&)> stage)
+    {
+        while(true){
+            EncodingJobPtr job;
+            in.pop(job);
+            if(job){
+                stage(*job);
+            }
+            if(out){
+                out->push(job);
+            }
+            if(!job){
+                return;
+            }
+        }
+    }
+
+    void persist(EncodingJob& job)
+    {
+        if(!m_state.persistStage(job)){
+            m_state.getState().db().commitEncoded(job.encoded);
+            m_state.getErasure()->setCompleteCodingEpoch(job.block_number);
+        }
+        m_state.accountStage(job);
+
+        auto s = std::make_shared<EncodedSnapshot>();
+        s->block_number = job.block_number;
+        s->root = job.root;
+        s->chunk_number = job.chunks.size();
+        s->encoded_number = job.encoded.size();
+        std::atomic_store(&m_snapshot, std::shared_ptr<EncodedSnapshot const>(s));
+        m_published = job.block_number;
+
+        {
+            std::lock_guard<std::mutex> l(x_persisted);
+            ++m_persisted;
+        }
+        m_persistedCv.notify_all();
+    }
+
+    MPTState& m_state;
+    std::vector<int> m_config;
+
+    JobQueue m_partitionQueue;
+    JobQueue m_chunkQueue;
+    JobQueue m_bmtQueue;
+    JobQueue m_encodeQueue;
+    JobQueue m_persistQueue;
+    std::vector<std::thread> m_workers;
+
+    size_t m_submitted;
+    size_t m_persisted;
+    std::mutex x_persisted;
+    std::condition_variable m_persistedCv;
+
+    std::atomic<int> m_published;
+    std::shared_ptr<EncodedSnapshot const> m_snapshot;
+    std::atomic<bool> m_stopped;
+};
+
+}  // namespace mptstate
+}  // namespace dev
@@ -36,30 +36,7 @@ void EurasureP2P::processPacket(SyncMsgPacket::Ptr packet, NodeAddr const& destn
         std::cout << "ECRequestChunkPacket coding_epoch = " << coding_epoch
                   << "group id = " << group_id << "   chunk_pos = " << chunk_pos
                   << "   destnodeId = " << destnodeId << std::endl;
-        while (m_eurasure->getCompleteEpoch() < coding_epoch){
-            sleep(0.1);
-            std::cout<< "m_eurasure->getCompleteEpoch() : " << m_eurasure->getCompleteEpoch()
-                << "  coding_epoch" << coding_epoch << std::endl;
-        }
-            
-        std::vector<std::string> request_chunk_and_merkle_hash =
-            m_eurasure->readChunkAndComputeMerkleHashs(coding_epoch, chunk_pos, group_id);
-        // if (chunk_pos == 4)
-        // {
-        //     // for (int i = 0; i < request_chunk_and_merkle_hash.size(); ++i)
-        //     // {
-        //     //     std::cout << "ECRequestChunkPacket hash = "
-        //     //               << sha256(request_chunk_and_merkle_hash[i]).hex() << std::endl;
-        //     // }
-        // }
-        // for (int i = 0; i < request_chunk_and_merkle_hash.size(); ++i)
-        // {
-        //     std::cout << "request chunk hash = " << request_chunk_and_merkle_hash[i] <<
-        //     std::endl;
-        // }
-        std::cout << "after ECRequestChunkPacket" << std::endl;
-
-        responseChunk(coding_epoch, group_id, chunk_pos, request_chunk_and_merkle_hash, destnodeId);
+        serveChunkRequest(coding_epoch, group_id, chunk_pos, destnodeId);
     };
     break;
 
@@ -76,29 +53,17 @@ void EurasureP2P::processPacket(SyncMsgPacket::Ptr packet, NodeAddr const& destn
 
         // if (group_id == 11 && chunk_pos == 0)
         // {
-        if (!m_eurasure->verifyChunkMerkleRoot(merkle_list, coding_epoch, chunk_pos, group_id))
+        std::string fetch_key = chunkFetchKey(coding_epoch, group_id, chunk_pos);
+        if (merkle_list.empty() ||
+            !m_eurasure->verifyChunkMerkleRoot(merkle_list, coding_epoch, chunk_pos, group_id))
         {
             std::cout << "the chunks is incorrect!" << std::endl;
+            completeFetch(fetch_key, false, std::string());
             return;
         }
         // std::cout<<"Merkle list = "<<merkle_list<<std::endl;
 
-        tbb::concurrent_unordered_map<std::string, unsigned int>::iterator pre_ac;
-        std::string str = std::to_string(coding_epoch);
-        str.append("-");
-        str.append(std::to_string(group_id));
-        std::cout << "ECReponseChunkPacket get str = " << str << std::endl;
-        chunk_data_map.emplace(
-            m_eurasure->GetChunkDataKey(coding_epoch, group_id, chunk_pos), merkle_list[0]);
-        pre_ac = chunk_count_map.find(str);
-        if (pre_ac != chunk_count_map.end())
-        {
-            chunk_count_map[str] += 1;
-        }
-        else
-        {
-            chunk_count_map[str] = 1;
-        }
+        completeFetch(fetch_key, true, merkle_list[0]);
         // chunk_data_map.emplace(
         //     m_eurasure->GetChunkDataKey(coding_epoch, group_id, chunk_pos), merkle_list[0]);
         
@@ -119,6 +84,59 @@ void EurasureP2P::processPacket(SyncMsgPacket::Ptr packet, NodeAddr const& destn
     };
     break;
 
+    case ECRequestChunksPacket: {
+        RLP const& rlps = (*packet).rlp();
+        auto items = rlps[0].toVector<std::vector<unsigned int>>();
+        std::vector<ChunkId> ready;
+        {
+            std::lock_guard<std::mutex> l(x_waiting);
+            auto now = std::chrono::steady_clock::now();
+            dropExpiredRequests(now);
+            for (auto const& item : items)
+            {
+                if (item.size() != 3)
+                    continue;
+                ChunkId id = {item[0], item[1], item[2]};
+                // 尚未编码完成的数据块按单块请求排队，编码完成后以单块响应返回
+                if (!queueIfNotEncoded(id, destnodeId, now))
+                    ready.push_back(id);
+            }
+        }
+        if (!ready.empty())
+        {
+            m_serveWorker->enqueue([this, ready, destnodeId]() { respondChunks(ready, destnodeId); });
+        }
+    };
+    break;
+
+    case ECResponseChunksPacket: {
+        processChunksResponse((*packet).rlp());
+    };
+    break;
+
+    case ECRequestTrieWalkPacket: {
+        RLP const& rlps = (*packet).rlp();
+        TrieWalkRequest req;
+        req.node = rlps[0].toHash<h256>();
+        req.key = rlps[1].toHash<h256>();
+        req.depth = rlps[2].toInt<unsigned>();
+        // 预取预算由对端给出，按本端上限截断
+        auto frontier_bytes = rlps[3].toInt<size_t>();
+        req.frontier_bytes = frontier_bytes < c_maxFrontierBytes ? frontier_bytes : c_maxFrontierBytes;
+        m_serveWorker->enqueue([this, req, destnodeId]() { respondTrieWalk(req, destnodeId); });
+    };
+    break;
+
+    case ECResponseTrieWalkPacket: {
+        RLP const& rlps = (*packet).rlp();
+        TrieWalkRequest req;
+        req.node = rlps[0].toHash<h256>();
+        req.key = rlps[1].toHash<h256>();
+        req.depth = rlps[2].toInt<unsigned>();
+        completeFetch(trieWalkFetchKey(req), true, asString(rlps[3].toBytes()));
+    };
+    break;
+
     case ECProofPacket: {
         RLP const& rlps = (*packet).rlp();
         unsigned int pos = rlps[0].toInt();
@@ -131,19 +149,12 @@ void EurasureP2P::processPacket(SyncMsgPacket::Ptr packet, NodeAddr const& destn
         RLP const& rlps = (*packet).rlp();
         unsigned int block_num = rlps[0].toInt();
         std::string key = asString(rlps[1].toBytes());
-        std::string data;
         // std::cout << "ECRequestStatePacket key = " << key << "  in block " << block_num << std::endl;
-        if (state_map.count(std::to_string(block_num).append(key)) != 0)
-        {
-            data = state_map[std::to_string(block_num).append(key)];
-        }
-        else
-        {
-            data = m_eurasure->getState(block_num, key);
-        }
-
-        // std::cout << "ECRequestStatePacket destnodeId = " << destnodeId << std::endl;
-        responseState(block_num, key, data, destnodeId);
+        // getState 可能触发纠删解码，交给服务线程池，不占用网络线程
+        m_serveWorker->enqueue([this, block_num, key, destnodeId]() {
+            std::string data = m_eurasure->getState(block_num, key);
+            responseState(block_num, key, data, destnodeId);
+        });
     };
     break;
     case ECReponseStatePacket: {
@@ -152,7 +163,7 @@ void EurasureP2P::processPacket(SyncMsgPacket::Ptr packet, NodeAddr const& destn
         std::string key = asString(rlps[1].toBytes());
         std::string data = asString(rlps[2].toBytes());
         // std::cout << "ECReponseStatePacket key = " << key << "  in block " << block_num << std::endl;
-        state_map[std::to_string(block_num).append(key)] = data;
+        completeFetch(stateFetchKey(block_num, key), true, data);
     };
     break;
     case HeartTest:{
@@ -179,7 +190,6 @@ void EurasureP2P::messageHandler(dev::p2p::NetworkException _e,
     std::shared_ptr<dev::p2p::P2PSession> _session, dev::p2p::P2PMessage::Ptr _msg)
 {
     SyncMsgPacket::Ptr packet = std::make_shared<SyncMsgPacket>();
-    std::cout<< "receive packet from" << _session->nodeID().abridged() << "type = " <<packet->packetType <<   std::endl;
     if (!packet->decode(_session, _msg))
     {
         SYNC_ENGINE_LOG(WARNING) << LOG_BADGE("Rcv") << LOG_BADGE("Packet")
@@ -189,9 +199,8 @@ void EurasureP2P::messageHandler(dev::p2p::NetworkException _e,
                                  << LOG_KV("message", toHex(*_msg->buffer()));
         return;
     }
-    std::thread work_thread(
-        boost::bind(&EurasureP2P::processPacket, this, packet, _session->nodeID()));
-    work_thread.join();
+    // 解包与分发直接在网络线程完成；读盘、解码等耗时请求由 processPacket 投递到 m_serveWorker
+    processPacket(packet, _session->nodeID());
 }
 
 void EurasureP2P::sendStateMessage(uint8_t message_type, unsigned int block_num,
@@ -291,6 +300,19 @@ void EurasureP2P::requestChunk(unsigned int coding_epoch, unsigned int group_id,
     sendChunkMessage(REQUESTCHUNKMESSAGETYPE, coding_epoch, group_id, chunk_pos,
         std::vector<std::string>(), destnodeId);
 }
+void EurasureP2P::requestChunks(std::vector<ChunkId> const& chunks, NodeAddr const& destnodeId)
+{
+    std::vector<std::vector<unsigned int>> items;
+    for (auto const& c : chunks)
+    {
+        items.push_back({c.coding_epoch, c.group_id, c.chunk_pos});
+    }
+    dev::sync::SyncECRequestChunksPacket retPacket;
+    retPacket.encode(items);
+    auto msg = retPacket.toMessage(m_protocolId);
+    m_service->asyncSendMessageByNodeID(
+        destnodeId, msg, CallbackFuncWithSession(), dev::network::Options());
+}
 void EurasureP2P::responseChunk(unsigned int coding_epoch, unsigned int group_id,
     unsigned int chunk_pos, std::vector<std::string> const& merklelist,
     dev::network::NodeID const& destnodeId)
@@ -312,4 +334,388 @@ void EurasureP2P::responseState(unsigned int block_num, std::string const& key,
     std::string const& data, NodeAddr const& destnodeId)
 {
     sendStateMessage(1, block_num, key, data, destnodeId);
+}
+
+std::string EurasureP2P::chunkFetchKey(
+    unsigned int coding_epoch, unsigned int group_id, unsigned int chunk_pos)
+{
+    return "c" + std::to_string(coding_epoch) + "|" + std::to_string(group_id) + "|" +
+           std::to_string(chunk_pos);
+}
+std::string EurasureP2P::stateFetchKey(unsigned int block_num, std::string const& key)
+{
+    return "s" + std::to_string(block_num) + "|" + key;
+}
+std::string EurasureP2P::trieWalkFetchKey(TrieWalkRequest const& req)
+{
+    return "t" + req.node.hex() + "|" + req.key.hex() + "|" + std::to_string(req.depth);
+}
+
+bool EurasureP2P::addWaiter(
+    std::string const& fetch_key, FetchCallback callback, unsigned timeout_ms)
+{
+    FetchWaiter waiter;
+    waiter.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    waiter.callback = std::move(callback);
+    bool first;
+    {
+        std::lock_guard<std::mutex> l(x_pending);
+        auto& waiters = m_pending[fetch_key];
+        first = waiters.empty();
+        waiters.push_back(std::move(waiter));
+    }
+    m_pendingCv.notify_all();
+    return first;
+}
+
+void EurasureP2P::completeFetch(std::string const& fetch_key, bool ok, std::string const& data)
+{
+    std::vector<FetchWaiter> waiters;
+    {
+        std::lock_guard<std::mutex> l(x_pending);
+        auto it = m_pending.find(fetch_key);
+        if (it == m_pending.end())
+        {
+            // 已超时或重复的响应
+            return;
+        }
+        waiters.swap(it->second);
+        m_pending.erase(it);
+    }
+    // 回调在锁外执行，回调中可以再次发起请求
+    for (auto& w : waiters)
+    {
+        w.callback(ok, data);
+    }
+}
+
+void EurasureP2P::reapTimeouts()
+{
+    std::unique_lock<std::mutex> l(x_pending);
+    while (!m_stopReaper)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto next = now + std::chrono::seconds(1);
+        std::vector<FetchWaiter> expired;
+        for (auto it = m_pending.begin(); it != m_pending.end();)
+        {
+            auto& waiters = it->second;
+            auto keep = std::partition(waiters.begin(), waiters.end(),
+                [&now](FetchWaiter const& w) { return w.deadline > now; });
+            for (auto w = keep; w != waiters.end(); ++w)
+            {
+                expired.push_back(std::move(*w));
+            }
+            waiters.erase(keep, waiters.end());
+            for (auto const& w : waiters)
+            {
+                next = std::min(next, w.deadline);
+            }
+            it = waiters.empty() ? m_pending.erase(it) : std::next(it);
+        }
+        if (!expired.empty())
+        {
+            l.unlock();
+            std::cout << "EurasureP2P fetch timeout, expired " << expired.size() << " requests"
+                      << std::endl;
+            for (auto& w : expired)
+            {
+                w.callback(false, std::string());
+            }
+            l.lock();
+            continue;
+        }
+        m_pendingCv.wait_until(l, next);
+    }
+}
+
+std::future<std::string> EurasureP2P::toFuture(std::function<void(FetchCallback)> const& start)
+{
+    auto promise = std::make_shared<std::promise<std::string>>();
+    auto ret = promise->get_future();
+    start([promise](bool ok, std::string const& data) {
+        if (ok)
+            promise->set_value(data);
+        else
+            promise->set_exception(
+                std::make_exception_ptr(std::runtime_error("EurasureP2P fetch failed")));
+    });
+    return ret;
+}
+
+void EurasureP2P::fetchChunk(unsigned int coding_epoch, unsigned int group_id,
+    unsigned int chunk_pos, NodeAddr const& destnodeId, FetchCallback callback,
+    unsigned timeout_ms)
+{
+    addWaiter(chunkFetchKey(coding_epoch, group_id, chunk_pos), std::move(callback), timeout_ms);
+    // 目标节点可能不同，每次都发送请求；先到的响应完成全部等待者，之后的响应被丢弃
+    requestChunk(coding_epoch, group_id, chunk_pos, destnodeId);
+}
+std::future<std::string> EurasureP2P::fetchChunk(unsigned int coding_epoch,
+    unsigned int group_id, unsigned int chunk_pos, NodeAddr const& destnodeId,
+    unsigned timeout_ms)
+{
+    return toFuture([&](FetchCallback cb) {
+        fetchChunk(coding_epoch, group_id, chunk_pos, destnodeId, std::move(cb), timeout_ms);
+    });
+}
+
+void EurasureP2P::fetchChunks(std::vector<ChunkId> const& chunks, NodeAddr const& destnodeId,
+    std::vector<FetchCallback> callbacks, unsigned timeout_ms)
+{
+    for (size_t i = 0; i < chunks.size() && i < callbacks.size(); ++i)
+    {
+        auto const& c = chunks[i];
+        addWaiter(chunkFetchKey(c.coding_epoch, c.group_id, c.chunk_pos), std::move(callbacks[i]),
+            timeout_ms);
+    }
+    requestChunks(chunks, destnodeId);
+}
+
+void EurasureP2P::fetchState(unsigned int block_num, std::string const& key,
+    NodeAddr const& destnodeId, FetchCallback callback, unsigned timeout_ms)
+{
+    addWaiter(stateFetchKey(block_num, key), std::move(callback), timeout_ms);
+    requestState(block_num, key, destnodeId);
+}
+std::future<std::string> EurasureP2P::fetchState(unsigned int block_num, std::string const& key,
+    NodeAddr const& destnodeId, unsigned timeout_ms)
+{
+    return toFuture([&](FetchCallback cb) {
+        fetchState(block_num, key, destnodeId, std::move(cb), timeout_ms);
+    });
+}
+
+void EurasureP2P::fetchTrieWalk(TrieWalkRequest const& req, NodeAddr const& destnodeId,
+    FetchCallback callback, unsigned timeout_ms)
+{
+    addWaiter(trieWalkFetchKey(req), std::move(callback), timeout_ms);
+    dev::sync::SyncECRequestTrieWalkPacket retPacket;
+    retPacket.encode(req.node, req.key, req.depth, req.frontier_bytes);
+    auto msg = retPacket.toMessage(m_protocolId);
+    m_service->asyncSendMessageByNodeID(
+        destnodeId, msg, CallbackFuncWithSession(), dev::network::Options());
+}
+std::future<std::string> EurasureP2P::fetchTrieWalk(
+    TrieWalkRequest const& req, NodeAddr const& destnodeId, unsigned timeout_ms)
+{
+    return toFuture(
+        [&](FetchCallback cb) { fetchTrieWalk(req, destnodeId, std::move(cb), timeout_ms); });
+}
+void EurasureP2P::setTrieWalkHandler(TrieWalkHandler handler)
+{
+    std::lock_guard<std::mutex> l(x_trieWalkHandler);
+    m_trieWalkHandler = std::move(handler);
+}
+void EurasureP2P::respondTrieWalk(TrieWalkRequest const& req, NodeAddr const& destnodeId)
+{
+    TrieWalkHandler handler;
+    {
+        std::lock_guard<std::mutex> l(x_trieWalkHandler);
+        handler = m_trieWalkHandler;
+    }
+    TrieWalkResult result;
+    if (handler)
+        result = handler(req);
+    dev::sync::SyncECResponseTrieWalkPacket retPacket;
+    retPacket.encode(req.node, req.key, req.depth, result.rlp());
+    auto msg = retPacket.toMessage(m_protocolId);
+    m_service->asyncSendMessageByNodeID(
+        destnodeId, msg, CallbackFuncWithSession(), dev::network::Options());
+}
+
+size_t EurasureP2P::pendingFetches()
+{
+    std::lock_guard<std::mutex> l(x_pending);
+    return m_pending.size();
+}
+
+void EurasureP2P::serveChunkRequest(unsigned int coding_epoch, unsigned int group_id,
+    unsigned int chunk_pos, NodeAddr const& destnodeId)
+{
+    {
+        std::lock_guard<std::mutex> l(x_waiting);
+        auto now = std::chrono::steady_clock::now();
+        dropExpiredRequests(now);
+        ChunkId id = {coding_epoch, group_id, chunk_pos};
+        if (queueIfNotEncoded(id, destnodeId, now))
+        {
+            return;
+        }
+    }
+    m_serveWorker->enqueue([this, coding_epoch, group_id, chunk_pos, destnodeId]() {
+        respondChunk(coding_epoch, group_id, chunk_pos, destnodeId);
+    });
+}
+
+bool EurasureP2P::queueIfNotEncoded(
+    ChunkId const& id, NodeAddr const& destnodeId, std::chrono::steady_clock::time_point now)
+{
+    // 在锁内判断轮次：setCompleteCodingEpoch 先更新轮次再取锁清空等待表，请求不会遗漏
+    if (m_eurasure->getCompleteEpoch() >= id.coding_epoch)
+    {
+        return false;
+    }
+    WaitingRequest req;
+    req.group_id = id.group_id;
+    req.chunk_pos = id.chunk_pos;
+    req.dest = destnodeId;
+    req.deadline = now + std::chrono::milliseconds(c_fetchTimeoutMs);
+    m_waitingRequests[id.coding_epoch].push_back(req);
+    return true;
+}
+
+void EurasureP2P::respondChunk(unsigned int coding_epoch, unsigned int group_id,
+    unsigned int chunk_pos, NodeAddr const& destnodeId)
+{
+    std::vector<std::string> request_chunk_and_merkle_hash =
+        m_eurasure->readChunkAndComputeMerkleHashs(coding_epoch, chunk_pos, group_id);
+    responseChunk(coding_epoch, group_id, chunk_pos, request_chunk_and_merkle_hash, destnodeId);
+}
+
+void EurasureP2P::respondChunks(std::vector<ChunkId> const& chunks, NodeAddr const& destnodeId)
+{
+    std::vector<std::vector<unsigned int>> ids;
+    std::vector<std::string> datas;
+    std::vector<std::vector<unsigned int>> proofs;
+    std::vector<std::string> hashes;
+    std::map<std::string, unsigned int> hash_index;
+    size_t bytes = 0;
+    auto flush = [&]() {
+        if (ids.empty())
+            return;
+        dev::sync::SyncECResponseChunksPacket retPacket;
+        retPacket.encode(ids, datas, proofs, hashes);
+        auto msg = retPacket.toMessage(m_protocolId);
+        m_service->asyncSendMessageByNodeID(
+            destnodeId, msg, CallbackFuncWithSession(), dev::network::Options());
+        ids.clear();
+        datas.clear();
+        proofs.clear();
+        hashes.clear();
+        hash_index.clear();
+        bytes = 0;
+    };
+    for (auto const& c : chunks)
+    {
+        std::vector<std::string> merkle_list =
+            m_eurasure->readChunkAndComputeMerkleHashs(c.coding_epoch, c.chunk_pos, c.group_id);
+        if (merkle_list.empty())
+            continue;
+        if (bytes > 0 && bytes + merkle_list[0].size() > c_maxBatchBytes)
+            flush();
+        // 证明节点按内容去重，同一默克尔树上的多个数据块共享上层节点
+        std::vector<unsigned int> proof;
+        for (size_t i = 1; i < merkle_list.size(); ++i)
+        {
+            auto ret = hash_index.insert(std::make_pair(merkle_list[i], (unsigned int)hashes.size()));
+            if (ret.second)
+                hashes.push_back(merkle_list[i]);
+            proof.push_back(ret.first->second);
+        }
+        ids.push_back({c.coding_epoch, c.group_id, c.chunk_pos});
+        bytes += merkle_list[0].size();
+        datas.push_back(std::move(merkle_list[0]));
+        proofs.push_back(std::move(proof));
+    }
+    flush();
+}
+
+std::vector<EurasureP2P::ChunkResponse> EurasureP2P::parseChunksResponse(RLP const& rlps)
+{
+    std::vector<ChunkResponse> responses;
+    auto hashes = rlps[1].toVector<std::string>();
+    RLP items = rlps[0];
+    for (size_t i = 0; i < items.itemCount(); ++i)
+    {
+        RLP item = items[i];
+        ChunkResponse r;
+        r.id = {item[0].toInt<unsigned int>(), item[1].toInt<unsigned int>(),
+            item[2].toInt<unsigned int>()};
+        r.ok = true;
+        r.merkle_list.push_back(asString(item[3].toBytes()));
+        for (auto idx : item[4].toVector<unsigned int>())
+        {
+            if (idx >= hashes.size())
+            {
+                r.ok = false;
+                break;
+            }
+            r.merkle_list.push_back(hashes[idx]);
+        }
+        responses.push_back(std::move(r));
+    }
+    return responses;
+}
+
+void EurasureP2P::processChunksResponse(RLP const& rlps)
+{
+    for (auto& r : parseChunksResponse(rlps))
+    {
+        std::string fetch_key = chunkFetchKey(r.id.coding_epoch, r.id.group_id, r.id.chunk_pos);
+        if (!r.ok || !m_eurasure->verifyChunkMerkleRoot(r.merkle_list, r.id.coding_epoch,
+                         r.id.chunk_pos, r.id.group_id))
+        {
+            std::cout << "the chunks is incorrect!" << std::endl;
+            completeFetch(fetch_key, false, std::string());
+            continue;
+        }
+        completeFetch(fetch_key, true, r.merkle_list[0]);
+    }
+}
+
+void EurasureP2P::onEpochCompleted(int64_t epoch)
+{
+    if (epoch < 0)
+    {
+        return;
+    }
+    std::vector<std::pair<unsigned int, WaitingRequest>> ready;
+    {
+        std::lock_guard<std::mutex> l(x_waiting);
+        dropExpiredRequests(std::chrono::steady_clock::now());
+        auto end = m_waitingRequests.upper_bound((unsigned int)epoch);
+        for (auto it = m_waitingRequests.begin(); it != end; ++it)
+        {
+            for (auto const& req : it->second)
+            {
+                ready.push_back(std::make_pair(it->first, req));
+            }
+        }
+        m_waitingRequests.erase(m_waitingRequests.begin(), end);
+    }
+    for (auto const& r : ready)
+    {
+        unsigned int coding_epoch = r.first;
+        WaitingRequest req = r.second;
+        m_serveWorker->enqueue([this, coding_epoch, req]() {
+            respondChunk(coding_epoch, req.group_id, req.chunk_pos, req.dest);
+        });
+    }
+}
+
+size_t EurasureP2P::dropExpiredRequests(std::chrono::steady_clock::time_point now)
+{
+    size_t dropped = 0;
+    for (auto it = m_waitingRequests.begin(); it != m_waitingRequests.end();)
+    {
+        auto& reqs = it->second;
+        auto keep = std::remove_if(reqs.begin(), reqs.end(),
+            [&now](WaitingRequest const& r) { return r.deadline <= now; });
+        dropped += reqs.end() - keep;
+        reqs.erase(keep, reqs.end());
+        it = reqs.empty() ? m_waitingRequests.erase(it) : std::next(it);
+    }
+    return dropped;
+}
+
+size_t EurasureP2P::waitingChunkRequests()
+{
+    std::lock_guard<std::mutex> l(x_waiting);
+    size_t ret = 0;
+    for (auto const& w : m_waitingRequests)
+    {
+        ret += w.second.size();
+    }
+    return ret;
 }
\ No newline at end of file
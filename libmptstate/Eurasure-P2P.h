@@ -3,6 +3,7 @@
 #include <libdevcore/Common.h>
 #include <libdevcore/CommonData.h>
 #include <libdevcore/FixedHash.h>
+#include <libdevcore/ThreadPool.h>
 #include <libethcore/Block.h>
 #include <libethcore/Exceptions.h>
 #include <libnetwork/Common.h>
@@ -11,6 +12,7 @@
 #include <libp2p/P2PMessage.h>
 #include <libsync/Common.h>
 #include <libsync/SyncMsgPacket.h>
+#include "TrieWalk.h"
 #include <stdlib.h>
 #include <tbb/concurrent_queue.h>
 #include <tbb/concurrent_unordered_map.h>
@@ -19,10 +21,17 @@
 #include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <ctime>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #define REQUESTBLOCKMESSAGETYPE 0
 #define REQUESTCHUNKMESSAGETYPE 0
@@ -35,9 +44,29 @@
 
 namespace ec {
 class Eurasure;
+// 一个数据块在编码结果中的位置
+struct ChunkId {
+    unsigned int coding_epoch;
+    unsigned int group_id;
+    unsigned int chunk_pos;
+};
 /*纠删码网络模块*/
 class EurasureP2P {
   public:
+    /**
+     * 异步请求的完成回调
+     *  ok: 收到并校验通过的响应为 true，超时或校验失败为 false
+     *  data: 数据块内容或状态数据
+     */
+    typedef std::function<void(bool ok, std::string const &data)> FetchCallback;
+    // 在本节点继续其他节点发来的分布式 MPT 查找
+    typedef std::function<TrieWalkResult(TrieWalkRequest const &req)> TrieWalkHandler;
+    static const unsigned c_fetchTimeoutMs = 10000;
+    static const size_t c_serveThreads = 4;
+    static const unsigned c_trieWalkTimeoutMs = 2000; // 分布式查找单跳的等待上限
+    static const size_t c_maxFrontierBytes = (size_t)1 << 20; // 响应遍历请求时最多预取的字节数
+    static const size_t c_maxBatchBytes = (size_t)4 << 20; // 单个批量响应包的数据上限
+
     /**
      * 初始化纠删码网络服务
      * input:
@@ -52,12 +81,25 @@ class EurasureP2P {
         : m_nodeId(nodeid), m_service(_service), m_protocolId(_protocolId) {
         m_groupId = dev::eth::getGroupAndProtocol(_protocolId).first;
         // std::cout << "m_ecId = " << m_protocolId << std::endl;
+        m_serveWorker = std::make_shared<dev::ThreadPool>(
+            "ECServe-" + std::to_string(m_groupId), c_serveThreads);
         registerHandler();
+        m_reaper = std::thread(&EurasureP2P::reapTimeouts, this);
     }
     void setEurasure(ec::Eurasure *eurasure);
     void registerHandler();
     void removeHandler();
-    ~EurasureP2P() { removeHandler(); }
+    ~EurasureP2P() {
+        removeHandler();
+        {
+            std::lock_guard<std::mutex> l(x_pending);
+            m_stopReaper = true;
+        }
+        m_pendingCv.notify_all();
+        if (m_reaper.joinable())
+            m_reaper.join();
+        m_serveWorker->stop();
+    }
     /**
      * 纠删码消息处理
      * input:
@@ -89,6 +131,9 @@ class EurasureP2P {
                           dev::network::NodeID const &destnodeId);
     void requestChunk(unsigned int coding_epoch, unsigned int group_id,
                       unsigned int chunk_pos, NodeAddr const &destnodeId);
+    // 一个包请求同一节点上的多个数据块
+    void requestChunks(std::vector<ChunkId> const &chunks,
+                       NodeAddr const &destnodeId);
 
     void responseChunk(unsigned int coding_epoch, unsigned int group_id,
                        unsigned int chunk_pos,
@@ -96,6 +141,55 @@ class EurasureP2P {
                        NodeAddr const &destnodeId);
     void requestState(unsigned int block_num, std::string key,
                       NodeAddr const &destnodeId);
+    /**
+     * 异步获取数据块 / 状态
+     * 发出请求后立即返回，processPacket 收到响应或超时后调用 callback（或完成 future）。
+     * 请求以内容为键（epoch|group|pos 或 block+key），同一键上并发的请求共享一个响应，
+     * 完成后即从等待表中删除。future 版本在超时时抛出 std::runtime_error。
+     */
+    void fetchChunk(unsigned int coding_epoch, unsigned int group_id,
+                    unsigned int chunk_pos, NodeAddr const &destnodeId,
+                    FetchCallback callback,
+                    unsigned timeout_ms = c_fetchTimeoutMs);
+    std::future<std::string> fetchChunk(unsigned int coding_epoch,
+                                        unsigned int group_id,
+                                        unsigned int chunk_pos,
+                                        NodeAddr const &destnodeId,
+                                        unsigned timeout_ms = c_fetchTimeoutMs);
+    /**
+     * 批量获取同一节点上的数据块，一次往返
+     * callbacks[i] 对应 chunks[i]，逐块完成（响应可能被拆成多个包陆续到达）
+     */
+    void fetchChunks(std::vector<ChunkId> const &chunks,
+                     NodeAddr const &destnodeId,
+                     std::vector<FetchCallback> callbacks,
+                     unsigned timeout_ms = c_fetchTimeoutMs);
+    void fetchState(unsigned int block_num, std::string const &key,
+                    NodeAddr const &destnodeId, FetchCallback callback,
+                    unsigned timeout_ms = c_fetchTimeoutMs);
+    std::future<std::string> fetchState(unsigned int block_num,
+                                        std::string const &key,
+                                        NodeAddr const &destnodeId,
+                                        unsigned timeout_ms = c_fetchTimeoutMs);
+    /**
+     * 请求 destnodeId 从 req.node 继续遍历 MPT（服务端遍历）
+     * callback 的 data 为 TrieWalkResult::rlp()，由调用方解码并用其中的证明校验
+     */
+    void fetchTrieWalk(TrieWalkRequest const &req, NodeAddr const &destnodeId,
+                       FetchCallback callback,
+                       unsigned timeout_ms = c_fetchTimeoutMs);
+    std::future<std::string> fetchTrieWalk(TrieWalkRequest const &req,
+                                           NodeAddr const &destnodeId,
+                                           unsigned timeout_ms = c_fetchTimeoutMs);
+    // 未设置时对遍历请求返回 Failed
+    void setTrieWalkHandler(TrieWalkHandler handler);
+    size_t pendingFetches();
+    /**
+     * 编码轮次推进后由 Eurasure::setCompleteCodingEpoch 调用，
+     * 把等待 coding_epoch <= epoch 的 chunk 请求交给工作线程响应
+     */
+    void onEpochCompleted(int64_t epoch);
+    size_t waitingChunkRequests();
     void responseState(unsigned int block_num, std::string const &key,
                        std::string const &data, NodeAddr const &destnodeId);
     void sendHeart(std::string const &heart, NodeAddr const &destnodeId);
@@ -103,17 +197,124 @@ class EurasureP2P {
                    dev::network::NodeID const &destnodeId);
     void processPacket(dev::sync::SyncMsgPacket::Ptr packet,
                        NodeAddr const &destnodeId);
+    // 批量响应中的一项，证明下标越界时 ok 为 false
+    struct ChunkResponse {
+        ChunkId id;
+        bool ok;
+        std::vector<std::string> merkle_list; // [数据, 默克尔证明...]
+    };
+    /**
+     * 解析 ECResponseChunksPacket 的包体 [items, hashes]
+     * 按每项的下标从共享的 hashes 中还原默克尔证明，只做解析，不校验默克尔根
+     */
+    static std::vector<ChunkResponse> parseChunksResponse(dev::RLP const &rlps);
 
-    tbb::concurrent_unordered_map<std::string, unsigned int> chunk_count_map;
-    tbb::concurrent_unordered_map<std::string, std::string> chunk_data_map;
-    std::map<std::string, std::string> state_map;
     tbb::concurrent_queue<std::pair<int, std::string>> vc_proof_queue;
 
   private:
+    struct FetchWaiter {
+        std::chrono::steady_clock::time_point deadline;
+        FetchCallback callback;
+    };
+    static std::string chunkFetchKey(unsigned int coding_epoch,
+                                     unsigned int group_id,
+                                     unsigned int chunk_pos);
+    static std::string stateFetchKey(unsigned int block_num,
+                                     std::string const &key);
+    static std::string trieWalkFetchKey(TrieWalkRequest const &req);
+    // 登记等待者，返回该键是否此前没有未完成的请求
+    bool addWaiter(std::string const &fetch_key, FetchCallback callback,
+                   unsigned timeout_ms);
+    void completeFetch(std::string const &fetch_key, bool ok,
+                       std::string const &data);
+    void reapTimeouts();
+    // 早于编码完成到达的 chunk 请求
+    struct WaitingRequest {
+        unsigned int group_id;
+        unsigned int chunk_pos;
+        NodeAddr dest;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    void serveChunkRequest(unsigned int coding_epoch, unsigned int group_id,
+                           unsigned int chunk_pos, NodeAddr const &destnodeId);
+    // 在工作线程中读取 chunk、计算默克尔证明并响应
+    void respondChunk(unsigned int coding_epoch, unsigned int group_id,
+                      unsigned int chunk_pos, NodeAddr const &destnodeId);
+    // 批量响应，超过 c_maxBatchBytes 时拆成多个包
+    void respondChunks(std::vector<ChunkId> const &chunks,
+                       NodeAddr const &destnodeId);
+    void processChunksResponse(dev::RLP const &rlps);
+    // 在工作线程中遍历并响应
+    void respondTrieWalk(TrieWalkRequest const &req, NodeAddr const &destnodeId);
+    // 数据块所在轮次尚未编码完成时加入等待表并返回 true，需持有 x_waiting
+    bool queueIfNotEncoded(ChunkId const &id, NodeAddr const &destnodeId,
+                           std::chrono::steady_clock::time_point now);
+    // 丢弃请求方已超时放弃的等待请求，需持有 x_waiting
+    size_t dropExpiredRequests(std::chrono::steady_clock::time_point now);
+    static std::future<std::string> toFuture(
+        std::function<void(FetchCallback)> const &start);
+
+    std::map<std::string, std::vector<FetchWaiter>> m_pending;
+    std::mutex x_pending;
+    std::condition_variable m_pendingCv;
+    bool m_stopReaper = false;
+    std::thread m_reaper;
+
+    std::map<unsigned int, std::vector<WaitingRequest>> m_waitingRequests;
+    std::mutex x_waiting;
+    dev::ThreadPool::Ptr m_serveWorker;
+    TrieWalkHandler m_trieWalkHandler;
+    std::mutex x_trieWalkHandler;
+
     NodeAddr m_nodeId;
     std::shared_ptr<dev::p2p::Service> m_service;
     MessageProtocolID m_protocolId;
     dev::GROUP_ID m_groupId;
     ec::Eurasure *m_eurasure;
 };
+
+/**
+ * 汇总一组 fetchChunk 的结果：等待其中 need 个成功，或全部请求结束（成功、失败或超时）。
+ * 状态放在 shared_ptr 中，wait 返回后迟到的回调不会访问已析构的对象。
+ */
+class FetchCollector {
+  public:
+    FetchCollector() : m_state(std::make_shared<State>()) {}
+
+    EurasureP2P::FetchCallback add(unsigned int chunk_pos) {
+        std::shared_ptr<State> state = m_state;
+        {
+            std::lock_guard<std::mutex> l(state->mutex);
+            state->outstanding++;
+        }
+        return [state, chunk_pos](bool ok, std::string const &data) {
+            {
+                std::lock_guard<std::mutex> l(state->mutex);
+                state->outstanding--;
+                if (ok)
+                    state->results[chunk_pos] = data;
+            }
+            state->cv.notify_all();
+        };
+    }
+
+    // 返回收到的 chunk（位置 -> 数据），个数不足 need 时说明有请求失败或超时
+    std::map<unsigned int, std::string> wait(size_t need) {
+        std::unique_lock<std::mutex> l(m_state->mutex);
+        m_state->cv.wait(l, [this, need]() {
+            return m_state->results.size() >= need ||
+                   m_state->outstanding == 0;
+        });
+        return m_state->results;
+    }
+
+  private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t outstanding = 0;
+        std::map<unsigned int, std::string> results;
+    };
+    std::shared_ptr<State> m_state;
+};
 } // namespace ec
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <libdevcrypto/Hash.h>
 
+#include "ChunkStore.h"
 #include "Eurasure-P2P.h"
 #include "VCGroup.h"
 #include <boost/algorithm/string/classification.hpp>
@@ -9,7 +10,12 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <random>
+#include <unordered_set>
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+#include <libdevcore/SnappyCompress.h>
 
 
 using namespace ec;
@@ -89,10 +95,10 @@ void Eurasure::findKeyInWhichChunk(
     int group_id = ecComputePostion(key.substr(0, 32), group_len);
     std::cout<<"key "<<key<<std::endl;
     // std::cout << " findKeyInWhichChunk group_id = " << group_id << std::endl;
-    // group = group_id / (ec_k * number_of_vc_in_one_chunk) * ec_k;  /* zcy 原来的*/
+    // group = group_id / (ec_policy.k * number_of_vc_in_one_chunk) * ec_policy.k;  /* zcy 原来的*/
     // add at 2021-11-4
-    chunk_num = group_id % ec_k;
-    // chunk_num = group_id % (ec_k + ec_m);
+    chunk_num = group_id % ec_policy.k;
+    // chunk_num = group_id % (ec_policy.k + ec_policy.m);
     // std::cout << "group = " << group << " ; chunk_num = " << chunk_num <<
     // std::endl; for (auto& s : fields)
     // {
@@ -116,12 +122,12 @@ void Eurasure::findKeyInWhichChunk_2D(
     int group_id = ecComputePostion(key.substr(0, 32), group_len);
     std::cout<<"Eurasure::findKeyInWhichChunk_2D key = "<<key<<std::endl;
     // std::cout << " findKeyInWhichChunk group_id = " << group_id << std::endl;
-    // group = group_id / (ec_k * number_of_vc_in_one_chunk) * ec_k;  /* zcy 原来的*/
+    // group = group_id / (ec_policy.k * number_of_vc_in_one_chunk) * ec_policy.k;  /* zcy 原来的*/
     // add at 2021-11-4
-    int _mod = group_id % (ec_k * ec_k);
-    group = _mod / ec_k;
-    chunk_num = _mod % ec_k;
-    // chunk_num = group_id % (ec_k + ec_m);
+    int _mod = group_id % (ec_policy.k * ec_policy.k);
+    group = _mod / ec_policy.k;
+    chunk_num = _mod % ec_policy.k;
+    // chunk_num = group_id % (ec_policy.k + ec_policy.m);
     // std::cout << "group = " << group << " ; chunk_num = " << chunk_num <<
     // std::endl; for (auto& s : fields)
     // {
@@ -139,12 +145,12 @@ void Eurasure::findKeyInWhichChunk_2D(
 void Eurasure::generate_ptrs(size_t data_size, uint8_t* data, erasure_bool* present, uint8_t** ptrs)
 {
     size_t i;
-    for (i = 0; i < ec_k + ec_m; ++i)
+    for (i = 0; i < ec_policy.k + ec_policy.m; ++i)
     {
         ptrs[i] = data + data_size * i;
     }
 
-    for (i = 0; i < ec_k + ec_m; ++i)
+    for (i = 0; i < ec_policy.k + ec_policy.m; ++i)
     {
         present[i] = true;
     }
@@ -174,12 +180,20 @@ std::string Eurasure::GetChunkDataKey(
     str.append("|").append(std::to_string(chunk_pos));
     return str;
 }
+void Eurasure::setCompleteCodingEpoch(int epoch)
+{
+    complete_coding_epoch = epoch;
+    if (ec_eurasure_p2p)
+    {
+        ec_eurasure_p2p->onEpochCompleted(epoch);
+    }
+}
 // 将传入的states转入processed-data，及对应论文中将数据化为等长的数据块
 void Eurasure::maxLen(std::map<int, std::map<int, std::string>>& states, int64_t group_id,
     std::map<int, std::string>& processed_data)
 {
     // zcy写的
-    // for (int i = 0; i < ec_k; ++i)
+    // for (int i = 0; i < ec_policy.k; ++i)
     // {
     //     std::cout<<"group_id:"<<group_id<<std::endl;
     //     std::cout<<"proce data:"<<i<<" ";
@@ -205,7 +219,7 @@ void Eurasure::maxLen(std::map<int, std::map<int, std::string>>& states, int64_t
         {
             for(auto iter = states.begin(); iter != states.end(); iter++){
                 for (auto it = states[iter->first].begin(); it != states[iter->first].end(); ++it){   
-                    processed_data[(iter->first) % ec_k].append(it->second);
+                    processed_data[(iter->first) % ec_policy.k].append(it->second);
                     // std::cout<< it->second <<" ";
                 }    
             }
@@ -213,7 +227,7 @@ void Eurasure::maxLen(std::map<int, std::map<int, std::string>>& states, int64_t
             // std::cout<<processed_data[i]<<std::endl;
         }
     }
-    for(int i=0; i<ec_k; i++){
+    for(int i=0; i<ec_policy.k; i++){
         processed_data[i].append("!!!");
     }
 
@@ -222,7 +236,7 @@ void Eurasure::maxLen(std::map<int, std::map<int, std::string>>& states, int64_t
 void Eurasure::maxLen_2D(std::map<int, std::map<int, std::string>>& states, int64_t group_id,
     std::map<int, std::string>& processed_data)
 {
-    //qqf 将state中的状态数据划分至processed_data[ ec_k * ec_k ]中
+    //qqf 将state中的状态数据划分至processed_data[ ec_policy.k * ec_policy.k ]中
     for (int i = 0; i < 1; ++i)
     {
         // std::cout<<"group_id:"<<group_id<<std::endl;
@@ -231,7 +245,7 @@ void Eurasure::maxLen_2D(std::map<int, std::map<int, std::string>>& states, int6
         {
             for(auto iter = states.begin(); iter != states.end(); iter++){
                 for (auto it = states[iter->first].begin(); it != states[iter->first].end(); ++it){   
-                    processed_data[(iter->first) % (ec_k * ec_k)].append(it->second);
+                    processed_data[(iter->first) % (ec_policy.k * ec_policy.k)].append(it->second);
                     // std::cout<< it->second <<" ";
                 }    
             }
@@ -239,7 +253,7 @@ void Eurasure::maxLen_2D(std::map<int, std::map<int, std::string>>& states, int6
             // std::cout<<processed_data[i]<<std::endl;
         }
     }
-    for(int i=0; i<(ec_k*ec_k); i++){
+    for(int i=0; i<(ec_policy.k*ec_policy.k); i++){
         processed_data[i].append("!!!");
     }
 
@@ -253,12 +267,12 @@ std::pair<uint8_t*, int64_t> Eurasure::preprocess(
     maxLen(states, groupid, processed_data);
 
     int max_len = processed_data[0].size();
-    for (int i = 1; i < ec_k; ++i)
+    for (int i = 1; i < ec_policy.k; ++i)
     {
         max_len = max(max_len, (int)processed_data[i].size());
     }
-    uint8_t* data = new uint8_t[max_len * (ec_k + ec_m) * sizeof(uint8_t)]();
-    memset(data, 0, max_len * (ec_k + ec_m) * sizeof(uint8_t));
+    uint8_t* data = new uint8_t[max_len * (ec_policy.k + ec_policy.m) * sizeof(uint8_t)]();
+    memset(data, 0, max_len * (ec_policy.k + ec_policy.m) * sizeof(uint8_t));
     int64_t count = 0;
     //将数据预处理
 
@@ -280,12 +294,12 @@ std::pair<uint8_t*, int64_t> Eurasure::preprocess_2D(
     maxLen_2D(states, groupid, processed_data);
 
     int max_len = processed_data[0].size();
-    for (int i = 1; i < (ec_k*ec_k); ++i)
+    for (int i = 1; i < (ec_policy.k*ec_policy.k); ++i)
     {
         max_len = max(max_len, (int)processed_data[i].size());
     }
-    uint8_t* data = new uint8_t[max_len * (ec_k + ec_m) * (ec_k * 2) * sizeof(uint8_t)]();
-    memset(data, 0, max_len * (ec_k + ec_m) * (ec_k * 2) * sizeof(uint8_t));
+    uint8_t* data = new uint8_t[max_len * (ec_policy.k + ec_policy.m) * (ec_policy.k * 2) * sizeof(uint8_t)]();
+    memset(data, 0, max_len * (ec_policy.k + ec_policy.m) * (ec_policy.k * 2) * sizeof(uint8_t));
     int64_t count = 0;
     //将数据预处理
 
@@ -298,17 +312,17 @@ std::pair<uint8_t*, int64_t> Eurasure::preprocess_2D(
         memcpy(data + count, it->second.c_str(), it->second.size());
         ++ec_k_cnt;
         // 多留一个位置
-        if(ec_k_cnt >= ec_k){
+        if(ec_k_cnt >= ec_policy.k){
             count += max_len;  
             ec_k_cnt = 0;  
         }
         count += max_len;
     }
     // 纵向做EC，并把其string传入data
-    for (int i = 0; i < ec_k; i++)
+    for (int i = 0; i < ec_policy.k; i++)
     {
-        for(int j =0; j < ec_k; j++){
-            memcpy(data + count, processed_data[i + (j * ec_k)].c_str(), processed_data[i + (j * ec_k)].size());
+        for(int j =0; j < ec_policy.k; j++){
+            memcpy(data + count, processed_data[i + (j * ec_policy.k)].c_str(), processed_data[i + (j * ec_policy.k)].size());
             count += max_len;
         }
         count += max_len;
@@ -325,28 +339,28 @@ static inline double GetTime()
 std::pair<uint8_t**, int64_t> Eurasure::encode(std::pair<uint8_t*, int64_t> blocks_rlp_data)
 {
     int64_t length = blocks_rlp_data.second;
-    uint8_t** ptrs = new uint8_t*[ec_k + ec_m];
-    erasure_bool* present = new erasure_bool[ec_k + ec_m];
+    uint8_t** ptrs = new uint8_t*[ec_policy.k + ec_policy.m];
+    erasure_bool* present = new erasure_bool[ec_policy.k + ec_policy.m];
     generate_ptrs(length, blocks_rlp_data.first, present, ptrs);
 
-    erasure_encoder_parameters params = {ec_k + ec_m, ec_k, length};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
-    erasure_encode(encoder, ptrs, ptrs + ec_k);
+    erasure_encoder_parameters params = {ec_policy.k + ec_policy.m, ec_policy.k, length};
+    erasure_encoder* encoder = erasure_create_encoder(&params, ec_policy.codec);
+    erasure_encode(encoder, ptrs, ptrs + ec_policy.k);
 
     erasure_destroy_encoder(encoder);
-    delete present;
+    delete[] present;
     return std::make_pair(ptrs, length);
 }
 
 std::pair<int*, int*> Eurasure::get_my_chunk_set(unsigned int groupid)
 {
     int* chunk_set = get_distinct_chunk_set(groupid);
-    int* my_chunks = new int[ec_c];
-    memset(my_chunks, 0, sizeof(int) * ec_c);
-    for (int i = 0; i < ec_c; i++)
+    int* my_chunks = new int[ec_policy.c];
+    memset(my_chunks, 0, sizeof(int) * ec_policy.c);
+    for (int i = 0; i < ec_policy.c; i++)
     {
-        // int remain = (chunk_set[i] + ec_position_in_sealers) / (ec_k + ec_m);
-        my_chunks[i] = (chunk_set[i] + ec_position_in_sealers) % (ec_k + ec_m);
+        // int remain = (chunk_set[i] + ec_position_in_sealers) / (ec_policy.k + ec_policy.m);
+        my_chunks[i] = (chunk_set[i] + ec_position_in_sealers) % (ec_policy.k + ec_policy.m);
     }
     // delete chunk_set;
     return std::make_pair(my_chunks, chunk_set);
@@ -382,32 +396,31 @@ bool Eurasure::writeDB(
     // qqf 算出各个节点存储那几个块，随机分配
     int* chunk_set = get_distinct_chunk_set(coding_epoch);
     // std::cout << "chunk set :" << std::endl;
-    // for(int i = 0; i < ec_k + 2*ec_m; i++) {
+    // for(int i = 0; i < ec_policy.k + 2*ec_policy.m; i++) {
     //     std::cout << chunk_set[i] << " ";
     // }
     // std::cout << endl;
     int count = 0;
-    // std::cout << string((const char*)chunk.first[0], chunk.second).size() / 1024.0 << std::endl;
-    for (count = 0; count < ec_k + ec_m; count++)
+    // 本节点负责的数据块与校验块放在同一个 WriteBatch 中一次写入
+    WriteBatch batch;
+    std::vector<std::pair<h256, bytesConstRef>> items;
+    for (count = 0; count < ec_policy.k + ec_policy.m; count++)
     {
         // 2021-11-7
         if (chunk_set[count] == ec_position_in_sealers)
         {
-            string str = GetChunkDataKey(coding_epoch, groupid, count);
-            std::cout << "writedb key   = " << str << std::endl;
-            string value((const char*)chunk.first[count], chunk.second);
-            std::cout<<"chunk first: "<<chunk.first[count]<<std::endl;
-            std::cout<<"chunk second: "<<chunk.second<<std::endl;
-            
-            // 所写在DB的key值与value值
-            std::cout<<value<<std::endl;
-            // std::cout<<str<<" "<<std::endl;
-            std::cout<<"value size"<< sizeof(value)<< std::endl;
             // str 就是标记该 chunk 对应的位置(如 1|1|4), value 为真实的校验块/数据块 数据字符串
-            Status status = ec_db->Put(WriteOptions(), str, value);
-            assert(status.ok());
+            string str = GetChunkDataKey(coding_epoch, groupid, count);
+            if (ec_chunk_store)
+                items.push_back(std::make_pair(sha3(str), bytesConstRef(chunk.first[count], chunk.second)));
+            else
+                batch.Put(str, Slice((const char*)chunk.first[count], chunk.second));
         }
     }
+    if (ec_chunk_store)
+        return ec_chunk_store->append(items);
+    Status status = ec_db->Write(WriteOptions(), &batch);
+    assert(status.ok());
 
     return true;
 }
@@ -418,28 +431,30 @@ bool Eurasure::writeDB_columns(
     // qqf 算出各个节点存储那几个块，随机分配
     int* chunk_set = get_distinct_chunk_set(coding_epoch);
     // std::cout << "chunk set :" << std::endl;
-    // for(int i = 0; i < ec_k + 2*ec_m; i++) {
+    // for(int i = 0; i < ec_policy.k + 2*ec_policy.m; i++) {
     //     std::cout << chunk_set[i] << " ";
     // }
     // std::cout << endl;
     int count = 0;
-    // std::cout << string((const char*)chunk.first[0], chunk.second).size() / 1024.0 << std::endl;
-    for (count = 0; count < ec_k + ec_m; count++)
+    WriteBatch batch;
+    std::vector<std::pair<h256, bytesConstRef>> items;
+    for (count = 0; count < ec_policy.k + ec_policy.m; count++)
     {
         // 2021-11-7
-        if (chunk_set[groupid] == ec_position_in_sealers && count >= ec_k)
+        if (chunk_set[groupid] == ec_position_in_sealers && count >= ec_policy.k)
         {
             // 纵向就是将groupid和count转换过来
             string str = GetChunkDataKey(coding_epoch, count, groupid);
-            // std::cout << "writedb key   = " << str << std::endl;
-            string value((const char*)chunk.first[count], chunk.second);
-            // std::cout<<"chunk first: "<<chunk.first[count]<<std::endl;
-            // std::cout<<"chunk second: "<<chunk.second<<std::endl;
-            std::cout<<str<<" "<<value<<std::endl;
-            Status status = ec_db->Put(WriteOptions(), str, value);
-            assert(status.ok());
+            if (ec_chunk_store)
+                items.push_back(std::make_pair(sha3(str), bytesConstRef(chunk.first[count], chunk.second)));
+            else
+                batch.Put(str, Slice((const char*)chunk.first[count], chunk.second));
         }
     }
+    if (ec_chunk_store)
+        return ec_chunk_store->append(items);
+    Status status = ec_db->Write(WriteOptions(), &batch);
+    assert(status.ok());
 
     return true;
 }
@@ -450,7 +465,7 @@ bool Eurasure::writeDB_columns(
 //     unsigned int coding_epoch = block_number;
 
 //     std::pair<uint8_t**, int64_t> chunks = encode(preprocess(block_number,
-//     groupid, states)); for (int count = 0; count < ec_k + ec_m; count++)
+//     groupid, states)); for (int count = 0; count < ec_policy.k + ec_policy.m; count++)
 //     {
 //          int pos = count;
 //          string value((const char*)chunks.first[count], chunks.second);
@@ -477,7 +492,7 @@ void Eurasure::saveChunk(std::map<int, std::map<int, std::string>>& states, int
         << " encoding time is " << t2-t1 << " s"<< std::endl;
     outfile.close();
 
-    for (int count = 0; count < ec_k + ec_m; count++)
+    for (int count = 0; count < ec_policy.k + ec_policy.m; count++)
     {
         int pos = count;
         // 前面一个是该数据段开始的指针，后面int类型是截取的字符数量
@@ -496,22 +511,22 @@ void Eurasure::saveChunk_2D(std::map<int, std::map<int, std::string>>& states, i
     auto blocks_rlp_data = preprocess_2D(block_number, groupid, states);
     // 写入横向EC
     std::cout<<"写入横向EC"<<std::endl;
-    for(int i=0; i<ec_k; i++){
+    for(int i=0; i<ec_policy.k; i++){
         std::pair<uint8_t**, int64_t> chunks = encode(blocks_rlp_data);
-        for (int count = 0; count < ec_k + ec_m; count++){
+        for (int count = 0; count < ec_policy.k + ec_policy.m; count++){
             int pos = count;
             string value((const char*)chunks.first[count], chunks.second);
             cs[i][pos] = value;
         }
         writeDB(coding_epoch, i, chunks);
-        blocks_rlp_data.first = (blocks_rlp_data.first) + blocks_rlp_data.second * (ec_k + ec_m);
+        blocks_rlp_data.first = (blocks_rlp_data.first) + blocks_rlp_data.second * (ec_policy.k + ec_policy.m);
     }
     // 写入纵向EC
     std::cout<<"写入列向EC"<<std::endl;
-    for(int i=0; i<ec_k; i++){
+    for(int i=0; i<ec_policy.k; i++){
         std::pair<uint8_t**, int64_t> chunks = encode(blocks_rlp_data);
         writeDB_columns(coding_epoch, i, chunks);
-        blocks_rlp_data.first = (blocks_rlp_data.first) + blocks_rlp_data.second * (ec_k + ec_m);
+        blocks_rlp_data.first = (blocks_rlp_data.first) + blocks_rlp_data.second * (ec_policy.k + ec_policy.m);
     }
 }
 int* Eurasure::get_distinct_chunk_set(unsigned int coding_epoch)
@@ -519,12 +534,12 @@ int* Eurasure::get_distinct_chunk_set(unsigned int coding_epoch)
     std::hash<unsigned int> ec_hash;
     unsigned int seed = ec_hash(coding_epoch);
     std::mt19937 generator(seed);
-    std::uniform_int_distribution<> dis(0, ec_k + ec_m);
-    // std::uniform_int_distribution<> dis(0, ec_k + ec_m - 1);
-    int* chunk_set = new int[ec_k + ec_m];
+    std::uniform_int_distribution<> dis(0, ec_policy.k + ec_policy.m);
+    // std::uniform_int_distribution<> dis(0, ec_policy.k + ec_policy.m - 1);
+    int* chunk_set = new int[ec_policy.k + ec_policy.m];
     int lucky_boy = dis(generator);
     // std::cout << "luck boy = " << lucky_boy << std::endl;
-    for (int j = 0; j < ec_k + ec_m; j++)
+    for (int j = 0; j < ec_policy.k + ec_policy.m; j++)
     {
         int tmp = dis(generator);
         if (tmp == lucky_boy)
@@ -543,7 +558,7 @@ int* Eurasure::get_distinct_chunk_set(unsigned int coding_epoch)
         }
     }
     // qqf 暂时按照序号固定分配
-    for(int i=0; i<ec_k+ec_m; i++){
+    for(int i=0; i<ec_policy.k+ec_policy.m; i++){
         chunk_set[i]=i;
     }
 
@@ -553,9 +568,9 @@ int* Eurasure::get_distinct_chunk_set(unsigned int coding_epoch)
 std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
 {
     double start_time = GetTime();
-    erasure_bool* present = new erasure_bool[ec_k + ec_m];
+    erasure_bool* present = new erasure_bool[ec_policy.k + ec_policy.m];
     int* chunk_set = get_distinct_chunk_set(coding_epoch);
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         std::cout << chunk_set[i] << "  ";
     }
@@ -577,7 +592,7 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
     std::set<unsigned int> replica_chunk;
     std::set<unsigned int> no_replica_chunk;
 
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         no_replica_chunk.insert(i);
     }
@@ -591,7 +606,7 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
     }
     else{
         // 将本地的Chunk也计入replica_chunk中，参与纠删码恢复
-        for (int i = 0; i < ec_k + ec_m; i++){
+        for (int i = 0; i < ec_policy.k + ec_policy.m; i++){
             if(chunk_set[i] == ec_position_in_sealers){
                 std::cout<<"I have Chunk "<< i <<std::endl;
                 replica_chunk.insert(i);
@@ -600,10 +615,12 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
         }
     }
 
-    unsigned int need_chunk_num = ec_k - replica_chunk.size();
+    unsigned int need_chunk_num = ec_policy.k - replica_chunk.size();
     unsigned int need_chunk_count = need_chunk_num;
     bool flag = false;
     std::cout<<"ec_position_in_sealers:"<<ec_position_in_sealers<<std::endl;
+    FetchCollector collector;
+    std::map<int, std::vector<ChunkId>> chunks_by_sealer;
     for (std::set<unsigned int>::iterator it = no_replica_chunk.begin();
          it != no_replica_chunk.end(); ++it)
     {
@@ -614,7 +631,7 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
         std::cout<<"res = "<<res<<std::endl;
         if (res < 0)
         {
-            res += (ec_k + ec_m);
+            res += (ec_policy.k + ec_policy.m);
         }
 
         if (res != ec_position_in_sealers)
@@ -625,39 +642,29 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
                       << " pos = " << *it << "  sealer = " <<
             ec_sealers[res]
                       << std::endl;
-            ec_eurasure_p2p->requestChunk(coding_epoch, group_id, *it, ec_sealers[res]);
+            chunks_by_sealer[res].push_back({coding_epoch, group_id, *it});
         }
         // need_chunk_count--;
     }
-    starttime = GetTime();
-    std::cout << "send complete" << std::endl;
-    int num;
-    std::string str = std::to_string(coding_epoch);
-    str.append("-");
-    str.append(std::to_string(group_id));
-    auto its = ec_eurasure_p2p->chunk_count_map.find(str);
-    if (its == ec_eurasure_p2p->chunk_count_map.end())
-    {
-        num = 0;
-    }
-    else
+    // 同一节点上的 chunk 合并为一个批量请求
+    for (auto const& b : chunks_by_sealer)
     {
-        num = its->second;
-    }
-    std::cout<<"find str = "<<str<<std::endl;
-    while (num < need_chunk_num)
-    {
-        sleep(0.0001);
-        its = ec_eurasure_p2p->chunk_count_map.find(str);
-        if (its == ec_eurasure_p2p->chunk_count_map.end())
-        {
-            num = 0;
-        }
-        else
+        std::vector<EurasureP2P::FetchCallback> callbacks;
+        for (auto const& c : b.second)
         {
-            num = its->second;
-            // std::cout<<num<<std::endl;
+            callbacks.push_back(collector.add(c.chunk_pos));
         }
+        ec_eurasure_p2p->fetchChunks(b.second, ec_sealers[b.first], std::move(callbacks));
+    }
+    starttime = GetTime();
+    // 等待 need_chunk_num 个响应，其余请求失败或超时时不再等待
+    auto received = collector.wait(need_chunk_num);
+    if (received.size() < need_chunk_num)
+    {
+        std::cout << "decode epoch " << coding_epoch << " group " << group_id << " received "
+                  << received.size() << " of " << need_chunk_num << " chunks" << std::endl;
+        delete[] present;
+        return std::string();
     }
     std::cout << "wait chunk response time = " << GetTime() - starttime <<
     std::endl;
@@ -670,34 +677,21 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
     // (*sec_it).first
     //     << std::endl;
     // }
-    for (unsigned int i = 0; i < ec_k + ec_m; i++)
+    for (auto const& r : received)
     {
-        std::string str_count = GetChunkDataKey(coding_epoch, group_id, i);
-        // std::cout << "str_count " << str_count << std::endl;
-        auto sec_it = ec_eurasure_p2p->chunk_data_map.find(str_count);
-        if (sec_it != ec_eurasure_p2p->chunk_data_map.end())
-        {
-            get_chunk_pos.insert(i);
-            // std::cout<< " can find "<< i <<std::endl;
-        }
+        get_chunk_pos.insert(r.first);
     }
     // qqf 通过获取第一个元素来判断data的长度和大小？
     unsigned int chunk_rec_pos = *(get_chunk_pos.begin());
     // std::cout << "chunk_rec_pos = " << chunk_rec_pos << std::endl;
-    auto read_acc = ec_eurasure_p2p->chunk_data_map.find(
-        GetChunkDataKey(coding_epoch, group_id, chunk_rec_pos));
-    // std::cout<< " //// "<< GetChunkDataKey(coding_epoch, group_id, chunk_rec_pos) <<std::endl;
-    // if(ec_eurasure_p2p->chunk_data_map.end() == read_acc ){
-    //     std::cout<< " is end "<<std::endl;
-    // }
-    std::string chunk_data = read_acc->second;
+    std::string chunk_data = received[chunk_rec_pos];
     // std::cout<< " \\\\ "<<std::endl;
 
-    uint8_t** ptrs = new uint8_t*[ec_k + ec_m];
+    uint8_t** ptrs = new uint8_t*[ec_policy.k + ec_policy.m];
 
-    memset(present, false, (ec_k + ec_m) * sizeof(erasure_bool));
-    uint8_t* data = new uint8_t[(ec_k + ec_m) * chunk_data.size()];
-    memset(data, 0, (ec_k + ec_m) * chunk_data.size() * sizeof(uint8_t));
+    memset(present, false, (ec_policy.k + ec_policy.m) * sizeof(erasure_bool));
+    uint8_t* data = new uint8_t[(ec_policy.k + ec_policy.m) * chunk_data.size()];
+    memset(data, 0, (ec_policy.k + ec_policy.m) * chunk_data.size() * sizeof(uint8_t));
     generate_ptrs(chunk_data.size(), data, present, ptrs);
 
     // present[chunk_rec_pos] = true;
@@ -705,7 +699,7 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
     // {
     //     ptrs[chunk_rec_pos][j] = chunk_rec_data[j];
     // }
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         present[i] = false;
     }
@@ -716,12 +710,9 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
         int seq = it;
         // std::cout << "seq = " << seq << std::endl;
         present[seq] = true;
-        std::string fir = GetChunkDataKey(coding_epoch, group_id, it);
-        auto data_it = ec_eurasure_p2p->chunk_data_map.find(fir);
-        // for (int64_t j = 0; j < chunk_data.size(); j++)
-        // {
-        // ptrs[seq][j] = data_it->second[j];
-        memcpy(ptrs[seq], (uint8_t*)const_cast<char*>(data_it->second.c_str()), chunk_data.size());
+        auto const& chunk = received[it];
+        memcpy(ptrs[seq], (uint8_t*)const_cast<char*>(chunk.c_str()),
+            std::min(chunk.size(), chunk_data.size()));
     }
     if (replica_chunk.size() > 0)
     {
@@ -738,15 +729,15 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
         }
     }
     present[chunk_pos] = false;
-    for(int i = 0 ; i<ec_k+ec_m; i++){
+    for(int i = 0 ; i<ec_policy.k+ec_policy.m; i++){
         // std::cout<<"No."<<i<<" "<<ptrs[i]<<std::endl;
     }
     // std::cout << "get chunk and prepare decoding time = " << GetTime() -
     // starttime << std::endl;
     start_time = GetTime();
 
-    erasure_encoder_parameters params = {ec_k + ec_m, ec_k, chunk_data.size()};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
+    erasure_encoder_parameters params = {ec_policy.k + ec_policy.m, ec_policy.k, chunk_data.size()};
+    erasure_encoder* encoder = erasure_create_encoder(&params, ec_policy.codec);
     erasure_recover(encoder, ptrs, present);
     uint8_t* tmp_data = new uint8_t[chunk_data.size()];
     for (int i = 0; i < chunk_data.size(); i++)
@@ -757,7 +748,7 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
     std::string strs(tmp_data, tmp_data + chunk_data.size());
 
     erasure_destroy_encoder(encoder);
-    delete present;
+    delete[] present;
     double end_time = GetTime();
     // std::cout << end_time - start_time << std::endl;
     return strs;
@@ -766,9 +757,9 @@ std::string Eurasure::decode(unsigned int coding_epoch, std::string key)
 std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
 {
     double start_time = GetTime();
-    erasure_bool* present = new erasure_bool[ec_k + ec_m];
+    erasure_bool* present = new erasure_bool[ec_policy.k + ec_policy.m];
     int* chunk_set = get_distinct_chunk_set(coding_epoch);
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         std::cout << chunk_set[i] << "  ";
     }
@@ -791,7 +782,7 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
     std::set<unsigned int> replica_chunk;
     std::set<unsigned int> no_replica_chunk;
 
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         no_replica_chunk.insert(i);
     }
@@ -805,7 +796,7 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
     }
     else{
         // 将本地的Chunk也计入replica_chunk中，参与纠删码恢复
-        for (int i = 0; i < ec_k + ec_m; i++){
+        for (int i = 0; i < ec_policy.k + ec_policy.m; i++){
             if(chunk_set[i] == ec_position_in_sealers){
                 std::cout<<"I have Chunk "<< i <<std::endl;
                 replica_chunk.insert(i);
@@ -814,11 +805,13 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
         }
     }
 
-    unsigned int need_chunk_num = ec_k - replica_chunk.size();
+    unsigned int need_chunk_num = ec_policy.k - replica_chunk.size();
     unsigned int need_chunk_count = need_chunk_num;
     bool flag = false;
     std::cout<<"ec_position_in_sealers = "<<ec_position_in_sealers<<std::endl;
     // 遍历所有本地没有的chunk，并且向其他节点发送chunk获取请求
+    FetchCollector collector;
+    std::map<int, std::vector<ChunkId>> chunks_by_sealer;
     for (std::set<unsigned int>::iterator it = no_replica_chunk.begin();
          it != no_replica_chunk.end(); ++it)
     {
@@ -829,7 +822,7 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
         std::cout<<"request chunk number = "<<res<<std::endl;
         if (res < 0)
         {
-            res += (ec_k + ec_m);
+            res += (ec_policy.k + ec_policy.m);
         }
 
         if (res != ec_position_in_sealers)
@@ -840,40 +833,31 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
                       << " pos = " << *it << "  sealer = " <<
             ec_sealers[res]
                       << std::endl;
-            ec_eurasure_p2p->requestChunk(coding_epoch, group_id, *it, ec_sealers[res]);
+            chunks_by_sealer[res].push_back({coding_epoch, group_id, *it});
         }
         // need_chunk_count--;
     }
+    // 同一节点上的 chunk 合并为一个批量请求
+    for (auto const& b : chunks_by_sealer)
+    {
+        std::vector<EurasureP2P::FetchCallback> callbacks;
+        for (auto const& c : b.second)
+        {
+            callbacks.push_back(collector.add(c.chunk_pos));
+        }
+        ec_eurasure_p2p->fetchChunks(b.second, ec_sealers[b.first], std::move(callbacks));
+    }
     starttime = GetTime();
-    std::cout << "send complete" << std::endl;
 
     // 根据区块号codingepoch和横坐标groupid，从P2p模块中判断是否已经获取到ec_k数量的chunk
-    int num;
-    std::string str = std::to_string(coding_epoch);
-    str.append("-");
-    str.append(std::to_string(group_id));
-    auto its = ec_eurasure_p2p->chunk_count_map.find(str);
-    if (its == ec_eurasure_p2p->chunk_count_map.end())
+    // 等待 need_chunk_num 个响应，其余请求失败或超时时不再等待
+    auto received = collector.wait(need_chunk_num);
+    if (received.size() < need_chunk_num)
     {
-        num = 0;
-    }
-    else
-    {
-        num = its->second;
-    }
-    std::cout<<"finding key str = "<<str<<std::endl;
-    while (num < need_chunk_num)
-    {
-        sleep(0.0001);
-        its = ec_eurasure_p2p->chunk_count_map.find(str);
-        if (its == ec_eurasure_p2p->chunk_count_map.end())
-        {
-            num = 0;
-        }
-        else
-        {
-            num = its->second;
-        }
+        std::cout << "decode epoch " << coding_epoch << " group " << group_id << " received "
+                  << received.size() << " of " << need_chunk_num << " chunks" << std::endl;
+        delete[] present;
+        return std::string();
     }
     std::cout << "wait chunk response time = " << GetTime() - starttime <<
     std::endl;
@@ -888,28 +872,20 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
     // }
 
     // 将以以获得chunk的编号遍历，然后依次在P2p模块下的chunk map中寻找
-    for (unsigned int i = 0; i < ec_k + ec_m; i++)
+    for (auto const& r : received)
     {
-        std::string str_count = GetChunkDataKey(coding_epoch, group_id, i);
-        // std::cout << "str_count " << str_count << std::endl;
-        auto sec_it = ec_eurasure_p2p->chunk_data_map.find(str_count);
-        if (sec_it != ec_eurasure_p2p->chunk_data_map.end())
-        {
-            get_chunk_pos.insert(i);
-        }
+        get_chunk_pos.insert(r.first);
     }
     // qqf 通过获取第一个元素来判断data的长度和大小？
     unsigned int chunk_rec_pos = *(get_chunk_pos.begin());
     // std::cout << "chunk_rec_pos = " << chunk_rec_pos << std::endl;
-    auto read_acc = ec_eurasure_p2p->chunk_data_map.find(
-        GetChunkDataKey(coding_epoch, group_id, chunk_rec_pos));
-    std::string chunk_data = read_acc->second;
+    std::string chunk_data = received[chunk_rec_pos];
 
-    uint8_t** ptrs = new uint8_t*[ec_k + ec_m];
+    uint8_t** ptrs = new uint8_t*[ec_policy.k + ec_policy.m];
 
-    memset(present, false, (ec_k + ec_m) * sizeof(erasure_bool));
-    uint8_t* data = new uint8_t[(ec_k + ec_m) * chunk_data.size()];
-    memset(data, 0, (ec_k + ec_m) * chunk_data.size() * sizeof(uint8_t));
+    memset(present, false, (ec_policy.k + ec_policy.m) * sizeof(erasure_bool));
+    uint8_t* data = new uint8_t[(ec_policy.k + ec_policy.m) * chunk_data.size()];
+    memset(data, 0, (ec_policy.k + ec_policy.m) * chunk_data.size() * sizeof(uint8_t));
     generate_ptrs(chunk_data.size(), data, present, ptrs);
     std::cout<<" == chunk_data_size == " << chunk_data.size() << std::endl;
     // present[chunk_rec_pos] = true;
@@ -917,7 +893,7 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
     // {
     //     ptrs[chunk_rec_pos][j] = chunk_rec_data[j];
     // }
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         present[i] = false;
     }
@@ -928,12 +904,9 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
         int seq = it;
         // std::cout << "seq = " << seq << std::endl;
         present[seq] = true;
-        std::string fir = GetChunkDataKey(coding_epoch, group_id, it);
-        auto data_it = ec_eurasure_p2p->chunk_data_map.find(fir);
-        // for (int64_t j = 0; j < chunk_data.size(); j++)
-        // {
-        // ptrs[seq][j] = data_it->second[j];
-        memcpy(ptrs[seq], (uint8_t*)const_cast<char*>(data_it->second.c_str()), chunk_data.size());
+        auto const& chunk = received[it];
+        memcpy(ptrs[seq], (uint8_t*)const_cast<char*>(chunk.c_str()),
+            std::min(chunk.size(), chunk_data.size()));
     }
     // 读取本地存储的chunk信息
     if (replica_chunk.size() > 0)
@@ -951,15 +924,15 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
         }
     }
     present[chunk_pos] = false;
-    for(int i = 0 ; i<ec_k+ec_m; i++){
+    for(int i = 0 ; i<ec_policy.k+ec_policy.m; i++){
         std::cout<<"Chunk No."<<i<<" = "<<ptrs[i]<<std::endl;
     }
     // std::cout << "get chunk and prepare decoding time = " << GetTime() -
     // starttime << std::endl;
     start_time = GetTime();
 
-    erasure_encoder_parameters params = {ec_k + ec_m, ec_k, chunk_data.size()};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
+    erasure_encoder_parameters params = {ec_policy.k + ec_policy.m, ec_policy.k, chunk_data.size()};
+    erasure_encoder* encoder = erasure_create_encoder(&params, ec_policy.codec);
     erasure_recover(encoder, ptrs, present);
     uint8_t* tmp_data = new uint8_t[chunk_data.size()];
     for (int i = 0; i < chunk_data.size(); i++)
@@ -970,7 +943,7 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
     std::string strs(tmp_data, tmp_data + chunk_data.size());
 
     erasure_destroy_encoder(encoder);
-    delete present;
+    delete[] present;
     double end_time = GetTime();
     // std::cout << end_time - start_time << std::endl;
     return strs;
@@ -978,9 +951,9 @@ std::string Eurasure::decode_2D(unsigned int coding_epoch, std::string key)
 std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string key)
 {
     double start_time = GetTime();
-    erasure_bool* present = new erasure_bool[ec_k + ec_m];
+    erasure_bool* present = new erasure_bool[ec_policy.k + ec_policy.m];
     int* chunk_set = get_distinct_chunk_set(coding_epoch);
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         std::cout << chunk_set[i] << "  ";
     }
@@ -1003,7 +976,7 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
     std::set<unsigned int> replica_chunk;
     std::set<unsigned int> no_replica_chunk;
 
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         no_replica_chunk.insert(i);
     }
@@ -1011,7 +984,7 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
     
     // 将本地的Chunk也计入replica_chunk中，参与纠删码恢复
     // 目前的方案是将其余的chunk存储至本地，若日后有修改，可以在此基础上添加对应功能
-    for (int i = 0; i < ec_k + ec_m; i++){
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++){
         if(chunk_set[group_id] == ec_position_in_sealers){
             std::cout<<"I have Chunk "<< i <<std::endl;
             replica_chunk.insert(i);
@@ -1019,11 +992,13 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
         }
     }
 
-    int need_chunk_num = ec_k - replica_chunk.size();
+    int need_chunk_num = ec_policy.k - replica_chunk.size();
     // unsigned int need_chunk_count = need_chunk_num;
     bool flag = false;
     std::cout<<"ec_position_in_sealers = "<<ec_position_in_sealers<<std::endl;
     // 遍历所有本地没有的chunk，并且向其他节点发送chunk获取请求 （若chunk都存在本地，则无需向其他节点请求）
+    FetchCollector collector;
+    std::map<int, std::vector<ChunkId>> chunks_by_sealer;
     for (std::set<unsigned int>::iterator it = no_replica_chunk.begin();
          it != no_replica_chunk.end(); ++it)
     {
@@ -1034,7 +1009,7 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
         std::cout<<"request chunk number = "<<res<<std::endl;
         if (res < 0)
         {
-            res += (ec_k + ec_m);
+            res += (ec_policy.k + ec_policy.m);
         }
 
         if (res != ec_position_in_sealers)
@@ -1045,41 +1020,31 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
                       << " pos = " << *it << "  sealer = " <<
             ec_sealers[res]
                       << std::endl;
-            ec_eurasure_p2p->requestChunk(coding_epoch, group_id, *it, ec_sealers[res]);
+            chunks_by_sealer[res].push_back({coding_epoch, group_id, *it});
         }
         // need_chunk_count--;
     }
+    // 同一节点上的 chunk 合并为一个批量请求
+    for (auto const& b : chunks_by_sealer)
+    {
+        std::vector<EurasureP2P::FetchCallback> callbacks;
+        for (auto const& c : b.second)
+        {
+            callbacks.push_back(collector.add(c.chunk_pos));
+        }
+        ec_eurasure_p2p->fetchChunks(b.second, ec_sealers[b.first], std::move(callbacks));
+    }
     starttime = GetTime();
-    std::cout << "send complete" << std::endl;
 
     // 根据区块号codingepoch和横坐标groupid，从P2p模块中判断是否已经获取到ec_k数量的chunk
-    int num;
-    std::string str = std::to_string(coding_epoch);
-    str.append("-");
-    str.append(std::to_string(group_id));
-    auto its = ec_eurasure_p2p->chunk_count_map.find(str);
-    if (its == ec_eurasure_p2p->chunk_count_map.end())
-    {
-        num = 0;
-    }
-    else
+    // 等待 need_chunk_num 个响应，其余请求失败或超时时不再等待
+    auto received = collector.wait(need_chunk_num);
+    if (received.size() < need_chunk_num)
     {
-        num = its->second;
-    }
-    std::cout<<"finding key str = "<<str<<std::endl;
-    while (num < need_chunk_num)
-    {
-        std::cout << num << need_chunk_num << std::endl;
-        sleep(0.0001);
-        its = ec_eurasure_p2p->chunk_count_map.find(str);
-        if (its == ec_eurasure_p2p->chunk_count_map.end())
-        {
-            num = 0;
-        }
-        else
-        {
-            num = its->second;
-        }
+        std::cout << "decode epoch " << coding_epoch << " group " << group_id << " received "
+                  << received.size() << " of " << need_chunk_num << " chunks" << std::endl;
+        delete[] present;
+        return std::string();
     }
     std::cout << "wait chunk response time = " << GetTime() - starttime <<
     std::endl;
@@ -1094,7 +1059,7 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
     // }
 
     // 将以以获得chunk的编号遍历，然后依次在P2p模块下的chunk map中寻找
-    // for (unsigned int i = 0; i < ec_k + ec_m; i++)
+    // for (unsigned int i = 0; i < ec_policy.k + ec_policy.m; i++)
     // {
     //     std::string str_count = GetChunkDataKey(coding_epoch, group_id, i);
     //     // std::cout << "str_count " << str_count << std::endl;
@@ -1114,11 +1079,11 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
             << " chunk_data = " << chunk_data <<std::endl;
 
 
-    uint8_t** ptrs = new uint8_t*[ec_k + ec_m];
+    uint8_t** ptrs = new uint8_t*[ec_policy.k + ec_policy.m];
 
-    memset(present, false, (ec_k + ec_m) * sizeof(erasure_bool));
-    uint8_t* data = new uint8_t[(ec_k + ec_m) * chunk_data.size()];
-    memset(data, 0, (ec_k + ec_m) * chunk_data.size() * sizeof(uint8_t));
+    memset(present, false, (ec_policy.k + ec_policy.m) * sizeof(erasure_bool));
+    uint8_t* data = new uint8_t[(ec_policy.k + ec_policy.m) * chunk_data.size()];
+    memset(data, 0, (ec_policy.k + ec_policy.m) * chunk_data.size() * sizeof(uint8_t));
     generate_ptrs(chunk_data.size(), data, present, ptrs);
     std::cout<<" == chunk_data_size == " << chunk_data.size() << std::endl;
     // present[chunk_rec_pos] = true;
@@ -1126,7 +1091,7 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
     // {
     //     ptrs[chunk_rec_pos][j] = chunk_rec_data[j];
     // }
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         present[i] = false;
     }
@@ -1160,15 +1125,15 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
     }
     // 此时跟踪的是横坐标，即groupid
     present[group_id] = false;
-    for(int i = 0 ; i<ec_k+ec_m; i++){
+    for(int i = 0 ; i<ec_policy.k+ec_policy.m; i++){
         std::cout<<"Chunk No."<<i<<" = "<<ptrs[i]<<std::endl;
     }
     // std::cout << "get chunk and prepare decoding time = " << GetTime() -
     // starttime << std::endl;
     start_time = GetTime();
 
-    erasure_encoder_parameters params = {ec_k + ec_m, ec_k, chunk_data.size()};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
+    erasure_encoder_parameters params = {ec_policy.k + ec_policy.m, ec_policy.k, chunk_data.size()};
+    erasure_encoder* encoder = erasure_create_encoder(&params, ec_policy.codec);
     erasure_recover(encoder, ptrs, present);
     uint8_t* tmp_data = new uint8_t[chunk_data.size()];
     for (int i = 0; i < chunk_data.size(); i++)
@@ -1179,7 +1144,7 @@ std::string Eurasure::decode_2D_columns(unsigned int coding_epoch, std::string k
     std::string strs(tmp_data, tmp_data + chunk_data.size());
 
     erasure_destroy_encoder(encoder);
-    delete present;
+    delete[] present;
     double end_time = GetTime();
     // std::cout << end_time - start_time << std::endl;
     return strs;
@@ -1229,7 +1194,10 @@ void Eurasure::readChunkFromDB(
     {
         std::string db_key = GetChunkDataKey(block_number, group_num, pos);
         std::string db_value;
-        ec_db->Get(ReadOptions(), db_key, &db_value);
+        if (ec_chunk_store)
+            db_value = ec_chunk_store->lookup(sha3(db_key));
+        else
+            ec_db->Get(ReadOptions(), db_key, &db_value);
         if (db_value.length() == 0)
         {
             std::cout << "db_key = " << db_key << std::endl;
@@ -1505,7 +1473,7 @@ std::string Eurasure::constructMerkleRoot(
 {
     std::vector<string> v;
     // readChunkFromDB(block_number, group_num, pos, v);
-    for (int i = 0; i < group_num; i += ec_k * number_of_vc_in_one_chunk)
+    for (int i = 0; i < group_num; i += ec_policy.k * number_of_vc_in_one_chunk)
     {
         // if (i == 8 && pos == 4)
         // {
@@ -1568,7 +1536,7 @@ void Eurasure::makeMerkleRoot(int block_number, std::map<int, std::map<int, std:
     int group_num = group_len;
     // int data_len = 109;
     // std::cout << "start make merkle root" << std::endl;
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         std::string root = constructMerkleRoot(i, group_num, block_number, data);
         string mid = "-";
@@ -1585,7 +1553,7 @@ void Eurasure::makeMerkleTree(int block_number, std::map<int, std::map<int, std:
 {
     std::vector<string> v;
     // readChunkFromDB(block_number, group_num, pos, v);
-    for (int i = 0; i < ec_k + ec_m; i++)
+    for (int i = 0; i < ec_policy.k + ec_policy.m; i++)
     {
         // if (i == 8 && pos == 4)
         // {
@@ -1682,7 +1650,7 @@ void Eurasure::makeMerkleTree(int block_number, std::map<int, std::map<int, std:
     }
     // 通过Vo验证区块的完整性和正确性
     double starttime_verify = GetTime();
-    verifyChunkMerkleRoot(vo, block_number, 0, (pos-1)* ec_k);
+    verifyChunkMerkleRoot(vo, block_number, 0, (pos-1)* ec_policy.k);
     double endtime_verify = GetTime();
     std::cout<<"verifyChunkMerkleRoot cost time = "<< endtime_verify - starttime_verify << std::endl;
     // std::cout << "constructMerkleRoot = " << new_merkle[0] << std::endl;
@@ -1877,13 +1845,15 @@ std::string Eurasure::remoteReadState(
 {
     // std::cout << "remote read" << std::endl;
     double starttime = GetTime();
-    ec_eurasure_p2p->requestState(block_num, key, target_nodeid);
-    std::string str = std::to_string(block_num).append(key);
-    while (ec_eurasure_p2p->state_map.count(str) == 0)
+    std::string state_data;
+    try
+    {
+        state_data = ec_eurasure_p2p->fetchState(block_num, key, target_nodeid).get();
+    }
+    catch (std::exception const& e)
     {
-        sleep(0.0001);
+        std::cout << "remoteReadState block " << block_num << " failed: " << e.what() << std::endl;
     }
-    std::string state_data = ec_eurasure_p2p->state_map[str];
     // std::cout << "state_data = " << state_data << std::endl;
     // std::pair<std::string, std::string> data = getKVAndProof(state_data,
     // key); if (checkState(key, data.first, data.second))
@@ -1922,14 +1892,14 @@ std::string Eurasure::getState(unsigned int block_num, std::string key)
         // std::set<int> state_in_which_nodes;
         // int quotient[2] = {0, 1};
 
-        // for (int i = 0; i < ec_c; i++)
+        // for (int i = 0; i < ec_policy.c; i++)
         // {
         //     for (int j = 0; j < 2; j++)
         //     {
-        //         int res = (ec_k + ec_m) * quotient[j] + chunk_pos -
+        //         int res = (ec_policy.k + ec_policy.m) * quotient[j] + chunk_pos -
         //         chunk_set[i]; if (res < 0)
         //         {
-        //             res += (ec_k + ec_m);
+        //             res += (ec_policy.k + ec_policy.m);
         //         }
         //         state_in_which_nodes.insert(res);
         //     }
@@ -1968,18 +1938,22 @@ void Eurasure::readChunk(
     int res = chunk_set[chunk_pos];
     if (res < 0)
     {
-        res += (ec_k + ec_m);
+        res += (ec_policy.k + ec_policy.m);
     }
     // 2021-11-7
     if (ec_nodeid != ec_sealers[res])
     {
-        ec_eurasure_p2p->requestChunk(coding_epoch, group_id, chunk_pos, ec_sealers[res]);
-        while (ec_eurasure_p2p->chunk_data_map.find(GetChunkDataKey(
-                   coding_epoch, group_id, chunk_pos)) == ec_eurasure_p2p->chunk_data_map.end())
-            sleep(0.1);
-        auto read_acc = ec_eurasure_p2p->chunk_data_map.find(
-            GetChunkDataKey(coding_epoch, group_id, chunk_pos));
-        out = read_acc->second;
+        try
+        {
+            out = ec_eurasure_p2p->fetchChunk(coding_epoch, group_id, chunk_pos, ec_sealers[res])
+                      .get();
+        }
+        catch (std::exception const& e)
+        {
+            std::cout << "read chunk " << GetChunkDataKey(coding_epoch, group_id, chunk_pos)
+                      << " failed: " << e.what() << std::endl;
+            out.clear();
+        }
     }
     else
     {
@@ -2743,36 +2717,60 @@ void Eurasure::makeECFromKV(int block_number, int _kv_number)
     std::cout << "finish EC from KV.txt " << std::endl;
 }
 
-std::unordered_map<h256, std::string> Eurasure::makeECFromMPT(int block_number, BMT& bmt, int fault_tolerance, int encoding_level)
+namespace
+{
+// 一个祖先节点对应的编码任务：该节点下的叶子（数据块，即 bmt.leaves 中的区间）与本层的校验块个数
+struct AncestorGroup
+{
+    std::shared_ptr<Node> node;
+    std::vector<bytesConstRef> leaves;
+    int64_t m;
+    std::unordered_map<h256, std::string> encoded_data;
+};
+
+// 各编码任务并行执行，日志文件的写入需要串行
+std::mutex x_encodingLog;
+}  // namespace
+
+std::unordered_map<h256, std::string> Eurasure::makeECFromMPT(int block_number, BMT& bmt, CodingPolicy const& policy)
 {
     std::cout<< "Block Number : " << block_number << std::endl;
 
+    // 0. 可选：编码前逐个压缩 chunk（帧格式见 frameChunk），校验块随之变小
+    std::vector<bytes> framed;
+    if(policy.compress){
+        framed.resize(bmt.leaves.size());
+        tbb::parallel_for(size_t(0), framed.size(), [&](size_t i){
+            framed[i] = frameChunk(bmt.leafData(i), true);
+        });
+    }
+
+    // 1. 按层收集所有需要编码的祖先节点。奇数情况下同一个节点会在多个父节点下重复出现，
+    //    只在第一次遇到时（即最上层）编码，与原先 p 非空即跳过的逻辑一致
+    std::vector<AncestorGroup> groups;
+    std::unordered_set<Node*> visited;
     std::vector<std::shared_ptr<Node>> currentLevel;
     currentLevel.push_back(bmt.bmt_root);
-    int level = fault_tolerance;
-    std::unordered_map<h256, std::string> totalEncodedData;
+    int level = policy.m;
     bool first_time = true;
 
     while(level){
         std::vector<std::shared_ptr<Node>> nextLevel;
         for(auto& currentNode: currentLevel){
-            // ancestors_leaves 多半是有重复的（奇数情况） 所以当遍历到重复的祖先 则其已经有校验块[p->不为空]
-            if(bmt.ancestors_leaves.count(currentNode->_hash) && currentNode->p.empty()){
-                auto leaves = bmt.ancestors_leaves[currentNode->_hash];
-                auto trans_leaves = std::vector<std::pair<dev::h256, std::string>>();
-                auto cnt = 0;
-                for(const auto& leaf: leaves){
-                    // leaf 为 状态存储时候的 key(h256), 此时根据 key 在 state_cache 中寻找对应的 value(string)
-                    if(std::find(trans_leaves.begin(), trans_leaves.end(), make_pair(leaf, bmt.state_cache[leaf])) == trans_leaves.end()){
-                        trans_leaves.push_back(std::make_pair(leaf, bmt.state_cache[leaf]));
-                        cnt++;
-                    }
+            if(!visited.insert(currentNode.get()).second){
+                continue;
+            }
+            bool ancestor = currentNode->left_child || currentNode->right_child;
+            if(ancestor && currentNode->p.empty()){
+                AncestorGroup group;
+                group.node = currentNode;
+                group.m = level; // 原为校验块的数量，现为每一层校验块的数量
+                // 子树的叶子是 bmt.leaves 中的一段连续区间，只引用 state_cache 中的 chunk 数据
+                group.leaves.reserve(currentNode->_end - currentNode->_begin);
+                for(auto i = currentNode->_begin; i < currentNode->_end; i++){
+                    group.leaves.push_back(framed.empty() ? bmt.leafData(i) : bytesConstRef(&framed[i]));
                 }
-                ec_k = cnt; // 原为数据块的个数，现为状态数量的个数
-                ec_m = level; // 原为校验块的数量，现为每一层校验块的数量
-                auto encoded_data = saveChunkFromMPT(trans_leaves, bmt, currentNode);
-                totalEncodedData.insert(encoded_data.begin(), encoded_data.end());
-                // std::cout<<"These leaves EC Finish: "<< leaves << std::endl;
+                groups.push_back(std::move(group));
             }
             else{
                 std::cout<<"Error Hash."<< std::endl;
@@ -2783,138 +2781,247 @@ std::unordered_map<h256, std::string> Eurasure::makeECFromMPT(int block_number,
         }
         currentLevel = nextLevel;
         if(first_time){
-            level = min(encoding_level - 1, bmt.l - 1);
+            level = min(policy.levels - 1, bmt.l - 1);
             first_time = false;
         }
         else{
             level--;
         }
     }
-    setCompleteCodingEpoch(block_number);
+
+    // 2. 各组互不依赖（只写各自祖先节点的 p），同层与跨层的组一起并行编码
+    //    所有组的临时缓冲区都从本区块的 arena 中分配，校验块拷贝出来后一次性释放
+    auto t1 = std::chrono::steady_clock::now();
+    EncodingArena arena;
+    tbb::task_group tasks;
+    for(auto& group: groups){
+        AncestorGroup* g = &group;
+        tasks.run([this, g, &bmt, &policy, &arena](){
+            // k 原为数据块的个数，现为状态数量的个数
+            g->encoded_data = saveChunkFromMPT(g->leaves, bmt, g->node, policy.withGroup(g->leaves.size(), g->m), arena);
+        });
+    }
+    tasks.wait();
+    auto arena_size = arena.capacity();
+    arena.release();
+
+    std::unordered_map<h256, std::string> totalEncodedData;
+    for(auto& group: groups){
+        totalEncodedData.insert(group.encoded_data.begin(), group.encoded_data.end());
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    auto encoding_time = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0;
+    writeToLog("Encoding " + dev::toString(groups.size()) + " groups in parallel, costing "
+        + dev::toString(encoding_time) + "ms, arena " + printMemorySize(arena_size), "output_log.txt");
+
+    // 编码轮次在 chunk 与校验块持久化之后才推进（见 MPTState::persistStage），否则排队的请求会读到尚未写入的 chunk
     std::cout << "Finish EC From MPT " << std::endl;
     return totalEncodedData;
 }
 
+bytes Eurasure::frameChunk(bytesConstRef chunk, bool compress)
+{
+    bytes payload;
+    uint8_t mode = 0;
+    if(compress && chunk.size()){
+        dev::compress::SnappyCompress::compress(chunk, payload);
+        // 压缩后没有变小则保留原文
+        if(payload.size() && payload.size() < chunk.size()){
+            mode = 1;
+        }
+    }
+    if(mode == 0){
+        payload.assign(chunk.begin(), chunk.end());
+    }
+    bytes frame(5 + payload.size());
+    frame[0] = mode;
+    uint32_t len = payload.size();
+    for(int i = 0; i < 4; i++){
+        frame[1 + i] = (len >> (8 * i)) & 0xFF;
+    }
+    memcpy(frame.data() + 5, payload.data(), payload.size());
+    return frame;
+}
+
+std::string Eurasure::unframeChunk(std::string const& frame)
+{
+    // 解码结果去掉了末尾的 0，连帧头都可能被截短（全 0 的原文 chunk、长度的高字节为 0），先补齐帧头
+    std::string header = frame.substr(0, 5);
+    header.resize(5, '\0');
+    uint32_t len = 0;
+    for(int i = 0; i < 4; i++){
+        len |= (uint32_t)(uint8_t)header[1 + i] << (8 * i);
+    }
+    // 负载同样按帧头记录的长度补齐
+    std::string payload = frame.size() > 5 ? frame.substr(5) : std::string();
+    payload.resize(len, '\0');
+    if(frame[0] == 0){
+        return payload;
+    }
+    bytes raw;
+    dev::compress::SnappyCompress::uncompress(bytesConstRef(&payload), raw);
+    return std::string(raw.begin(), raw.end());
+}
+
 // 将 leaves 中的叶子节点的值进行编码， 并且将校验块信息更新到 bmt 中
-std::unordered_map<h256, std::string> Eurasure::saveChunkFromMPT(std::vector<std::pair<dev::h256, std::string>>& leaves, BMT& bmt, std::shared_ptr<dev::Node>& node)
+// 编码组的策略由调用者传入而不读取 Eurasure 的字段，因此可以对不同祖先节点并行调用
+std::unordered_map<h256, std::string> Eurasure::saveChunkFromMPT(std::vector<bytesConstRef> const& leaves, BMT& bmt, std::shared_ptr<dev::Node>& node, CodingPolicy const& policy, EncodingArena& arena)
 {
     // 创造一些输出日志的参数 包括时间之类的参数
     auto t1 = std::chrono::steady_clock::now();
 
 
-    // 第一个参数是指向ec后的数组的指针，第二个参数是每个数组的长度（其中最大的变量）
-    std::pair<uint8_t**, int64_t> chunks = encodeFromMPT(preprocessFromMPT(leaves));
-
-    // std::cout<<"chunks lengh:"<< chunks.second << std::endl;
-
-    // std::cout << "DECODE STR: " << decodeFromMPT(chunks) << std::endl;
+    auto parity = parityFromMPT(leaves, policy, &arena);
+    size_t parity_size = parity.empty() ? 0 : parity[0].size();
 
     std::unordered_map<h256, std::string> encoded_data;
 
-    for (int count = 0; count < ec_k + ec_m; count++)
+    for (auto& value : parity)
     {
-        // 前面一个是该数据段开始的指针，后面int类型是截取的字符数量
-        string value((const char*)chunks.first[count], chunks.second);
-        // std::cout << "Chunks[" << count << "] = " << value << " Lengh = " << value.size() << std::endl;
-        if (count >= ec_k){
-            // 将校验块的 hash 插入至对应的祖先节点处
-            // cout<<"将校验块的 hash 插入至对应的祖先节点" << node->_hash << "处 " << value.size() << endl;
-            node->p.push_back(dev::sha3(value));
-            encoded_data[dev::sha3(value)] = value;
-        }
+        // 将校验块的 hash 插入至对应的祖先节点处
+        // cout<<"将校验块的 hash 插入至对应的祖先节点" << node->_hash << "处 " << value.size() << endl;
+        auto parity_hash = dev::sha3(value);
+        node->p.push_back(parity_hash);
+        encoded_data[parity_hash] = std::move(value);
     }
-    cout << "Parity chunks: " << ec_m << endl;
 
     // 计算耗时，并输出日志
     auto t2 = std::chrono::steady_clock::now();
     auto encoding_time = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0;
-    auto logStr = "Encoding " + dev::toString(ec_k) + "DC and " + dev::toString(ec_m) + " PC, each " 
-        + printMemorySize(chunks.second) + ", costing " + dev::toString(encoding_time) + "ms";
-    writeToLog(logStr,"output_log.txt");
+    auto logStr = "Encoding " + dev::toString(policy.k) + "DC and " + dev::toString(policy.m) + " PC, each " 
+        + printMemorySize(parity_size) + ", costing " + dev::toString(encoding_time) + "ms";
+    {
+        std::lock_guard<std::mutex> l(x_encodingLog);
+        writeToLog(logStr,"output_log.txt");
+    }
 
     return encoded_data;
     // writeDB(coding_epoch, groupid, chunks);
 }
 
-// 将传入的states转入processed-data，及对应论文中将数据化为等长的数据块
-size_t Eurasure::maxLenFromMPT(const std::vector<std::pair<dev::h256, std::string>>& leaves, std::vector<std::string>& processed_data)
+// 计算一个编码组的 m 个校验块，不修改 BMT
+// arena 为空时使用本次调用的临时 arena
+std::vector<std::string> Eurasure::parityFromMPT(std::vector<bytesConstRef> const& leaves, CodingPolicy const& policy, EncodingArena* arena)
+{
+    EncodingArena local;
+    auto& a = arena ? *arena : local;
+    // 第一个参数是指向ec后的数组的指针，第二个参数是每个数组的长度（其中最大的变量）
+    std::pair<uint8_t**, int64_t> chunks = encodeFromMPT(preprocessFromMPT(leaves, policy, a), policy, a);
+
+    std::vector<std::string> parity;
+    for (int count = policy.k; count < policy.k + policy.m; count++)
+    {
+        // 前面一个是该数据段开始的指针，后面int类型是截取的字符数量
+        parity.push_back(string((const char*)chunks.first[count], chunks.second));
+    }
+    return parity;
+}
+
+// 用同组的数据块（缺失的为空串）与校验块恢复第 lost 个数据块；编码前压缩过 chunk 时负责帧的转换
+std::string Eurasure::recoverFromMPT(std::vector<std::string> data, std::vector<std::string> const& parity, size_t lost, CodingPolicy const& policy)
 {
-    for(const auto& leaf : leaves){
-        // h256 是 first, string 是 second
-        // auto tmp = dev::toString(leaf.first);
-        // std::cout << "Size Of H256: " << tmp.size() << std::endl;
-        // tmp.append(leaf.second);
-        processed_data.push_back(leaf.second);
+    if(policy.compress){
+        for(auto& d : data){
+            if(!d.empty()){
+                auto frame = frameChunk(bytesConstRef(&d), true);
+                d.assign(frame.begin(), frame.end());
+            }
+        }
     }
+    auto group = policy.withGroup(data.size(), parity.size());
+    data.insert(data.end(), parity.begin(), parity.end());
+    auto ret = decodeFromMPT(data, group, lost);
+    return policy.compress ? unframeChunk(ret) : ret;
+}
 
+std::vector<std::string> Eurasure::recoverFromMPT(std::vector<std::string> data, std::vector<std::string> const& parity, std::vector<size_t> const& lost, CodingPolicy const& policy)
+{
+    if(policy.compress){
+        for(auto& d : data){
+            if(!d.empty()){
+                auto frame = frameChunk(bytesConstRef(&d), true);
+                d.assign(frame.begin(), frame.end());
+            }
+        }
+    }
+    auto group = policy.withGroup(data.size(), parity.size());
+    data.insert(data.end(), parity.begin(), parity.end());
+    auto ret = decodeGroupFromMPT(std::move(data), group, std::vector<int>(lost.begin(), lost.end()));
+    if(policy.compress){
+        for(auto& r : ret){
+            r = unframeChunk(r);
+        }
+    }
+    return ret;
+}
+
+// 将传入的states转入processed-data，及对应论文中将数据化为等长的数据块
+size_t Eurasure::maxLenFromMPT(std::vector<bytesConstRef> const& leaves)
+{
     int max_len = -1;
-    for (const auto& data : processed_data)
+    for (const auto& data : leaves)
         max_len = max(max_len, (int)data.size());
     
     return max_len;
 }
 
-std::pair<uint8_t*, int64_t> Eurasure::preprocessFromMPT(std::vector<std::pair<dev::h256, std::string>>& leaves)
+// 各块在 arena 中的起始地址按 64 字节对齐（块间距为 EncodingArena::align(max_len)），编码长度仍为 max_len
+std::pair<uint8_t*, int64_t> Eurasure::preprocessFromMPT(std::vector<bytesConstRef> const& leaves, CodingPolicy const& policy, EncodingArena& arena)
 {
-    std::vector<std::string> processed_data;
-
-    auto max_len = maxLenFromMPT(leaves, processed_data);
-    
-    auto cnt = 0;    
-    for(const auto& d: processed_data){
-        std::cout << "Processed Data[" << cnt++ << "] = " << d.size() << " # " << "dev::RLP(d)" << std::endl;
-    }
+    auto max_len = policy.blockLength(maxLenFromMPT(leaves));
+    auto stride = EncodingArena::align(max_len);
+    auto ec_k = policy.k;
+    auto ec_m = policy.m;
 
-    // 判断需要开多少的内存空间，即总共有多少个块（数据块 + 校验块）
+    // 判断需要开多少的内存空间，即总共有多少个块（数据块 + 校验块），arena 分配的内存已清零
     // int f = 1; // 容错（暂时
     // int chunk_num = int(processed_data.size()) + f;
 
-    uint8_t* data = new uint8_t[max_len * (ec_k + ec_m) * sizeof(uint8_t)]();
-    memset(data, 0, max_len * (ec_k + ec_m) * sizeof(uint8_t));
+    uint8_t* data = arena.allocate<uint8_t>(stride * (ec_k + ec_m));
     
     
     // 将数据预处理
     int64_t count = 0;
-    for (const auto& _data : processed_data){
-        memcpy(data + count, _data.c_str(), _data.size());
+    for (const auto& _data : leaves){
+        memcpy(data + count, _data.data(), _data.size());
         // std::cout<<"The str lengh is: "<< strlen(reinterpret_cast<char*>(data + count)) << std::endl;
-        count += max_len;
+        count += stride;
     }
 
     return make_pair(data, max_len);
 }
 
-std::pair<uint8_t**, int64_t> Eurasure::encodeFromMPT(std::pair<uint8_t*, int64_t> blocks_rlp_data)
+std::pair<uint8_t**, int64_t> Eurasure::encodeFromMPT(std::pair<uint8_t*, int64_t> blocks_rlp_data, CodingPolicy const& policy, EncodingArena& arena)
 {
+    auto ec_k = policy.k;
+    auto ec_m = policy.m;
     int64_t length = blocks_rlp_data.second;
-    uint8_t** ptrs = new uint8_t*[ec_k + ec_m];
-    erasure_bool* present = new erasure_bool[ec_k + ec_m];
-    generate_ptrs(length, blocks_rlp_data.first, present, ptrs);
+    uint8_t** ptrs = arena.allocate<uint8_t*>(ec_k + ec_m);
+    erasure_bool* present = arena.allocate<erasure_bool>(ec_k + ec_m);
+    generatePtrsWithPara(EncodingArena::align(length), blocks_rlp_data.first, present, ptrs, ec_k, ec_m);
 
     erasure_encoder_parameters params = {ec_k + ec_m, ec_k, length};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
+    erasure_encoder* encoder = erasure_create_encoder(&params, policy.codec);
     erasure_encode(encoder, ptrs, ptrs + ec_k);
 
     erasure_destroy_encoder(encoder);
-    delete present;
     return std::make_pair(ptrs, length);
 }
 
 std::string Eurasure::decodeFromMPT(std::pair<uint8_t**, int64_t> test_data)
 {
+    EncodingArena arena;
     // double start_time = GetTime();
-    erasure_bool* present = new erasure_bool[ec_k + ec_m];
+    erasure_bool* present = arena.allocate<erasure_bool>(ec_policy.k + ec_policy.m);
 
     // auto lengh = strlen(reinterpret_cast<char*>(test_data.first[0]));
     auto lengh = test_data.second;
 
     // std::cout<<"decode lengh :"<<lengh<<std::endl;
 
-    uint8_t** ptrs = new uint8_t*[ec_k + ec_m];
+    uint8_t** ptrs = arena.allocate<uint8_t*>(ec_policy.k + ec_policy.m);
 
-    memset(present, false, (ec_k + ec_m) * sizeof(erasure_bool));
-    uint8_t* data = new uint8_t[(ec_k + ec_m) * lengh];
-    memset(data, 0, (ec_k + ec_m) * lengh * sizeof(uint8_t));
+    uint8_t* data = arena.allocate<uint8_t>((ec_policy.k + ec_policy.m) * lengh);
     generate_ptrs(lengh, data, present, ptrs);
     // 把它全部扭成负数了，即初始化假设所有的空都没有
     for (int i = 0; i < 1; i++)
@@ -2922,57 +3029,68 @@ std::string Eurasure::decodeFromMPT(std::pair<uint8_t**, int64_t> test_data)
         present[i] = false;
     }
 
-    for(int i=0; i<ec_k+ec_m; i++){
+    for(int i=0; i<ec_policy.k+ec_policy.m; i++){
         memcpy(ptrs[i], test_data.first[i], lengh);
     }
 
-    erasure_encoder_parameters params = {ec_k + ec_m, ec_k, lengh};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
+    erasure_encoder_parameters params = {ec_policy.k + ec_policy.m, ec_policy.k, lengh};
+    erasure_encoder* encoder = erasure_create_encoder(&params, ec_policy.codec);
     erasure_recover(encoder, ptrs, present);
 
-    for (int count = 0; count < ec_k + ec_m; count++)
+    for (int count = 0; count < ec_policy.k + ec_policy.m; count++)
     {
         // 前面一个是该数据段开始的指针，后面int类型是截取的字符数量
         string value((const char*)ptrs[count], lengh);
         // std::cout << "Decode::Chunks[" << count << "] = " << value << std::endl;    
     }
 
-    uint8_t* tmp_data = new uint8_t[lengh];
-    for (int i = 0; i < lengh; i++)
-    {
-        // 恢复以后一个字符一个字符往Tmpdata里面加啊……
-        tmp_data[i] = ptrs[0][i];
-    }
-
-    std::string strs(tmp_data, tmp_data + lengh);
+    std::string strs((const char*)ptrs[0], lengh);
     erasure_destroy_encoder(encoder);
-    delete present;
     return strs;
 }
 
-std::string Eurasure::decodeFromMPT(std::vector<std::string> raw_data, int p_number, int lost_node)
+std::string Eurasure::decodeFromMPT(std::vector<std::string> raw_data, int p_number, int lost_node, size_t range_len)
 {
-    
+    auto policy = ec_policy.withGroup(raw_data.size() - p_number, p_number);
+    return decodeFromMPT(std::move(raw_data), policy, lost_node, range_len);
+}
+
+// policy.m 为 raw_data 末尾校验块的个数，其余为数据块
+std::string Eurasure::decodeFromMPT(std::vector<std::string> raw_data, CodingPolicy const& policy, int lost_node, size_t range_len)
+{
+    return decodeGroupFromMPT(std::move(raw_data), policy, std::vector<int>(1, lost_node), range_len)[0];
+}
+
+// 只做一次 erasure_recover，依次取出 lost_nodes 中的各个数据块；位置不是数据块的返回空串
+std::vector<std::string> Eurasure::decodeGroupFromMPT(std::vector<std::string> raw_data, CodingPolicy const& policy, std::vector<int> const& lost_nodes, size_t range_len)
+{
+    int p_number = policy.m;
+
     auto _num = raw_data.size();
     // double start_time = GetTime();
-    erasure_bool* present = new erasure_bool[_num];
+    EncodingArena arena;
+    erasure_bool* present = arena.allocate<erasure_bool>(_num);
 
     // 通过记录每个字符串的长度来判断截取几个区间出来，这明显不是一个好方法
     // 因为缺失的状态不会给你具体的数值
-    auto lengh = raw_data.back().size();
+    // 区间切片在 chunk 末尾处可能被截断，统一按 range_len 补 0（编码时短的数据块同样以 0 补齐）
+    // 整块解码时块长取收到的校验块的长度（各校验块等长，只收到部分 chunk 时最后一个可能为空）
+    size_t lengh = range_len;
+    for(size_t i = _num - p_number; i < _num && !lengh; i++){
+        lengh = raw_data[i].size();
+    }
     std::vector<int> str_lengh;
     for(const auto& str: raw_data){
-        str_lengh.push_back(str.size());
+        str_lengh.push_back(std::min(str.size(), lengh));
     }
 
     // std::cout<<"decode lengh :"<< lengh << ", decode number :" << _num <<std::endl;
 
-    uint8_t** ptrs = new uint8_t*[_num];
+    uint8_t** ptrs = arena.allocate<uint8_t*>(_num);
 
-    memset(present, false, (_num) * sizeof(erasure_bool));
-    uint8_t* data = new uint8_t[_num * lengh];
-    memset(data, 0, _num * lengh * sizeof(uint8_t));
-    generatePtrsWithPara(lengh, data, present, ptrs, _num - p_number, p_number);
+    auto stride = EncodingArena::align(lengh);
+    uint8_t* data = arena.allocate<uint8_t>(_num * stride);
+    generatePtrsWithPara(stride, data, present, ptrs, _num - p_number, p_number);
 
 
     for(int i = 0; i < _num; i++){
@@ -2984,32 +3102,30 @@ std::string Eurasure::decodeFromMPT(std::vector<std::string> raw_data, int p_num
     }
 
     erasure_encoder_parameters params = {_num, _num - p_number, lengh};
-    erasure_encoder* encoder = erasure_create_encoder(&params, ec_mode);
+    erasure_encoder* encoder = erasure_create_encoder(&params, policy.codec);
     erasure_recover(encoder, ptrs, present);
+    erasure_destroy_encoder(encoder);
 
-    for (int count = 0; count < _num; count++)
-    {
-        // 前面一个是该数据段开始的指针，后面int类型是截取的字符数量
-        // string value((const char*)ptrs[count], str_lengh[count]);
-        if(count < _num - p_number){
-
-            const char* c_str = (char*)ptrs[count];
-            for(int i = lengh - 1; i >= 0; i--){
-                if(c_str[i] != '\0'){
-                    // std::cout << " L = " << i + 1 << std::endl;
-                    str_lengh[count] = i + 1;
-                    break;
-                }
+    // 只有丢失的数据块需要取出，去掉末尾补的 0
+    std::vector<std::string> ret;
+    for(auto lost_node : lost_nodes){
+        ret.push_back(std::string());
+        if(lost_node < 0 || lost_node >= (int)(_num - p_number)){
+            continue;
+        }
+        const char* c_str = (char*)ptrs[lost_node];
+        if(range_len){
+            ret.back().assign(c_str, lengh);
+            continue;
+        }
+        str_lengh[lost_node] = 0;
+        for(int i = lengh - 1; i >= 0; i--){
+            if(c_str[i] != '\0'){
+                str_lengh[lost_node] = i + 1;
+                break;
             }
-            string value((const char*)ptrs[count], str_lengh[count]);
-            // std::cout << "Decode::Data_Chunks[" << count << "] = " << str_lengh[count] << ":" << "RLP(value)" << std::endl; 
-            if(count == lost_node)
-                return value;
         }
-        else{
-            string value((const char*)ptrs[count], str_lengh[count]);
-            // std::cout << "Decode::Coded_Chunks[" << count << "] = " << "value" << std::endl;
-        }   
+        ret.back().assign(c_str, str_lengh[lost_node]);
     }
 
     // uint8_t* tmp_data = new uint8_t[lengh];
@@ -3023,7 +3139,7 @@ std::string Eurasure::decodeFromMPT(std::vector<std::string> raw_data, int p_num
     // erasure_destroy_encoder(encoder);
     // delete present;
     // return strs;
-    return "";
+    return ret;
 }
 
 bool Eurasure::writeDBFromMPT(
@@ -3032,13 +3148,13 @@ bool Eurasure::writeDBFromMPT(
     // qqf 算出各个节点存储那几个块，随机分配
     int* chunk_set = get_distinct_chunk_set(coding_epoch);
     // std::cout << "chunk set :" << std::endl;
-    // for(int i = 0; i < ec_k + 2*ec_m; i++) {
+    // for(int i = 0; i < ec_policy.k + 2*ec_policy.m; i++) {
     //     std::cout << chunk_set[i] << " ";
     // }
     // std::cout << endl;
     int count = 0;
     // std::cout << string((const char*)chunk.first[0], chunk.second).size() / 1024.0 << std::endl;
-    // for (count = 0; count < ec_k + ec_m; count++)
+    // for (count = 0; count < ec_policy.k + ec_policy.m; count++)
     // {
     //     // 2021-11-7
     //     if (chunk_set[count] == ec_position_in_sealers)
@@ -3068,18 +3184,22 @@ void Eurasure::readChunkFromMPT(unsigned int coding_epoch, unsigned group_id, un
     int res = chunk_set[chunk_pos];
     if (res < 0)
     {
-        res += (ec_k + ec_m);
+        res += (ec_policy.k + ec_policy.m);
     }
     // 2021-11-7
     if (ec_nodeid != ec_sealers[res])
     {
-        ec_eurasure_p2p->requestChunk(coding_epoch, group_id, chunk_pos, ec_sealers[res]);
-        while (ec_eurasure_p2p->chunk_data_map.find(GetChunkDataKey(
-                   coding_epoch, group_id, chunk_pos)) == ec_eurasure_p2p->chunk_data_map.end())
-            sleep(0.1);
-        auto read_acc = ec_eurasure_p2p->chunk_data_map.find(
-            GetChunkDataKey(coding_epoch, group_id, chunk_pos));
-        out = read_acc->second;
+        try
+        {
+            out = ec_eurasure_p2p->fetchChunk(coding_epoch, group_id, chunk_pos, ec_sealers[res])
+                      .get();
+        }
+        catch (std::exception const& e)
+        {
+            std::cout << "read chunk " << GetChunkDataKey(coding_epoch, group_id, chunk_pos)
+                      << " failed: " << e.what() << std::endl;
+            out.clear();
+        }
     }
     else
     {
@@ -18,12 +18,20 @@
 #include "rocksdb/db.h"
 #include "rocksdb/options.h"
 #include "rocksdb/slice.h"
+#include "rocksdb/write_batch.h"
 #include "BMT.h"
+#include "CodingPolicy.h"
+#include "EncodingArena.h"
 
 #define BLOCKS_SIZE_BYTE 3 //默认记录区块大小的字节数
 #define blockchainManager std::shared_ptr<dev::blockchain::BlockChainInterface>
 #define StatePoint std::pair<std::string, std::string>
 #define NodeAddr dev::h512
+namespace dev {
+namespace mptstate {
+class ChunkStore;
+}
+}
 namespace ec {
 class EurasureP2P;
 
@@ -36,13 +44,14 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
         std::vector<NodeAddr> sealers, std::string path,
         ec::EurasureP2P *eurasure_p2p, int _group_size,
         std::shared_ptr<dev::blockchain::BlockChainInterface> _blockmanager)
-        : ec_k(k), ec_m(m), ec_c(c), ec_nodeid(nodeid), ec_sealers(sealers),
+        : ec_policy(k, m, c), ec_nodeid(nodeid), ec_sealers(sealers),
           ec_DBPath(path), ec_eurasure_p2p(eurasure_p2p),
           group_len(_group_size), ec_blockchain(_blockmanager) {}
 
     Eurasure(){
       // 测试
     }
+    explicit Eurasure(CodingPolicy const& policy) : ec_policy(policy) {}
     //初始化EC模块
     bool InitEurasure();
 
@@ -167,13 +176,29 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
     * @author qqf
     * @date 2024/10/30
     */
-    std::unordered_map<dev::h256, std::string> makeECFromMPT(int block_number, dev::BMT& bmt, int fault_tolerance, int encoding_level);
-    std::unordered_map<dev::h256, std::string> saveChunkFromMPT(std::vector<std::pair<dev::h256, std::string>>& leaves, dev::BMT& bmt, std::shared_ptr<dev::Node>& node);
-    std::pair<uint8_t *, int64_t> preprocessFromMPT(std::vector<std::pair<dev::h256, std::string>>& leaves);
-    size_t maxLenFromMPT(const std::vector<std::pair<dev::h256, std::string>>& leaves, std::vector<std::string>& processed_data);
-    std::pair<uint8_t **, int64_t> encodeFromMPT(std::pair<uint8_t *, int64_t> blocks_rlp_data);
+    // policy.m 为最上层编码组的校验块个数（容错个数），policy.levels 为编码层数
+    std::unordered_map<dev::h256, std::string> makeECFromMPT(int block_number, dev::BMT& bmt, CodingPolicy const& policy);
+    // policy 为本编码组的策略（k 个数据块，m 个校验块），按调用传入，不读取 Eurasure 的字段
+    // leaves 引用 BMT 中的 chunk 数据，编码期间 BMT 不能修改
+    // 临时缓冲区从 arena 中分配，由调用者统一释放
+    std::unordered_map<dev::h256, std::string> saveChunkFromMPT(std::vector<dev::bytesConstRef> const& leaves, dev::BMT& bmt, std::shared_ptr<dev::Node>& node, CodingPolicy const& policy, EncodingArena& arena);
+    std::pair<uint8_t *, int64_t> preprocessFromMPT(std::vector<dev::bytesConstRef> const& leaves, CodingPolicy const& policy, EncodingArena& arena);
+    size_t maxLenFromMPT(std::vector<dev::bytesConstRef> const& leaves);
+    std::pair<uint8_t **, int64_t> encodeFromMPT(std::pair<uint8_t *, int64_t> blocks_rlp_data, CodingPolicy const& policy, EncodingArena& arena);
+    // 参与编码的 chunk 帧：[1 字节模式(0 原文, 1 snappy)][4 字节负载长度(小端)][负载]
+    // 开启压缩时数据块以该形式参与编解码，恢复出的帧用 unframeChunk 还原
+    static dev::bytes frameChunk(dev::bytesConstRef chunk, bool compress);
+    std::vector<std::string> parityFromMPT(std::vector<dev::bytesConstRef> const& leaves, CodingPolicy const& policy, EncodingArena* arena = nullptr);
+    std::string recoverFromMPT(std::vector<std::string> data, std::vector<std::string> const& parity, size_t lost, CodingPolicy const& policy);
+    // 一次解码恢复同组中的多个数据块，返回值与 lost 一一对应
+    std::vector<std::string> recoverFromMPT(std::vector<std::string> data, std::vector<std::string> const& parity, std::vector<size_t> const& lost, CodingPolicy const& policy);
+    static std::string unframeChunk(std::string const& frame);
     std::string decodeFromMPT(std::pair<uint8_t**, int64_t> test_data);
-    std::string decodeFromMPT(std::vector<std::string>, int p_number, int lost_node = -1);
+    // range_len 非 0 时 raw_data 为各 chunk 同一字节区间的切片，块长取 range_len，
+    // 返回丢失块在该区间内的完整切片（不去掉末尾的 0）
+    std::string decodeFromMPT(std::vector<std::string>, int p_number, int lost_node = -1, size_t range_len = 0);
+    std::string decodeFromMPT(std::vector<std::string>, CodingPolicy const& policy, int lost_node = -1, size_t range_len = 0);
+    std::vector<std::string> decodeGroupFromMPT(std::vector<std::string> raw_data, CodingPolicy const& policy, std::vector<int> const& lost_nodes, size_t range_len = 0);
     bool writeDBFromMPT(unsigned int coding_epoch, std::pair<uint8_t **, int64_t> const &chunks);
     void generatePtrsWithPara(size_t data_size, uint8_t* data, erasure_bool* present, uint8_t** ptrs, int k, int m);
     void readChunkFromMPT(unsigned int coding_epoch, unsigned group_id, unsigned chunk_pos, std::string &out);
@@ -184,14 +209,13 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
     void statistic();
     int64_t findSeqInSealers();
     void getVCCommit(int block_number, int pos, std::string &output);
-    erasure_encoder_flags getecmode(){ return ec_mode; }
+    erasure_encoder_flags getecmode(){ return ec_policy.codec; }
 
-    int64_t getK() { return ec_k; }
-    int64_t getM() { return ec_m; }
-    int64_t getC() { return ec_c; }
-    int64_t setK(int64_t n) { ec_k = n; }
-    int64_t setM(int64_t n) { ec_m = n; }
-    int64_t setC(int64_t n) { ec_c = n; }
+    // 构造时确定，之后不再修改；需要其他参数时复制后按次传入
+    CodingPolicy const& policy() const { return ec_policy; }
+    int64_t getK() { return ec_policy.k; }
+    int64_t getM() { return ec_policy.m; }
+    int64_t getC() { return ec_policy.c; }
     int getCurrentBlockNum() { return ec_current_block_num; }
     void setDBHandler(rocksdb::DB *_db) { ec_db = _db; }
     rocksdb::DB *getDBHandler() { return ec_db; }
@@ -199,7 +223,8 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
     long getStorageSize() { return ec_storage_size; }
     int64_t getCompleteEpoch() { return complete_coding_epoch; }
     int getGroupLen() { return group_len; }
-    void setCompleteCodingEpoch(int epoch) { complete_coding_epoch = epoch; }
+    // 更新已完成的编码轮次，并唤醒网络模块中等待该轮次的 chunk 请求
+    void setCompleteCodingEpoch(int epoch);
     void setCurrentBlockNum(int current_block_num) {
         ec_current_block_num = current_block_num;
     }
@@ -207,6 +232,7 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
     int getInitVCSize() { return init_size; }
     int getNumberOfVCInOneChunk() { return number_of_vc_in_one_chunk; }
     ec::EurasureP2P *getP2PHandle() { return ec_eurasure_p2p; }
+    std::vector<NodeAddr> const &getSealers() const { return ec_sealers; }
     blockchainManager getBlockchain() { return ec_blockchain; }
     void setVCDB(rocksdb::DB *_db) { vc_db = _db; }
     int getRandCount() { return randcount; }
@@ -218,20 +244,21 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
     void mpt_test();
     // qqf 建立MPTState中state与Eurasure的state之间的联系
     void setStateStorage(std::unordered_map<int, dev::StringMap> _state_storage){state_storage = _state_storage; }
+    // 设置后 chunk 的读写走只追加段存储（key 为 sha3(GetChunkDataKey)），不再经过 ec_db
+    void setChunkStore(std::shared_ptr<dev::mptstate::ChunkStore> _store) { ec_chunk_store = _store; }
+    std::shared_ptr<dev::mptstate::ChunkStore> getChunkStore() { return ec_chunk_store; }
+    bool compressChunks() const { return ec_policy.compress; }
   private:
     NodeAddr ec_nodeid;                                     //节点ID
-    erasure_encoder_flags ec_mode = ERASURE_FORCE_ADV_IMPL; // ec编码模式
-    int64_t ec_k;                                           //数据块个数
-    int64_t ec_m;                                           //校验块个数
-    int64_t ec_c;                                           //副本个数
+    const CodingPolicy ec_policy;                           //编码策略（数据块、校验块、副本个数与ec编码模式）
     std::vector<NodeAddr> ec_sealers;                       //所有节点地址
     unsigned int ec_position_in_sealers; //本节点在所有节点中的相对位置
     rocksdb::DB *ec_db = NULL;           // DB句柄
     rocksdb::DB *vc_db;                  // DB句柄
     std::string ec_DBPath;               // DB路径
     long ec_storage_size = 0;            // EC存储开销
-    ec::EurasureP2P *ec_eurasure_p2p;   // EC网络模块句柄
-    int64_t complete_coding_epoch = -1; //已完成ECepoch
+    ec::EurasureP2P *ec_eurasure_p2p = nullptr;   // EC网络模块句柄
+    std::atomic<int64_t> complete_coding_epoch{-1}; //已完成ECepoch
     int ec_current_block_num = 0;
     blockchainManager ec_blockchain; //区块链句柄
     int group_len = 64;
@@ -251,6 +278,7 @@ class Eurasure : public std::enable_shared_from_this<Eurasure> {
     int randcount = 1;
     bf::hasher hashers;
     std::unordered_map<int, dev::StringMap> state_storage;
+    std::shared_ptr<dev::mptstate::ChunkStore> ec_chunk_store;
     
 };
 } // namespace ec
\ No newline at end of file
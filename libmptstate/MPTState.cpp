@@ -24,6 +24,7 @@
  */
 
 #include "MPTState.h"
+#include "EncodingPipeline.h"
 #include <string>
 #include <unordered_map>
 
@@ -255,20 +256,35 @@ void MPTState::makeEC(int block_number, int thread_number)
 /**
 * @brief 针对MPT验证结构和状态数据进行编码
 * 
+* 依次执行流水线的各个阶段（见 EncodingPipeline.h），同步版本。
 * 
 * @param block_number 区块编号
-* @param node_number 节点个数
+* @param config {节点个数, 容错个数, 编码层数[, 划分模式]}，划分模式缺省为 1
 * @return totalEncodedData 本轮中编码的结果（以<h256, string>存储）
-* @return partition_result 本轮状态划分的结果 n行为第n个节点的节点集合，每一列为分配的状态地址
 */
 std::unordered_map<h256, std::string> MPTState::makeECFromMPT(int block_number, std::vector<int> config){
     
-    // 容错设置
-    int node_number = config[0];
-    int fault_tolerance = config[1];
-    int encoding_level = config[2];
-    
     /* 2024/10/23 状态编码*/
+    EncodingJob job(block_number, config);
+    job.mut_map = collectDirtyNodes();
+    job.root = getState().rootHash();
+
+    partitionStage(job);
+    chunkStage(job);
+    bmtStage(job);
+    encodeStage(job);
+    persistStage(job);
+    accountStage(job);
+
+    return job.encoded;
+
+    /* 2024/10/23 状态编码 end */
+}
+
+/**
+* @brief 截取本区块修改过的 MPT 节点（overlay 中引用计数仍为正的部分）
+*/
+std::unordered_map<h256, std::string> MPTState::collectDirtyNodes(){
     auto mut_map = getState().db().get();
     auto mut_set = getState().db().keys();
     for(auto it = mut_map.begin(); it != mut_map.end();){
@@ -279,26 +295,23 @@ std::unordered_map<h256, std::string> MPTState::makeECFromMPT(int block_number,
             ++it;
         }
     }
+    return mut_map;
+}
 
-    auto t1 = std::chrono::steady_clock::now();
-
-    std::cout << " The Map Get From OverlayDB is : \n";
-    versionManager.initDB(getState().db());
-    versionManager.processBatch(mut_map);
-    versionManager.setVersion(block_number);
-    // versionManager.printManager();
-
-    StatePartition sp;
-    
+/**
+* @brief 划分阶段：只读 job，独占 incrementalPartitioner
+*/
+void MPTState::partitionStage(EncodingJob& job){
     auto t2 = std::chrono::steady_clock::now();
 
-    sp.processBatch(mut_map);
+    auto& sp = job.sp;
+    sp.processBatch(job.mut_map);
     // 节点个数 nodes number
-    sp.init(node_number);
-    auto _r = getState().rootHash();
+    sp.init(job.node_number);
+    auto _r = job.root;
     cout << " (0v0)~~MPTRoot : " << _r << endl;
 
-    u_int expression = 1; // which partition mode we choose
+    u_int expression = job.partition_mode; // which partition mode we choose
     switch (expression){
         case 1:
             sp.partitionMPT(_r); // 我们的方法 
@@ -312,19 +325,37 @@ std::unordered_map<h256, std::string> MPTState::makeECFromMPT(int block_number,
         case 4:
             sp.partitionMPTWithLocal(_r); // local read
             break;
+        case 5:
+            incrementalPartitioner.partitionMPT(sp, _r, job.mut_map); // 跨区块保留划分结果，仅放置新节点
+            break;
         default:
             break;
     }
-    versionManager.setStatePartition(sp);
 
     auto t3 = std::chrono::steady_clock::now();
+    job.sp_time = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() / 1000.0;
+}
 
-    ChunkBuilder cb(versionManager);
-    // cb.setDataSet(versionManager.dataSet);
-    
+/**
+* @brief chunk 构建阶段：独占 versionManager（版本差 + 节点存储）
+*/
+void MPTState::chunkStage(EncodingJob& job){
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::cout << " The Map Get From OverlayDB is : \n";
+    versionManager.initDB(getState().db());
+    versionManager.processBatch(job.mut_map);
+    versionManager.setVersion(job.block_number);
+    versionManager.setStatePartition(job.sp);
+    // versionManager.printManager();
+
+    auto t3 = std::chrono::steady_clock::now();
+
+    job.cb.reset(new ChunkBuilder(versionManager));
+    auto& cb = *job.cb;
     // cb.initPartitions(sp.getPartitionMapResult());
-    cb.processBatch(mut_map, versionManager.m_nodeVersions);
-    vector<string> chunksRlt = cb.handleDataSet(sp.getPartitionMapResult(), sp.m_groups);
+    cb.processBatch(job.mut_map);
+    job.chunks = cb.handleDataSet(job.sp.getPartitionMapResult(), job.sp.m_groups);
     
     // vector<string> chunksRlt = cb.handleDataSetWithReadyQueue(sp.m_groups);
         
@@ -332,54 +363,125 @@ std::unordered_map<h256, std::string> MPTState::makeECFromMPT(int block_number,
 
     // 计算以下各个的时间 怎么那么慢
     auto t4 = std::chrono::steady_clock::now();
-    auto VM_time = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0;
-    auto SP_time = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() / 1000.0;
-    auto CB_time = std::chrono::duration_cast<std::chrono::microseconds>(t4 - t3).count() / 1000.0;
-    auto logStr = "VM time: " + dev::toString(VM_time) + "ms. "
-        + "SP time: " + dev::toString(SP_time) + "ms. "
-        + "CB time:" + dev::toString(CB_time);
-    writeToLog(logStr,"time_log.txt");
-
-    // for(const auto& i: mut_map){
-    //     std::cout << " H256: " << i.first << " Value:" << dev::RLP(i.second) << std::endl;
-    // }
+    job.vm_time = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t1).count() / 1000.0;
+    job.cb_time = std::chrono::duration_cast<std::chrono::microseconds>(t4 - t3).count() / 1000.0;
+    writeToLog("Node store: " + dev::toString(versionManager.m_store.size()) + " nodes, "
+        + printMemorySize(versionManager.m_store.memoryUsage()), "ouput_log.txt");
+}
 
+/**
+* @brief BMT 阶段：只读 job.chunks，由 chunk 生成本区块的 BMT
+*/
+void MPTState::bmtStage(EncodingJob& job){
     // auto bmt = BMT(mut_map); // 根据 状态数据 生成树
-    auto bmt = BMT(chunksRlt); // 根据 状态数据集成的chunk 生成树
-    
+    job.bmt = BMT(job.chunks, sizeAwareGroups); // 根据 状态数据集成的chunk 生成树
+}
 
-    // 2. 编码阶段
-    auto totalEncodedData = state_erasure->makeECFromMPT(block_number, bmt, fault_tolerance, encoding_level);
-    BMT_map.emplace(block_number, bmt);
-    
-    cb.StorageForChunks(chunksRlt, totalEncodedData, t_state_size, t_extraInfo_size, t_encoded_size); // 计算存储开销
-    
-    /*
-    // 3. 状态划分 
-    std::vector<h256> data_set;
-    m_state.get_m_state().leftOvers(data_set);
-    std::vector<h256> encoded_set;
-    for(const auto& data: totalEncodedData){
-        encoded_set.push_back(data.first);
+/**
+* @brief 编码阶段：独占 state_erasure 与 BMT_map
+*/
+void MPTState::encodeStage(EncodingJob& job){
+    auto policy = state_erasure->policy().withLevels(job.fault_tolerance, job.encoding_level);
+    job.encoded = state_erasure->makeECFromMPT(job.block_number, job.bmt, policy);
+    BMT_map.emplace(job.block_number, job.bmt);
+}
+
+/**
+* @brief 持久化阶段：一个区块的数据块、校验块追加到 chunkStore，和/或连同 BMT 元数据一次写入 chunkDB
+*
+* 写入后推进编码轮次；返回 false 时由调用者把编码块写入 OverlayDB 后再调用 setCompleteCodingEpoch。
+*/
+bool MPTState::persistStage(EncodingJob& job){
+    bool store = chunkStore && chunkStore->isOpen();
+    bool db = chunkDB && chunkDB->isOpen();
+    if(!store && !db){
+        return false;
     }
-    // 节点数量
-    // int node_number = 3;
-    auto partition_result = partitionElements(data_set, encoded_set, node_number);
-    // 测试是怎么划分的
-    auto node_index = 0;
-    for(const auto& i : partition_result){
-        // std::cout << "[";
-        for(const auto& j : i){
-            stateHashToInfoMap[j] = StateLocation(dev::toString(node_index), block_number);;
-            // std::cout << j << " | "; 
+    auto t1 = std::chrono::steady_clock::now();
+    if(store){
+        std::vector<std::pair<h256, bytesConstRef>> items;
+        items.reserve(job.bmt.leaves.size() + job.encoded.size());
+        for(size_t i = 0; i < job.bmt.leaves.size(); i++){
+            items.push_back(std::make_pair(job.bmt.leaves[i], job.bmt.leafData(i)));
         }
-        // std::cout << "]" << std::endl;
-        ++node_index;
+        for(auto const& i : job.encoded){
+            items.push_back(std::make_pair(i.first, bytesConstRef(&i.second)));
+        }
+        chunkStore->append(items);
+        if(retention){
+            retention->onBlockPersisted(job.block_number, job.bmt);
+        }
+    }
+    if(db){
+        chunkDB->writeBlock(job.block_number, job.bmt, job.encoded);
+    }
+    if(scrubber){
+        scrubber->onBlockPersisted(job.block_number, job.bmt);
     }
-    */
-    return totalEncodedData;
+    auto t2 = std::chrono::steady_clock::now();
+    auto write_time = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0;
+    writeToLog("Chunk persist: " + dev::toString(job.chunks.size()) + " chunks, "
+        + dev::toString(job.encoded.size()) + " parity, " + dev::toString(write_time) + "ms", "time_log.txt");
+    // chunk 已可读，推进编码轮次并响应排队的请求
+    state_erasure->setCompleteCodingEpoch(job.block_number);
+    return true;
+}
 
-    /* 2024/10/23 状态编码 end */
+/**
+* @brief 开启按分区的分布式读取，transport 的语义见 MPTState.h
+*/
+void MPTState::enableDistributedReads(int local_node, ec::EurasureP2P* p2p, size_t prefetch_bytes){
+    TrieWalkTransport transport;
+    if(p2p){
+        p2p->setTrieWalkHandler([this, local_node](TrieWalkRequest const& req){
+            ReadContext ctx;
+            return versionManager.walk(req, local_node, ctx);
+        });
+        auto sealers = state_erasure ? state_erasure->getSealers() : std::vector<NodeAddr>();
+        transport = [p2p, sealers](int owner, TrieWalkRequest const& req, TrieWalkResult& res){
+            // 分区编号超出节点列表时不能猜测目标节点，本次读取失败
+            if(owner < 0 || (size_t)owner >= sealers.size()){
+                writeToLog("Trie walk owner " + dev::toString(owner) + " out of range (" + dev::toString(sealers.size())
+                    + " sealers)", "ouput_log.txt");
+                return false;
+            }
+            unsigned timeout_ms = ec::EurasureP2P::c_trieWalkTimeoutMs;
+            try{
+                // 超时由 pending fetch 完成为失败；wait_for 再兜底，避免无限阻塞
+                auto f = p2p->fetchTrieWalk(req, sealers[owner], timeout_ms);
+                if(f.wait_for(std::chrono::milliseconds(timeout_ms * 2)) != std::future_status::ready){
+                    writeToLog("Trie walk to node " + dev::toString(owner) + " timed out", "ouput_log.txt");
+                    return false;
+                }
+                auto data = f.get();
+                return TrieWalkResult::fromRLP(bytesConstRef(data), res);
+            }
+            catch(std::exception const& e){
+                writeToLog("Trie walk to node " + dev::toString(owner) + " failed: " + e.what(), "ouput_log.txt");
+                return false;
+            }
+        };
+    }
+    else{
+        transport = [this](int owner, TrieWalkRequest const& req, TrieWalkResult& res){
+            ReadContext ctx;
+            res = versionManager.walk(req, owner, ctx);
+            return true;
+        };
+    }
+    versionManager.setDistributed(local_node, transport, prefetch_bytes);
+}
+
+/**
+* @brief 统计阶段：计算存储开销并记录各阶段耗时
+*/
+void MPTState::accountStage(EncodingJob& job){
+    auto logStr = "VM time: " + dev::toString(job.vm_time) + "ms. "
+        + "SP time: " + dev::toString(job.sp_time) + "ms. "
+        + "CB time:" + dev::toString(job.cb_time);
+    writeToLog(logStr,"time_log.txt");
+
+    job.cb->StorageForChunks(job.chunks, job.encoded, t_state_size, t_extraInfo_size, t_encoded_size); // 计算存储开销
 }
 
 OverlayDB MPTState::openDB(
@@ -39,6 +39,10 @@
 #include <unordered_map>
 #include "Eurasure-P2P.h"
 #include "Eurasure.h"
+#include "ChunkDB.h"
+#include "ChunkStore.h"
+#include "ChunkRetention.h"
+#include "ChunkScrubber.h"
 // #include "VersionManager.h"
 
 // #include "BMT.h"
@@ -47,6 +51,7 @@ namespace dev
 {
 namespace mptstate
 {
+struct EncodingJob;
 
 class MPTState : public dev::executive::StateFace
 {
@@ -74,8 +79,22 @@ public:
 
     std::unordered_map<int, BMT> BMT_map; 
 
+    // 编码块的列族存储，未打开时编码块仍随状态节点写入 OverlayDB
+    std::shared_ptr<ChunkDB> chunkDB;
+    // 编码块的只追加段存储（mmap 零拷贝读取），优先于 chunkDB
+    std::shared_ptr<ChunkStore> chunkStore;
+    // 基于 chunkStore 的分层保留策略（热区 / 仅保留本节点份额 / 压缩归档）
+    std::shared_ptr<ChunkRetention> retention;
+    // 后台巡检本地 chunk / 校验块并修复
+    std::shared_ptr<ChunkScrubber> scrubber;
+    // BMT 叶子按 chunk 大小排序后分组编码
+    bool sizeAwareGroups = false;
+
     VersionManager versionManager;
 
+    // 跨区块保留分配结果的增量划分器（partition mode 5）
+    IncrementalPartitioner incrementalPartitioner;
+
     explicit MPTState(u256 const& _accountStartNonce) : m_state(_accountStartNonce)
     {
         std::cout << "init start1" << std::endl;
@@ -147,6 +166,24 @@ public:
 
     std::unordered_map<h256, std::string> makeECFromMPT(int block_number, std::vector<int> config);
 
+    // 编码流水线的各个阶段（见 EncodingPipeline.h），makeECFromMPT 依次调用
+    std::unordered_map<h256, std::string> collectDirtyNodes();
+    void partitionStage(EncodingJob& job);
+    void chunkStage(EncodingJob& job);
+    void bmtStage(EncodingJob& job);
+    void encodeStage(EncodingJob& job);
+    void accountStage(EncodingJob& job);
+    // 写入 chunkStore / chunkDB，返回 false 表示都未启用，编码块需由调用者写入 OverlayDB
+    bool persistStage(EncodingJob& job);
+
+    /**
+     * 开启分布式查找（versionManager.distributedAt）：本节点为 local_node，按 NodeMetadata 的节点归属路由
+     * p2p 非空时经 EurasureP2P 把遍历请求发给所属节点，并响应其他节点发来的请求；
+     * 为空时在本进程内以所属节点的身份遍历（模拟各节点只读本地分区）
+     * prefetch_bytes 非 0 时每次跨分区请求让对端额外返回其分区内的节点，供后续遍历和同批次的查找使用
+     */
+    void enableDistributedReads(int local_node, ec::EurasureP2P* p2p = nullptr, size_t prefetch_bytes = 0);
+
     bool addressInUse(Address const& _address) const override;
 
     bool accountNonemptyAndExisting(Address const& _address) const override;
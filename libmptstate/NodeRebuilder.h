@@ -0,0 +1,386 @@
+/**
+ * @失效节点的批量重建
+ *功能包括：
+ * 1. 按区块号依次处理，找出失效节点负责的数据块（第 i 个 chunk 属于节点 i % node_number）和校验块
+ * 2. 每个区块的编码组自底向上排序后逐组处理，每个编码组最多解码一次，一次恢复组内全部缺失的数据块；
+ *    组内缺失过多时留给更上层的编码组
+ * 3. 其余节点持有的 chunk 经 ChunkFetcher 读取，并发数不超过 concurrency，读到的 chunk 用 Merkle 根 / sha3 校验
+ * 4. 失效节点的校验块由（读到的与恢复出的）完整数据块重新编码得到
+ * 5. 恢复结果写入本地 ChunkStore（未打开时写入 ChunkDB），吞吐通过 metrics() 读取并写入日志
+ *
+ * 持有位置（holder）与 Mediator 中的 nodeId 一致：数据块为其 chunk 下标，编码组的第 j 个校验块为
+ * 组内第一个数据块的 chunk 下标 + k + j；所在节点为 holder % node_number。
+ *
+ * @file NodeRebuilder.h
+ * @author qqf
+ * @date 2025-03-27
+ */
+#pragma once
+
+#include "BMT.h"
+#include "ChunkDB.h"
+#include "ChunkStore.h"
+#include "Eurasure.h"
+#include <libdevcore/ThreadPool.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dev
+{
+namespace mptstate
+{
+
+struct RebuildConfig {
+    int node_number = 1;
+    int failed_node = -1;   // 需要重建的节点编号，-1 表示不启用
+    size_t concurrency = 8; // 同时向其他节点请求的 chunk 个数
+};
+
+// 重建统计，bytes_per_second 为写入本地的速率
+struct RebuildMetrics {
+    size_t blocks = 0;
+    size_t groups_decoded = 0;
+    size_t groups_encoded = 0; // 重新编码校验块的编码组数
+    size_t chunks_rebuilt = 0;
+    size_t parity_rebuilt = 0;
+    size_t chunks_fetched = 0;
+    size_t bytes_fetched = 0;
+    size_t bytes_written = 0;
+    size_t unrecoverable = 0;
+    double seconds = 0;
+    double bytes_per_second = 0;
+};
+
+class NodeRebuilder
+{
+public:
+    // 从 holder 处读取 chunk，读不到时返回空串
+    typedef std::function<std::string(h256 const& key, int block_number, int holder)> ChunkFetcher;
+
+    NodeRebuilder(std::shared_ptr<ChunkStore> store, std::shared_ptr<ChunkDB> db, ec::Eurasure* erasure,
+        RebuildConfig const& config, ChunkFetcher fetch)
+      : m_store(store), m_db(db), m_erasure(erasure), m_config(config), m_fetch(fetch)
+    {
+        if(m_config.node_number <= 0){
+            m_config.node_number = 1;
+        }
+        if(m_config.concurrency == 0){
+            m_config.concurrency = 1;
+        }
+        m_pool = std::make_shared<dev::ThreadPool>("Rebuild", m_config.concurrency);
+    }
+
+    ~NodeRebuilder() { m_pool->stop(); }
+
+    bool enabled() const
+    {
+        return m_config.failed_node >= 0 && m_config.failed_node < m_config.node_number && m_fetch
+            && ((m_store && m_store->isOpen()) || (m_db && m_db->isOpen()));
+    }
+
+    /**
+    * @brief 按区块号从小到大重建 bmts 中的全部区块
+    */
+    RebuildMetrics rebuild(std::unordered_map<int, BMT> const& bmts)
+    {
+        if(!enabled()){
+            return m_metrics;
+        }
+        std::vector<int> blocks;
+        for(auto const& b : bmts){
+            blocks.push_back(b.first);
+        }
+        std::sort(blocks.begin(), blocks.end());
+
+        auto start = std::chrono::steady_clock::now();
+        for(auto b : blocks){
+            rebuildBlock(b, bmts.at(b));
+            m_metrics.seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count() / 1000000.0;
+            m_metrics.bytes_per_second = m_metrics.seconds > 0 ? m_metrics.bytes_written / m_metrics.seconds : 0;
+        }
+        writeToLog("Rebuild node " + toString(m_config.failed_node) + ": " + toString(m_metrics.blocks) + " blocks, "
+            + toString(m_metrics.chunks_rebuilt) + " chunks / " + toString(m_metrics.parity_rebuilt) + " parity rebuilt ("
+            + toString(m_metrics.groups_decoded) + " groups decoded, " + toString(m_metrics.groups_encoded)
+            + " re-encoded), fetched " + printMemorySize(m_metrics.bytes_fetched) + ", wrote "
+            + printMemorySize(m_metrics.bytes_written) + " at " + printMemorySize((size_t)m_metrics.bytes_per_second)
+            + "/s, unrecoverable " + toString(m_metrics.unrecoverable), "ouput_log.txt");
+        return m_metrics;
+    }
+
+    // 重建一个区块中失效节点的数据块与校验块
+    void rebuildBlock(int block_number, BMT const& bmt)
+    {
+        BlockContext ctx(block_number, bmt);
+        m_metrics.blocks++;
+
+        std::set<size_t> pending; // 尚未恢复的失效节点数据块
+        for(size_t i = 0; i < ctx.leaves.size(); i++){
+            if(ownerOf(chunkOf(ctx, i)) == m_config.failed_node){
+                pending.insert(i);
+            }
+        }
+
+        // 自底向上：覆盖叶子少的编码组在前
+        std::vector<std::shared_ptr<Node>> groups;
+        forEachGroup(bmt.bmt_root, [&](std::shared_ptr<Node> const& group){ groups.push_back(group); });
+        std::sort(groups.begin(), groups.end(), [](std::shared_ptr<Node> const& a, std::shared_ptr<Node> const& b){
+            auto sa = a->_end - a->_begin;
+            auto sb = b->_end - b->_begin;
+            return sa != sb ? sa < sb : a->_begin < b->_begin;
+        });
+
+        for(auto const& group : groups){
+            std::vector<size_t> lost_data;
+            for(auto it = pending.lower_bound(group->_begin); it != pending.end() && *it < group->_end; ++it){
+                lost_data.push_back(*it);
+            }
+            size_t k = group->_end - group->_begin;
+            std::vector<size_t> lost_parity;
+            for(size_t j = 0; j < group->p.size(); j++){
+                if(ownerOf(parityHolder(ctx, *group, j)) == m_config.failed_node){
+                    lost_parity.push_back(j);
+                }
+            }
+            if(lost_data.empty() && lost_parity.empty()){
+                continue;
+            }
+
+            // 读取组内其他节点持有的数据块（已读到或已恢复的不再请求）
+            std::vector<Request> requests;
+            for(auto i = group->_begin; i < group->_end; i++){
+                if(ctx.data[i].empty() && !pending.count(i)){
+                    requests.push_back(Request{ctx.leaves[i], (int)chunkOf(ctx, i), false, &ctx.data[i]});
+                }
+            }
+            std::vector<std::string> parity(group->p.size());
+            if(!lost_data.empty()){
+                for(size_t j = 0; j < group->p.size(); j++){
+                    if(ownerOf(parityHolder(ctx, *group, j)) != m_config.failed_node){
+                        requests.push_back(Request{group->p[j], (int)parityHolder(ctx, *group, j), true, &parity[j]});
+                    }
+                }
+            }
+            fetchAll(block_number, requests);
+
+            if(!lost_data.empty()){
+                decodeGroup(ctx, *group, parity, lost_data, pending);
+            }
+            if(!lost_parity.empty()){
+                encodeGroup(ctx, *group, k, lost_parity);
+            }
+        }
+
+        for(auto i : pending){
+            m_metrics.unrecoverable++;
+            writeToLog("Rebuild failed to recover chunk " + toString(ctx.leaves[i]) + " of block "
+                + toString(block_number), "output_decode_log.txt");
+        }
+    }
+
+    RebuildMetrics metrics() const { return m_metrics; }
+
+private:
+    struct BlockContext {
+        BlockContext(int _block_number, BMT const& bmt)
+          : block_number(_block_number), leaves(bmt.leaves), leaf_chunk(bmt.leaf_chunk), data(bmt.leaves.size())
+        {
+            lengths.reserve(leaves.size());
+            for(size_t i = 0; i < leaves.size(); i++){
+                lengths.push_back(bmt.leafData(i).size());
+            }
+        }
+
+        int block_number;
+        std::vector<h256> const& leaves;
+        std::vector<uint> const& leaf_chunk;
+        std::vector<uint32_t> lengths;
+        std::vector<std::string> data; // 已读到或已恢复的数据块
+    };
+
+    struct Request {
+        h256 key;
+        int holder;
+        bool parity;
+        std::string* out;
+    };
+
+    static size_t chunkOf(BlockContext const& ctx, size_t leaf)
+    {
+        return leaf < ctx.leaf_chunk.size() ? ctx.leaf_chunk[leaf] : leaf;
+    }
+
+    static size_t parityHolder(BlockContext const& ctx, Node const& group, size_t j)
+    {
+        return chunkOf(ctx, group._begin) + (group._end - group._begin) + j;
+    }
+
+    int ownerOf(size_t holder) const { return (int)(holder % m_config.node_number); }
+
+    template <class F>
+    static void forEachGroup(std::shared_ptr<Node> const& root, F f)
+    {
+        std::unordered_set<Node*> visited;
+        std::vector<std::shared_ptr<Node>> stack;
+        if(root){
+            stack.push_back(root);
+        }
+        while(!stack.empty()){
+            auto node = stack.back();
+            stack.pop_back();
+            if(!visited.insert(node.get()).second){
+                continue;
+            }
+            if(!node->p.empty()){
+                f(node);
+            }
+            if(node->left_child) stack.push_back(node->left_child);
+            if(node->right_child) stack.push_back(node->right_child);
+        }
+    }
+
+    /**
+    * @brief 在 m_pool 中并发读取 requests，全部返回后才返回
+    *
+    * 校验不通过的 chunk 按读不到处理（out 保持为空）。
+    */
+    void fetchAll(int block_number, std::vector<Request> const& requests)
+    {
+        if(requests.empty()){
+            return;
+        }
+        std::mutex lock;
+        std::condition_variable done;
+        size_t remaining = requests.size();
+        size_t fetched = 0;
+        size_t bytes = 0;
+        for(auto const& r : requests){
+            m_pool->enqueue([&, r](){
+                auto ret = m_fetch(r.key, block_number, r.holder);
+                bool valid = !ret.empty() && (r.parity ? sha3(ret) == r.key : BMT::chunkRoot(ret) == r.key);
+                std::lock_guard<std::mutex> l(lock);
+                if(valid){
+                    *r.out = std::move(ret);
+                    fetched++;
+                    bytes += r.out->size();
+                }
+                if(--remaining == 0){
+                    done.notify_all();
+                }
+            });
+        }
+        std::unique_lock<std::mutex> l(lock);
+        done.wait(l, [&](){ return remaining == 0; });
+        m_metrics.chunks_fetched += fetched;
+        m_metrics.bytes_fetched += bytes;
+    }
+
+    // 一次解码恢复 lost_data 中的数据块，恢复成功的写入本地并从 pending 中移除
+    void decodeGroup(BlockContext& ctx, Node const& group, std::vector<std::string> const& parity,
+        std::vector<size_t> const& lost_data, std::set<size_t>& pending)
+    {
+        size_t k = group._end - group._begin;
+        size_t present = 0;
+        std::vector<std::string> group_data(ctx.data.begin() + group._begin, ctx.data.begin() + group._end);
+        for(auto const& d : group_data){
+            present += !d.empty();
+        }
+        bool has_parity = false;
+        for(auto const& p : parity){
+            present += !p.empty();
+            has_parity = has_parity || !p.empty();
+        }
+        if(present < k || !has_parity){
+            return;
+        }
+
+        std::vector<size_t> positions;
+        for(auto i : lost_data){
+            positions.push_back(i - group._begin);
+        }
+        auto recovered = m_erasure->recoverFromMPT(group_data, parity, positions, m_erasure->policy());
+        m_metrics.groups_decoded++;
+        for(size_t n = 0; n < lost_data.size(); n++){
+            auto i = lost_data[n];
+            auto& ret = recovered[n];
+            ret.resize(ctx.lengths[i], '\0');
+            if(BMT::chunkRoot(ret) != ctx.leaves[i] || !writeLocal(ctx.leaves[i], ret, ChunkDB::Data)){
+                continue;
+            }
+            m_metrics.chunks_rebuilt++;
+            m_metrics.bytes_written += ret.size();
+            ctx.data[i] = std::move(ret);
+            pending.erase(i);
+        }
+    }
+
+    // 组内数据块齐全时重新编码，得到失效节点的校验块
+    void encodeGroup(BlockContext& ctx, Node const& group, size_t k, std::vector<size_t> const& lost_parity)
+    {
+        for(auto i = group._begin; i < group._end; i++){
+            if(ctx.data[i].empty()){
+                m_metrics.unrecoverable += lost_parity.size();
+                writeToLog("Rebuild lacks data chunks to re-encode parity of group " + toString(group._hash)
+                    + " in block " + toString(ctx.block_number), "output_decode_log.txt");
+                return;
+            }
+        }
+        auto policy = m_erasure->policy().withGroup(k, group.p.size());
+        std::vector<bytes> framed;
+        std::vector<bytesConstRef> refs;
+        for(auto i = group._begin; i < group._end; i++){
+            if(policy.compress){
+                framed.push_back(ec::Eurasure::frameChunk(bytesConstRef(&ctx.data[i]), true));
+            }
+            else{
+                refs.push_back(bytesConstRef(&ctx.data[i]));
+            }
+        }
+        for(auto const& f : framed){
+            refs.push_back(bytesConstRef(&f));
+        }
+        auto derived = m_erasure->parityFromMPT(refs, policy);
+        m_metrics.groups_encoded++;
+        for(auto j : lost_parity){
+            if(j < derived.size() && sha3(derived[j]) == group.p[j] && writeLocal(group.p[j], derived[j], ChunkDB::Parity)){
+                m_metrics.parity_rebuilt++;
+                m_metrics.bytes_written += derived[j].size();
+            }
+            else{
+                m_metrics.unrecoverable++;
+                writeToLog("Rebuild derived parity " + toString(j) + " mismatch for group " + toString(group._hash),
+                    "output_decode_log.txt");
+            }
+        }
+    }
+
+    bool writeLocal(h256 const& key, std::string const& value, ChunkDB::Column c)
+    {
+        if(m_store && m_store->isOpen()){
+            return m_store->contains(key) ? m_store->replace(key, bytesConstRef(&value))
+                                          : m_store->put(key, bytesConstRef(&value));
+        }
+        return m_db && m_db->isOpen() && m_db->put(c, key, bytesConstRef(&value));
+    }
+
+    std::shared_ptr<ChunkStore> m_store;
+    std::shared_ptr<ChunkDB> m_db;
+    ec::Eurasure* m_erasure;
+    RebuildConfig m_config;
+    ChunkFetcher m_fetch;
+    std::shared_ptr<dev::ThreadPool> m_pool;
+    RebuildMetrics m_metrics;
+};
+
+}  // namespace mptstate
+}  // namespace dev
@@ -0,0 +1,262 @@
+/**
+ * @紧凑的版本化节点存储，替代 VersionManager 中多张 unordered_map<h256, ...>
+ *功能包括：
+ * 1. 以 h256 的前 8 字节为键的开放寻址表（线性探测），每个节点只哈希一次
+ * 2. 版本差、NodeMetadata 以及初始化标记内联存放在表项中
+ * 3. 节点的 value 与子节点 metadata 存放在分块 arena 中，表项只记录偏移量
+ * 4. 自带读写锁 mutex()：读取（find / value / forEach 以及读取表项）持 ReadGuard，
+ *    insert / setValue / setChildMeta 以及修改表项持 WriteGuard（扩容会搬移表项，arena 扩容会搬移块数组）
+ *
+ * @file NodeStore.h
+ * @author qqf
+ * @date 2025-03-12
+ */
+#pragma once
+
+#include <libdevcore/Common.h>
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/Guards.h>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct NodeMetadata {
+    uint32_t m_offset; // value 在 chunk 中的偏移量
+    uint32_t m_lengh; // 前三个字节表示 value 长度，后一个字节表示 metadata长度
+    // vector<uint16_t> m_versionDiffs; // 版本存储差集合
+    uint8_t m_node; // 所属节点编号
+
+    NodeMetadata(): m_offset(0), m_lengh(0), m_node(0) {}
+
+    uint8_t Size(){
+        int metadataSize = sizeof(m_offset) + sizeof(m_lengh) + sizeof(m_node);
+        // cout << "Size : " << metadataSize << endl;
+        return uint16_t(metadataSize);
+    }
+
+    uint32_t getDataLength() const{
+        return m_lengh & 0xFFFFFF; // 低 24 位
+    }
+
+    uint16_t getMetaSize() const{
+        return (m_lengh >> 24) & 0xFF; // 高 8 位
+    }
+
+    uint16_t getNodeNum() const{
+        return (uint16_t)m_node; // 高 8 位
+    }
+
+    void printNodeMetadata(int ver = -1) {
+        if(ver < 0){
+            std::cout << "Offset[" << m_offset << "]"
+                << " DataLengh[" << getDataLength() << "] "
+                << " MetaSize[" << getMetaSize() << "]"
+                << " NodeNum[" << getNodeNum() << "]" << std::endl;
+        }
+        else{
+            std::cout << "Offset[" << m_offset << "]"
+                << " DataLengh[" << getDataLength() << "] "
+                << " MetaSize[" << getMetaSize() << "]"
+                << " VersionDiff[" << ver << "]"
+                << " NodeNum[" << getNodeNum() << "]" << std::endl;
+        }
+
+    }
+};
+
+/**
+* @brief 分块 arena
+*
+* 只追加不释放，偏移量编码为 (块号 << 32) | 块内偏移，扩容时已写入的数据地址不变。
+*/
+class ValueArena {
+public:
+    static const size_t c_blockSize = 1 << 22; // 4MB
+
+    uint64_t append(const char* data, size_t len){
+        if(m_blocks.empty() || m_used + len > m_capacity){
+            // 超过块大小的 value 单独占一块
+            m_capacity = len > c_blockSize ? len : c_blockSize;
+            m_blocks.emplace_back(new char[m_capacity]);
+            m_used = 0;
+            m_reserved += m_capacity;
+        }
+        uint64_t offset = ((uint64_t)(m_blocks.size() - 1) << 32) | m_used;
+        if(len){
+            memcpy(m_blocks.back().get() + m_used, data, len);
+        }
+        m_used += len;
+        return offset;
+    }
+
+    const char* at(uint64_t offset) const {
+        return m_blocks[offset >> 32].get() + (offset & 0xFFFFFFFF);
+    }
+
+    size_t reserved() const { return m_reserved; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_used = 0;
+    size_t m_capacity = 0;
+    size_t m_reserved = 0;
+};
+
+struct NodeEntry {
+    enum Flags : uint8_t {
+        Used = 1,       // 槽位已被占用
+        HasValue = 2,   // value 已写入 arena
+        Init = 4,       // metadata 已初始化（原 dataSet_init）
+        HasVersion = 8, // 版本差有效（原 m_nodeVersions）
+        HasChildMeta = 16 // 子节点 metadata 已写入（原 dataWithchildsNodeMetadata）
+    };
+
+    uint64_t m_prefix = 0;      // h256 的前 8 字节
+    uint64_t m_keyOffset = 0;   // 完整 h256 在 arena 中的偏移（前缀冲突时比较）
+    uint64_t m_valueOffset = 0;
+    uint64_t m_childMetaOffset = 0;
+    uint32_t m_valueLength = 0;
+    int32_t m_version = -1;     // 版本差
+    NodeMetadata m_meta;
+    uint16_t m_childMetaLength = 0;
+    uint8_t m_flags = 0;
+
+    bool used() const { return m_flags & Used; }
+    bool hasValue() const { return m_flags & HasValue; }
+    bool isInit() const { return m_flags & Init; }
+    bool hasVersion() const { return m_flags & HasVersion; }
+    bool hasChildMeta() const { return m_flags & HasChildMeta; }
+    void setInit(bool init){ m_flags = init ? (m_flags | Init) : (m_flags & ~Init); }
+    void setVersion(int version){ m_version = version; m_flags |= HasVersion; }
+};
+
+/**
+* @brief 开放寻址的节点表
+*
+* 容量为 2 的幂，负载因子超过 0.7 时翻倍重建。find 不会插入，
+* 因此在没有 insert 的区间内返回的 NodeEntry 指针保持有效。
+* NodeStore 本身不加锁，调用方按 mutex() 加锁，NodeEntry 指针只在持锁期间有效。
+*/
+class NodeStore {
+public:
+    NodeStore() { m_slots.resize(c_initCapacity); }
+
+    NodeEntry* find(dev::h256 const& _h){
+        return const_cast<NodeEntry*>(static_cast<NodeStore const*>(this)->find(_h));
+    }
+
+    NodeEntry const* find(dev::h256 const& _h) const {
+        auto prefix = prefixOf(_h);
+        size_t mask = m_slots.size() - 1;
+        for(size_t i = prefix & mask; ; i = (i + 1) & mask){
+            auto const& slot = m_slots[i];
+            if(!slot.used()){
+                return nullptr;
+            }
+            if(slot.m_prefix == prefix && memcmp(m_arena.at(slot.m_keyOffset), _h.data(), dev::h256::size) == 0){
+                return &slot;
+            }
+        }
+    }
+
+    bool contains(dev::h256 const& _h) const { return find(_h) != nullptr; }
+
+    // 查找或创建，可能触发扩容，之前拿到的 NodeEntry 指针会失效
+    NodeEntry& insert(dev::h256 const& _h){
+        if(auto e = find(_h)){
+            return *e;
+        }
+        if((m_size + 1) * 10 > m_slots.size() * 7){
+            rehash(m_slots.size() * 2);
+        }
+        auto& slot = probe(prefixOf(_h));
+        slot.m_prefix = prefixOf(_h);
+        slot.m_keyOffset = m_arena.append((const char*)_h.data(), dev::h256::size);
+        slot.m_flags = NodeEntry::Used;
+        ++m_size;
+        return slot;
+    }
+
+    dev::h256 key(NodeEntry const& e) const {
+        return dev::h256((byte const*)m_arena.at(e.m_keyOffset), dev::h256::ConstructFromPointer);
+    }
+
+    // 内容寻址：同一 hash 的 value 只写入一次
+    void setValue(NodeEntry& e, std::string const& value){
+        if(e.hasValue()){
+            return;
+        }
+        e.m_valueOffset = m_arena.append(value.data(), value.size());
+        e.m_valueLength = value.size();
+        e.m_flags |= NodeEntry::HasValue;
+    }
+
+    std::string value(NodeEntry const& e) const {
+        return std::string(m_arena.at(e.m_valueOffset), e.m_valueLength);
+    }
+
+    dev::bytesConstRef valueRef(NodeEntry const& e) const {
+        return dev::bytesConstRef((byte const*)m_arena.at(e.m_valueOffset), e.m_valueLength);
+    }
+
+    void setChildMeta(NodeEntry& e, std::string const& meta){
+        e.m_childMetaOffset = m_arena.append(meta.data(), meta.size());
+        e.m_childMetaLength = meta.size();
+        e.m_flags |= NodeEntry::HasChildMeta;
+    }
+
+    std::string childMeta(NodeEntry const& e) const {
+        return e.hasChildMeta() ? std::string(m_arena.at(e.m_childMetaOffset), e.m_childMetaLength) : std::string();
+    }
+
+    template <class F>
+    void forEach(F f) const {
+        for(auto const& slot : m_slots){
+            if(slot.used()){
+                f(key(slot), slot);
+            }
+        }
+    }
+
+    size_t size() const { return m_size; }
+
+    // 表项 + arena 占用的字节数
+    size_t memoryUsage() const { return m_slots.size() * sizeof(NodeEntry) + m_arena.reserved(); }
+
+    dev::SharedMutex& mutex() const { return x_store; }
+
+private:
+    static const size_t c_initCapacity = 1 << 16;
+
+    static uint64_t prefixOf(dev::h256 const& _h){
+        uint64_t prefix;
+        memcpy(&prefix, _h.data(), sizeof(prefix));
+        return prefix;
+    }
+
+    NodeEntry& probe(uint64_t prefix){
+        size_t mask = m_slots.size() - 1;
+        size_t i = prefix & mask;
+        while(m_slots[i].used()){
+            i = (i + 1) & mask;
+        }
+        return m_slots[i];
+    }
+
+    void rehash(size_t capacity){
+        std::vector<NodeEntry> old(capacity);
+        old.swap(m_slots);
+        for(auto const& slot : old){
+            if(slot.used()){
+                probe(slot.m_prefix) = slot;
+            }
+        }
+    }
+
+    std::vector<NodeEntry> m_slots;
+    ValueArena m_arena;
+    size_t m_size = 0;
+    mutable dev::SharedMutex x_store;
+};
@@ -0,0 +1,157 @@
+/**
+ * @有界的分片 LRU 缓存
+ *功能包括：
+ * 1. 按 key 的哈希分到若干分片，每个分片一把锁，多线程读写时锁竞争只发生在同一分片内
+ * 2. 每个分片独立做 LRU 淘汰，总容量为各分片容量之和
+ * 3. 统计命中/未命中次数
+ * 4. 可指定 weigher 按值的大小（如字节数）计算容量，不指定时每项计 1
+ *
+ * @file ShardedCache.h
+ * @author qqf
+ * @date 2025-03-14
+ */
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+template <class Key, class Value, class Hash = std::hash<Key>>
+class ShardedCache {
+public:
+    typedef std::function<size_t(Value const&)> Weigher;
+
+    explicit ShardedCache(size_t capacity = 1 << 16, size_t shardNumber = 16, Weigher weigher = Weigher())
+      : m_weigher(weigher), m_hits(0), m_misses(0)
+    {
+        shardNumber = shardNumber ? shardNumber : 1;
+        for(size_t i = 0; i < shardNumber; i++){
+            m_shards.emplace_back(new Shard());
+        }
+        setCapacity(capacity);
+    }
+
+    // 调整总容量，超出的部分在下一次 put 时淘汰
+    void setCapacity(size_t capacity){
+        size_t perShard = capacity / m_shards.size();
+        for(auto& shard : m_shards){
+            std::lock_guard<std::mutex> l(shard->lock);
+            shard->capacity = perShard ? perShard : 1;
+        }
+    }
+
+    bool get(Key const& key, Value& value){
+        auto& shard = shardOf(key);
+        std::lock_guard<std::mutex> l(shard.lock);
+        auto it = shard.index.find(key);
+        if(it == shard.index.end()){
+            ++m_misses;
+            return false;
+        }
+        // 移到链表头部
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        value = it->second->second;
+        ++m_hits;
+        return true;
+    }
+
+    bool contains(Key const& key){
+        auto& shard = shardOf(key);
+        std::lock_guard<std::mutex> l(shard.lock);
+        return shard.index.count(key) != 0;
+    }
+
+    void put(Key const& key, Value const& value){
+        auto& shard = shardOf(key);
+        std::lock_guard<std::mutex> l(shard.lock);
+        auto it = shard.index.find(key);
+        if(it != shard.index.end()){
+            shard.weight -= weigh(it->second->second);
+            it->second->second = value;
+            shard.weight += weigh(value);
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        }
+        else{
+            shard.lru.emplace_front(key, value);
+            shard.index[key] = shard.lru.begin();
+            shard.weight += weigh(value);
+        }
+        // 最近放入的一项总是保留，即使它本身超过分片容量
+        while(shard.weight > shard.capacity && shard.lru.size() > 1){
+            shard.weight -= weigh(shard.lru.back().second);
+            shard.index.erase(shard.lru.back().first);
+            shard.lru.pop_back();
+        }
+    }
+
+    void erase(Key const& key){
+        auto& shard = shardOf(key);
+        std::lock_guard<std::mutex> l(shard.lock);
+        auto it = shard.index.find(key);
+        if(it != shard.index.end()){
+            shard.weight -= weigh(it->second->second);
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+
+    void clear(){
+        for(auto& shard : m_shards){
+            std::lock_guard<std::mutex> l(shard->lock);
+            shard->lru.clear();
+            shard->index.clear();
+            shard->weight = 0;
+        }
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for(auto& shard : m_shards){
+            std::lock_guard<std::mutex> l(shard->lock);
+            n += shard->lru.size();
+        }
+        return n;
+    }
+
+    // 各项 weigher 之和，未指定 weigher 时等于 size()
+    size_t weight() const {
+        size_t n = 0;
+        for(auto& shard : m_shards){
+            std::lock_guard<std::mutex> l(shard->lock);
+            n += shard->weight;
+        }
+        return n;
+    }
+
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+private:
+    typedef std::list<std::pair<Key, Value>> LruList;
+
+    struct Shard {
+        mutable std::mutex lock;
+        LruList lru; // 头部为最近使用
+        std::unordered_map<Key, typename LruList::iterator, Hash> index;
+        size_t capacity = 1;
+        size_t weight = 0;
+    };
+
+    size_t weigh(Value const& value) const { return m_weigher ? m_weigher(value) : 1; }
+
+    Shard& shardOf(Key const& key){
+        size_t h = Hash()(key);
+        // 分片内的 unordered_map 还会用同一个哈希值，这里先打散一次
+        h ^= h >> 17;
+        return *m_shards[h % m_shards.size()];
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    Weigher m_weigher;
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+};
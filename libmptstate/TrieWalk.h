@@ -0,0 +1,100 @@
+/**
+ * @分布式 MPT 查找（服务端遍历）的请求与结果
+ *功能包括：
+ * 1. 查找在本地沿 MPT 向下走，遇到属于其他节点（NodeMetadata::m_node）的子节点时，把该子节点的 hash 与 key 已匹配的 nibble 数发给其所属节点
+ * 2. 对端从该子节点继续向下遍历，直到找到 value、确定不存在，或再次跨入其他节点的分区（返回 Redirect），
+ *    因此一次查找每跨一次分区只有一次网络往返
+ * 3. 结果附带对端读取过的节点原始 RLP 作为证明，请求方用证明重放一遍遍历即可校验
+ * 4. 结果可编码为 RLP，经 EurasureP2P 传输
+ * 5. 请求可附带预取预算：对端按层序额外返回其分区内、起点之下的节点（不超过预算字节数），
+ *    请求方按 hash 缓存，同一批次中后续经过这一分区的查找可直接在本地继续，不必再发请求
+ *
+ * @file TrieWalk.h
+ * @author qqf
+ * @date 2025-03-28
+ */
+#pragma once
+
+#include <libdevcore/Common.h>
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/RLP.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct TrieWalkRequest {
+    dev::h256 node;     // 继续遍历的起点
+    dev::h256 key;      // 完整的 key
+    unsigned depth;     // key 已匹配的 nibble 数
+    size_t frontier_bytes; // 预取预算，0 表示不预取
+
+    TrieWalkRequest() : depth(0), frontier_bytes(0) {}
+};
+
+struct TrieWalkResult {
+    enum Status : uint8_t {
+        NotFound = 0,
+        Found = 1,
+        Redirect = 2, // 遍历跨入了其他节点的分区，从 next 继续
+        Failed = 3    // 节点读取失败或结果未通过校验
+    };
+
+    Status status = Failed;
+    std::string value;             // Found 时的 value
+    std::vector<dev::bytes> proof; // 按遍历顺序读取过的节点的原始 RLP（内联节点不单独列出）
+    dev::h256 next;                // Redirect 时下一段的起点
+    unsigned depth = 0;            // Redirect 时 key 已匹配的 nibble 数
+    int owner = -1;                // Redirect 时 next 所属的节点
+    std::vector<dev::bytes> frontier; // 预取的节点原始 RLP（不含 proof 中已有的），请求方按 sha3 校验后使用
+
+    dev::bytes rlp() const
+    {
+        dev::RLPStream s(7);
+        s << (unsigned)status << value;
+        s.appendList(proof.size());
+        for(auto const& p : proof){
+            s << p;
+        }
+        // owner 可能为 -1，加一后编码
+        s << next << depth << (unsigned)(owner + 1);
+        s.appendList(frontier.size());
+        for(auto const& f : frontier){
+            s << f;
+        }
+        return s.out();
+    }
+
+    static bool fromRLP(dev::bytesConstRef data, TrieWalkResult& out)
+    {
+        try{
+            dev::RLP r(data);
+            if(!r.isList() || r.itemCount() != 7){
+                return false;
+            }
+            auto status = r[0].toInt<unsigned>();
+            if(status > Failed){
+                return false;
+            }
+            out.status = (Status)status;
+            out.value = r[1].toString();
+            out.proof.clear();
+            for(auto const& p : r[2]){
+                out.proof.push_back(p.toBytes());
+            }
+            out.next = r[3].toHash<dev::h256>();
+            out.depth = r[4].toInt<unsigned>();
+            out.owner = (int)r[5].toInt<unsigned>() - 1;
+            out.frontier.clear();
+            for(auto const& f : r[6]){
+                out.frontier.push_back(f.toBytes());
+            }
+            return true;
+        }
+        catch(std::exception const&){
+            return false;
+        }
+    }
+};
+
+// 把请求发给 owner 节点并等待其遍历结果，发送失败或超时返回 false
+typedef std::function<bool(int owner, TrieWalkRequest const& req, TrieWalkResult& result)> TrieWalkTransport;
@@ -2,7 +2,17 @@
 #include <iostream>
 #include <iomanip>
 #include "Vtools.h"
+#include "NodeStore.h"
+#include "ShardedCache.h"
+#include "TrieWalk.h"
 #include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/spin_mutex.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <unordered_set>
 
 using namespace std;
 using namespace dev;
@@ -29,50 +39,6 @@ using namespace dev;
 //     }
 // }
 
-struct NodeMetadata {
-    uint32_t m_offset; // value 在 chunk 中的偏移量
-    uint32_t m_lengh; // 前三个字节表示 value 长度，后一个字节表示 metadata长度
-    // vector<uint16_t> m_versionDiffs; // 版本存储差集合
-    uint8_t m_node; // 所属节点编号
-
-    NodeMetadata(): m_offset(0), m_lengh(0), m_node(0) {}
-    
-    uint8_t Size(){
-        int metadataSize = sizeof(m_offset) + sizeof(m_lengh) + sizeof(m_node);
-        // cout << "Size : " << metadataSize << endl;
-        return uint16_t(metadataSize);
-    }
-
-    uint32_t getDataLength() const{
-        return m_lengh & 0xFFFFFF; // 低 24 位
-    }
-
-    uint16_t getMetaSize() const{
-        return (m_lengh >> 24) & 0xFF; // 高 8 位
-    }
-
-    uint16_t getNodeNum() const{
-        return (uint16_t)m_node; // 高 8 位
-    }
-
-    void printNodeMetadata(int ver = -1) {
-        if(ver < 0){
-            cout << "Offset[" << m_offset << "]" 
-                << " DataLengh[" << getDataLength() << "] " 
-                << " MetaSize[" << getMetaSize() << "]" 
-                << " NodeNum[" << getNodeNum() << "]" << endl;
-        }
-        else{
-            cout << "Offset[" << m_offset << "]" 
-                << " DataLengh[" << getDataLength() << "] " 
-                << " MetaSize[" << getMetaSize() << "]" 
-                << " VersionDiff[" << ver << "]" 
-                << " NodeNum[" << getNodeNum() << "]" << endl;
-        }
-        
-    }
-};
-
 class StatePartition{
 public:
     // 初始化
@@ -408,18 +374,408 @@ public:
     }
 };
 
+/**
+* @brief 增量式状态划分
+*
+* 与 StatePartition 每个区块从头划分不同，该划分器跨区块保留 trie 路径 -> part 的分配结果，
+* 每个区块只放置新产生的 MPT 节点：同一路径上被替换的节点沿用旧节点的分区，新路径优先放在父节点所在的分区，
+* 当分区负载失衡超过阈值时，仅在本区块的新节点中做有界的迁移，历史（冷）数据不会被重新编码。
+*
+* 分配按路径而不是按内容 hash 保存：节点被修改后 hash 改变，但路径不变，
+* 被替换的节点和不再存在的子树会从 pathParts 中移除并从 partLoad 中扣除，负载只反映当前这棵树。
+*/
+class IncrementalPartitioner{
+public:
+    // 位于某条路径上的节点
+    struct PathEntry {
+        h256 hash;
+        uint16_t part = 0;
+        int64_t size = 0;                        // 计入 partLoad 的字节数
+        vector<pair<h256, string>> children;     // 子节点 hash 及其相对路径（nibble 序列）
+    };
+
+    unordered_map<string, PathEntry> pathParts; // 跨区块保留的分配结果：路径（nibble 序列）-> 节点
+    vector<int64_t> partLoad;               // 每个分区当前的字节数
+    uint m_groups = 0;                      // 网络节点个数
+    double imbalanceThreshold = 0.2;        // 超过平均负载的比例即视为失衡
+    size_t maxMigrations = 64;              // 每个区块最多迁移的节点个数
+    size_t totalMigrations = 0;             // 累计迁移的节点个数
+    size_t totalEvictions = 0;              // 累计移除的过期路径个数
+
+    IncrementalPartitioner() = default;
+
+    void init(uint nodeNumber){
+        if(m_groups == nodeNumber){
+            return;
+        }
+        m_groups = nodeNumber;
+        partLoad.resize(m_groups, 0);
+    }
+
+    uint16_t lightestPart() const {
+        uint16_t part = 0;
+        for(uint16_t i = 1; i < m_groups; i++){
+            if(partLoad[i] < partLoad[part]){
+                part = i;
+            }
+        }
+        return part;
+    }
+
+    uint16_t heaviestPart() const {
+        uint16_t part = 0;
+        for(uint16_t i = 1; i < m_groups; i++){
+            if(partLoad[i] > partLoad[part]){
+                part = i;
+            }
+        }
+        return part;
+    }
+
+    // 放入 extra 字节后该分区是否超过平均负载的 (1 + imbalanceThreshold) 倍
+    bool overloaded(uint16_t part, int64_t extra) const {
+        int64_t total = extra;
+        for(auto load : partLoad){
+            total += load;
+        }
+        double avg = (double)total / m_groups;
+        return (partLoad[part] + extra) > avg * (1 + imbalanceThreshold);
+    }
+
+    /**
+    * @brief 解析节点的子节点及其相对路径
+    *
+    * 分支节点的第 i 个子节点相对路径为 nibble i，扩展节点的子节点相对路径为其 key，叶子节点没有子节点。
+    * 内联（不足 32 字节）的子节点不单独存储，跳过。
+    */
+    static vector<pair<h256, string>> childPaths(const std::string& rlpStr){
+        vector<pair<h256, string>> children;
+        try {
+            RLP rlp(rlpStr);
+            if(rlp.itemCount() == 2){
+                if(isLeaf(rlp) || !rlp[1].isData() || rlp[1].size() != h256::size){
+                    return children;
+                }
+                NibbleSlice key = keyOf(rlp);
+                string rel;
+                for(unsigned i = 0; i < key.size(); i++){
+                    rel.push_back((char)key[i]);
+                }
+                children.push_back(make_pair(rlp[1].toHash<h256>(), rel));
+            }
+            else if(rlp.itemCount() == 17){
+                for(unsigned i = 0; i < 16; i++){
+                    if(rlp[i].isData() && rlp[i].size() == h256::size){
+                        children.push_back(make_pair(rlp[i].toHash<h256>(), string(1, (char)i)));
+                    }
+                }
+            }
+        }catch (const std::exception& ex) {
+            std::cerr << "Error processing RLP for incremental partition: " << ex.what() << std::endl;
+        }
+        return children;
+    }
+
+    /**
+    * @brief 增量划分本区块的更新节点
+    *
+    * 按 BFS 从根出发，沿路径定位每个新节点：该路径上已有节点时沿用其分区并扣除旧节点的负载，
+    * 旧节点不再存在的子路径整棵移除，仅改变了路径的未修改子树整体改挂到新路径；
+    * 新路径上的节点跟随父节点所在分区，父分区过载时改放到负载最轻的分区。
+    * 结果同时写入 sp（供 ChunkBuilder 使用）和 pathParts。
+    *
+    * @param sp 已经 processBatch + init 的本区块划分信息
+    * @param rootHash 本区块的 MPT 根
+    * @param batch 本区块新写入的节点 hash -> RLP
+    */
+    void partitionMPT(StatePartition& sp, h256 rootHash, const std::unordered_map<h256, std::string>& batch){
+        init(sp.m_groups);
+
+        unordered_map<h256, string> placed; // 本区块放置的节点 -> 路径，供迁移时更新 pathParts
+        queue<pair<pair<h256, string>, uint16_t>> bfsQueue; // <<节点, 路径>, 父节点所在分区>
+        bfsQueue.push(make_pair(make_pair(rootHash, string()), lightestPart()));
+
+        while(!bfsQueue.empty()){
+            auto nodeHash = bfsQueue.front().first.first;
+            auto path = bfsQueue.front().first.second;
+            auto parentPart = bfsQueue.front().second;
+            bfsQueue.pop();
+
+            auto size = (int64_t)sp.nodeSize[nodeHash];
+            auto raw = batch.find(nodeHash);
+            auto children = raw != batch.end() ? childPaths(raw->second) : vector<pair<h256, string>>();
+
+            uint16_t part;
+            auto it = pathParts.find(path);
+            if(it != pathParts.end()){
+                // 路径上已有节点（被修改或内容相同），沿用其分区
+                part = it->second.part;
+                partLoad[part] -= it->second.size;
+                auto old = std::move(it->second.children);
+                pathParts.erase(it);
+                replaceChildren(path, old, children);
+            }
+            else{
+                part = overloaded(parentPart, size) ? lightestPart() : parentPart;
+            }
+
+            bool first = !sp.Mapparts.count(nodeHash);
+            if(first){
+                sp.parts[part].insert(nodeHash);
+                sp.Mapparts[nodeHash] = part;
+                sp.partSize[part] += size;
+                sp.allocatedNodes += size;
+                placed[nodeHash] = path;
+            }
+            else{
+                // 同一内容出现在多条路径上只存一份，只在第一次出现时计入负载
+                part = sp.Mapparts[nodeHash];
+                size = 0;
+            }
+
+            PathEntry& e = pathParts[path];
+            e.hash = nodeHash;
+            e.part = part;
+            e.size = size;
+            e.children = children;
+            partLoad[part] += size;
+
+            if(!first){
+                continue;
+            }
+            for(const auto& child : children){
+                // 如果遍历到非本次更新的节点，则跳过
+                if(sp.tree.find(child.first) != sp.tree.end()){
+                    bfsQueue.push(make_pair(make_pair(child.first, path + child.second), part));
+                }
+            }
+        }
+
+        rebalance(sp, placed);
+    }
+
+    /**
+    * @brief 有界迁移
+    *
+    * 只迁移本区块新放置的、在本批次中没有子节点的节点（其数据本来就要重新编码），
+    * 每次从最重的分区移到最轻的分区，至多 maxMigrations 个。
+    */
+    void rebalance(StatePartition& sp, const unordered_map<h256, string>& placed){
+        size_t migrations = 0;
+        while(migrations < maxMigrations){
+            auto from = heaviestPart();
+            auto to = lightestPart();
+            if(from == to || !overloaded(from, 0)){
+                break;
+            }
+
+            h256 candidate;
+            bool found = false;
+            for(const auto& nodeHash : sp.parts[from]){
+                bool hasDirtyChild = false;
+                for(const auto& childHash : sp.tree[nodeHash]){
+                    if(sp.tree.find(childHash) != sp.tree.end()){
+                        hasDirtyChild = true;
+                        break;
+                    }
+                }
+                if(!hasDirtyChild){
+                    candidate = nodeHash;
+                    found = true;
+                    break;
+                }
+            }
+            if(!found){
+                break;
+            }
+
+            auto size = (int64_t)sp.nodeSize[candidate];
+            sp.parts[from].erase(candidate);
+            sp.parts[to].insert(candidate);
+            sp.Mapparts[candidate] = to;
+            sp.partSize[from] -= size;
+            sp.partSize[to] += size;
+            auto p = placed.find(candidate);
+            if(p != placed.end()){
+                pathParts[p->second].part = to;
+            }
+            partLoad[from] -= size;
+            partLoad[to] += size;
+            ++migrations;
+        }
+        totalMigrations += migrations;
+        if(migrations){
+            writeToLog("Incremental partition migrated " + to_string(migrations) + " nodes", "ouput_log.txt");
+        }
+    }
+
+private:
+    // 取出 path + suffix 下的整棵子树，路径保存为相对 path 的后缀
+    void detach(const string& path, const string& suffix, vector<pair<string, PathEntry>>& out){
+        auto it = pathParts.find(path + suffix);
+        if(it == pathParts.end()){
+            return;
+        }
+        PathEntry e = std::move(it->second);
+        pathParts.erase(it);
+        for(const auto& child : e.children){
+            detach(path, suffix + child.second, out);
+        }
+        out.push_back(make_pair(suffix, std::move(e)));
+    }
+
+    /**
+    * @brief 用新节点的子路径替换旧节点的子路径
+    *
+    * 相对路径不变的子节点保留（被修改的会在 BFS 中被替换），
+    * 同一子节点换了相对路径时整棵子树改挂到新路径，其余旧子路径连同子树一起移除并扣除负载。
+    */
+    void replaceChildren(const string& path, const vector<pair<h256, string>>& oldChildren,
+        const vector<pair<h256, string>>& newChildren){
+        unordered_map<string, h256> keep;
+        unordered_map<h256, string> moved;
+        for(const auto& child : newChildren){
+            keep[child.second] = child.first;
+            moved[child.first] = child.second;
+        }
+
+        vector<pair<string, PathEntry>> evicted;
+        vector<pair<pair<string, string>, vector<pair<string, PathEntry>>>> reattach; // <<旧相对路径, 新相对路径>, 子树>
+        for(const auto& child : oldChildren){
+            if(keep.count(child.second)){
+                continue;
+            }
+            vector<pair<string, PathEntry>> subtree;
+            detach(path, child.second, subtree);
+            auto m = moved.find(child.first);
+            if(m != moved.end()){
+                reattach.push_back(make_pair(make_pair(child.second, m->second), std::move(subtree)));
+            }
+            else{
+                for(auto& e : subtree){
+                    evicted.push_back(std::move(e));
+                }
+            }
+        }
+
+        for(auto& r : reattach){
+            const string& oldRel = r.first.first;
+            const string& newRel = r.first.second;
+            // 新路径上原有的子树已不在树中
+            detach(path, newRel, evicted);
+            for(auto& e : r.second){
+                pathParts[path + newRel + e.first.substr(oldRel.size())] = std::move(e.second);
+            }
+        }
+
+        for(const auto& e : evicted){
+            partLoad[e.second.part] -= e.second.size;
+        }
+        totalEvictions += evicted.size();
+    }
+};
+
+/**
+* @brief 预解码的 MPT 节点
+*
+* 节点按 hash 内容寻址，解码一次后可以在多次查找、多个版本之间共享。
+* items 记录每一项在 raw 中的 RLP 片段，两项节点额外记录路径以及是否为叶子，
+* 查找时不必再从头扫描 RLP。
+*/
+struct DecodedNode {
+    std::string raw;        // 节点的原始 RLP（内联节点为空，items 指向父节点的 raw）
+    unsigned itemCount = 0; // 0 表示空节点
+    bool leaf = false;
+    NibbleSlice key;        // 两项节点的路径
+    bytesConstRef items[17];
+
+    explicit DecodedNode(std::string _raw) : raw(std::move(_raw)) {
+        decode(bytesConstRef((byte const*)raw.data(), raw.size()));
+    }
+    explicit DecodedNode(bytesConstRef _inline) { decode(_inline); }
+    // items 指向自身的 raw，不能拷贝
+    DecodedNode(DecodedNode const&) = delete;
+    DecodedNode& operator=(DecodedNode const&) = delete;
+
+    RLP item(unsigned i) const { return RLP(items[i]); }
+
+private:
+    void decode(bytesConstRef data){
+        RLP r(data);
+        if(r.isEmpty() || r.isNull() || !r.isList()){
+            return;
+        }
+        itemCount = r.itemCount();
+        assert(itemCount == 2 || itemCount == 17);
+        unsigned i = 0;
+        for(auto it : r){
+            if(i >= 17){
+                break;
+            }
+            items[i++] = it.data();
+        }
+        if(itemCount == 2){
+            auto pl = RLP(items[0]).payload();
+            leaf = (pl[0] & 0x20) != 0;
+            key = keyOf(pl);
+        }
+    }
+};
+typedef std::shared_ptr<DecodedNode const> DecodedNodePtr;
+
+/**
+* @brief 单次读取的上下文
+*
+* 原先 current_read / read_count / execution_remote_read 是 VersionManager 的成员，
+* 并发读取时会互相干扰；改为每个调用（或每个线程）持有一份，读完后再由调用方汇总。
+*/
+struct ReadContext {
+    int current_read = -1; // 记录现在正在遍历MPT节点属于的节点
+    int read_count = 0; // 记录遍历过程访问了多少个节点
+    size_t execution_remote_read = 0;
+    size_t nodes_fetched = 0; // 实际取出并解码的节点数
+    size_t cache_hits = 0; // 命中预解码节点缓存的次数
+    size_t remote_hops = 0; // 分布式查找中发给其他节点的遍历请求数
+    size_t prefetched_nodes = 0; // 分布式查找中随结果预取到的节点数
+    size_t speculative_hits = 0; // 用预取的节点在本地完成、省去的遍历请求数
+
+    void merge(ReadContext const& other){
+        read_count += other.read_count;
+        remote_hops += other.remote_hops;
+        prefetched_nodes += other.prefetched_nodes;
+        speculative_hits += other.speculative_hits;
+        execution_remote_read += other.execution_remote_read;
+        nodes_fetched += other.nodes_fetched;
+        cache_hits += other.cache_hits;
+    }
+};
+
+/**
+* @brief 分布式查找中预取的节点，按 sha3(raw) 索引，只在一次查找或一个批次内有效
+*
+* 节点以自身 hash 为键，只有从根沿 hash 引用走到时才会被用到，因此不需要额外校验。按原始 RLP 字节数做 LRU 淘汰。
+*/
+struct SpeculativeNodes {
+    ShardedCache<h256, DecodedNodePtr> nodes;
+
+    explicit SpeculativeNodes(size_t capacity_bytes)
+      : nodes(capacity_bytes, 1, [](DecodedNodePtr const& n){ return n->raw.size(); }) {}
+};
+
 class VersionManager {
         public:
             void recordCache(h256 const& nodeHash, int version){
-                m_cache[nodeHash] = version;
+                m_cache.push_back(make_pair(nodeHash, version));
             }
             
             void recordVersion(h256 const& nodeHash, int version){
-                m_nodeVersions[nodeHash] = version;
+                WriteGuard l(m_store.mutex());
+                m_store.insert(nodeHash).setVersion(version);
             }
             int getVersion(h256 const& nodeHash) const {
-                auto it = m_nodeVersions.find(nodeHash);
-                return (it != m_nodeVersions.end() ? it->second : -1);
+                ReadGuard l(m_store.mutex());
+                auto e = m_store.find(nodeHash);
+                return (e && e->hasVersion() ? e->m_version : -1);
             }
             int getVersionDifference(h256 parentHash, h256 const& childHash) const{
                 int parentVersion = getVersion(parentHash);
@@ -427,8 +783,40 @@ class VersionManager {
                 return (parentVersion != -1 && childVersion != -1) ? parentVersion - childVersion : -1;
             }
 
+            // 与原先 map::insert 语义一致：已有版本差的节点不覆盖
             void updataVersion(){
-                m_nodeVersions.insert(m_cache.begin(), m_cache.end());
+                WriteGuard l(m_store.mutex());
+                mergeCachedVersions();
+            }
+
+            // 子节点已有版本差时加一
+            void bumpVersion(h256 const& childHash){
+                WriteGuard l(m_store.mutex());
+                incVersion(childHash);
+            }
+
+            // 调用方持有 m_store 的写锁
+            void mergeCachedVersions(){
+                for(const auto& p : m_cache){
+                    auto& e = m_store.insert(p.first);
+                    if(!e.hasVersion()){
+                        e.setVersion(p.second);
+                    }
+                }
+                m_cache.clear();
+            }
+
+            void incVersion(h256 const& childHash){
+                auto e = m_store.find(childHash);
+                if(e && e->hasVersion()){
+                    ++e->m_version;
+                }
+            }
+
+            NodeMetadata getNodeMetadata(h256 const& nodeHash) const {
+                ReadGuard l(m_store.mutex());
+                auto e = m_store.find(nodeHash);
+                return e ? e->m_meta : NodeMetadata();
             }
 
             void setVersion(int v){
@@ -445,10 +833,12 @@ class VersionManager {
 
                 // 1. 将 <h256, 0> 插入 m_cache
                 // 2. 解析每个字符串 RLP，处理指向的节点
+                // 整批持写锁，读取方不会看到只更新了一半的版本差
+                WriteGuard l(m_store.mutex());
                 for (const auto& pair : batch) {
                     auto hash = pair.first;
                 
-                    m_cache[hash] = 0; // 插入到 m_cache，版本差为 0
+                    m_cache.push_back(make_pair(hash, 0)); // 插入到 m_cache，版本差为 0
                     auto rlpStr = pair.second;
                     try {
                         // 将字符串 RLP 转换为 RLP 对象
@@ -460,9 +850,7 @@ class VersionManager {
                                 continue;
                             }
                             auto childHash = rlp[1].toHash<h256>();
-                            if(m_nodeVersions.find(childHash) != m_nodeVersions.end()){
-                                ++m_nodeVersions[childHash];
-                            }
+                            incVersion(childHash);
                         }
                         else{
                             // 遍历 RLP 的所有子节点哈希
@@ -472,9 +860,7 @@ class VersionManager {
                                 h256 childHash = rlp[i].toHash<h256>(); // 获取子节点哈希
 
                                 // 如果子节点哈希存在于 m_nodeVersions 中，增加版本差值
-                                if (m_nodeVersions.find(childHash) != m_nodeVersions.end()) {
-                                    ++m_nodeVersions[childHash];
-                                }
+                                incVersion(childHash);
                             }
                         }
                     }catch (const std::exception& ex) {
@@ -483,7 +869,7 @@ class VersionManager {
                     }
                 }
                 // 将 cache 的数据合并
-                updataVersion();
+                mergeCachedVersions();
             }
 
             void processElement(const h256& hash, const std::string& rlpStr) {
@@ -499,9 +885,7 @@ class VersionManager {
                             // continue;
                         }
                         auto childHash = rlp[1].toHash<h256>();
-                        if(m_nodeVersions.find(childHash) != m_nodeVersions.end()){
-                            ++m_nodeVersions[childHash];
-                        }
+                        bumpVersion(childHash);
                     }
                     else{
                         // 遍历 RLP 的所有子节点哈希
@@ -511,9 +895,7 @@ class VersionManager {
                             h256 childHash = rlp[i].toHash<h256>(); // 获取子节点哈希
 
                             // 如果子节点哈希存在于 m_nodeVersions 中，增加版本差值
-                            if (m_nodeVersions.find(childHash) != m_nodeVersions.end()) {
-                                ++m_nodeVersions[childHash];
-                            }
+                            bumpVersion(childHash);
                         }
                     }
                 }catch (const std::exception& ex) {
@@ -526,95 +908,286 @@ class VersionManager {
             }
 
             void printManager(){
-                for(const auto& pair : m_nodeVersions){
-                    cout << "Node Hash [" << pair.first << "] VersionDiff [" << pair.second << endl;
-                }
+                ReadGuard l(m_store.mutex());
+                m_store.forEach([](h256 const& hash, NodeEntry const& e){
+                    if(e.hasVersion()){
+                        cout << "Node Hash [" << hash << "] VersionDiff [" << e.m_version << endl;
+                    }
+                });
             }
 
             void setStatePartition(StatePartition sp){
                 this->sp = sp;
             }
-            // 定位状态信息
-            string node(h256 hash){
-                auto it = dataSet.find(hash);
-                string str;
+            // 定位状态信息，只读取 m_store / m_db，计数写入调用方的 ctx，可并发调用（读取 m_store 时持读锁，与区块提交互斥）
+            string node(h256 const& hash, ReadContext& ctx) const {
+                ctx.nodes_fetched++;
                 // Is history read?
                 // if(least_state != nullptr){
                 //     auto it = std::find(least_state->begin(), least_state->end(), hash);
                 //     if(it == least_state->end()){
                 //         // can not find in least mpt
                 //         // cout << "Can not find: " << hash << endl;
-                //         execution_remote_read++;
+                //         ctx.execution_remote_read++;
                 //     }
                 // }
                 // find in cache
-                if(it != dataSet.end()){
-                    str = (it -> second).first;
-                    auto meta = (it -> second).second;
-                    auto num = meta.getNodeNum();
-                    // remote read times
-                    if(current_read != num){
-                        if(current_read != -1){
-                            // std::this_thread::sleep_for(std::chrono::microseconds(10000 * 2));
-                            // cout << "Cross node reading ...... sleep 0.06ms "; microseconds(60 * 2)
-                        }
-                        current_read = num;
-                        read_count++;
+                {
+                    ReadGuard l(m_store.mutex());
+                    auto e = m_store.find(hash);
+                    countRead(e, ctx);
+                    if(e && e->hasValue()){
+                        return m_store.value(*e);
                     }
                 }
-                else{ // find in disk
-                    // cout <<"Entry DB Lookup" << endl;
-                    str = m_db->lookup(hash);
-                    // cout << str << endl;
-                    auto meta = (it -> second).second;
-                    auto num = meta.getNodeNum();
-                    // remote read times
-                    if(current_read != num){
-                        if(current_read != -1){
-                            // std::this_thread::sleep_for(std::chrono::microseconds(10000 * 2));
-                            // cout << "Cross node reading ...... sleep 0.06ms "; microseconds(60 * 2)
-                        }
-                        current_read = num;
-                        read_count++;
-                    }
+                // find in disk
+                // cout <<"Entry DB Lookup" << endl;
+                return m_db->lookup(hash);
+            }
+
+            // 取出预解码的节点，命中缓存时不再拷贝和解析 RLP（跨节点读取仍照常计数）
+            DecodedNodePtr decodedNode(h256 const& hash, ReadContext& ctx) const {
+                DecodedNodePtr n;
+                if(m_nodeCache.get(hash, n)){
+                    ctx.cache_hits++;
+                    countRead(hash, ctx);
+                    return n;
                 }
+                n = std::make_shared<DecodedNode>(node(hash, ctx));
+                if(!n->raw.empty()){
+                    m_nodeCache.put(hash, n);
+                }
+                return n;
+            }
+
+            string node(h256 hash){
+                ReadContext ctx = legacyContext();
+                auto str = node(hash, ctx);
+                storeLegacyContext(ctx);
                 return str;
             }
 
-            void at(h256 _k, h256 root) {    
+            // 查找 _k 对应的 value，可从多个线程同时调用（每个线程使用自己的 ctx）
+            string at(h256 const& _k, h256 const& root, ReadContext& ctx) const {
                 // auto n = NibbleSlice(b);
-                auto rlt = atAux(RLP(node(root)), bytesConstRef((byte const*)&_k, sizeof(_k)));
+                auto rootNode = decodedNode(root, ctx);
+                auto rlt = atNode(*rootNode, bytesConstRef((byte const*)&_k, sizeof(_k)), ctx);
                 // cout << "at rlt = " << RLP(rlt) << std::endl;
                 // 执行时远程读归零
+                ctx.execution_remote_read = 0;
+                return rlt;
+            }
+
+            void at(h256 _k, h256 root) {
+                ReadContext ctx = legacyContext();
+                at(_k, root, ctx);
+                storeLegacyContext(ctx);
                 execution_remote_read = 0;
             }
 
-            string atAux(RLP _here, NibbleSlice _key){
+            /**
+            * @brief 批量查找
+            *
+            * keys 按 nibble 路径排序后从根向下只走一遍：branch 节点按下一个 nibble 把 key 集合切成连续的若干段，
+            * extension 节点整段下沉，每个节点在一次批量查找中最多被取出并 RLP 解码一次。
+            * 子树中的 key 足够多时，branch 的各个分支交给 tbb 并行处理，每个任务使用独立的 ReadContext，结束后汇总到 ctx。
+            *
+            * @return 与 keys 顺序一致的 value，找不到为空串
+            */
+            vector<string> multiGet(vector<h256> const& keys, h256 const& root, ReadContext& ctx) const {
+                vector<BatchItem> items(keys.size());
+                for(size_t i = 0; i < keys.size(); i++){
+                    items[i].key = NibbleSlice(bytesConstRef(keys[i].data(), h256::size));
+                    items[i].index = i;
+                }
+                std::sort(items.begin(), items.end(), [&](BatchItem const& a, BatchItem const& b){
+                    return keys[a.index] < keys[b.index];
+                });
+
+                vector<string> rlt(keys.size());
+                if(items.empty()){
+                    return rlt;
+                }
+                auto rootNode = decodedNode(root, ctx);
+                batchAux(*rootNode, items.data(), items.data() + items.size(), rlt, ctx);
+                ctx.execution_remote_read = 0;
+                return rlt;
+            }
+
+            /**
+            * @brief 设置本节点编号与发往其他节点的传输方式后，distributedAt 只在本地读取本节点分区内的 MPT 节点
+            *
+            * @param prefetch_bytes 每次跨分区请求时让对端额外返回的节点字节数上限，0 表示不预取
+            * @param speculative_bytes 一次查找 / 一个批次中缓存预取节点的字节数上限
+            */
+            void setDistributed(int local_node, TrieWalkTransport transport, size_t prefetch_bytes = 0,
+                size_t speculative_bytes = c_speculativeBytes){
+                m_localNode = local_node;
+                m_transport = transport;
+                m_prefetchBytes = prefetch_bytes;
+                m_speculativeBytes = speculative_bytes;
+            }
+
+            int localNode() const { return m_localNode; }
+
+            // MPT 节点所属的节点，没有 metadata 时返回 -1
+            int ownerOf(h256 const& hash) const {
+                ReadGuard l(m_store.mutex());
+                auto e = m_store.find(hash);
+                return e && e->isInit() ? e->m_meta.getNodeNum() : -1;
+            }
+
+            /**
+            * @brief 服务端遍历：以 local_node 的身份从 req.node 继续查找 req.key
+            *
+            * 起点总是在本地读取；之后遇到属于其他节点的子节点时停止并返回 Redirect，local_node 为 -1 时全部在本地读取。
+            * 读取过的节点原始 RLP 按顺序放入 proof（with_proof 为 false 时不收集）。
+            */
+            TrieWalkResult walk(TrieWalkRequest const& req, int local_node, ReadContext& ctx, bool with_proof = true) const {
+                TrieWalkResult res;
+                auto lookup = [this, &ctx](h256 const& hash){ return decodedNode(hash, ctx); };
+                auto locate = [this, local_node](h256 const& hash){
+                    int owner = ownerOf(hash);
+                    return local_node < 0 || owner < 0 || owner == local_node ? -1 : owner;
+                };
+                walkFrom(req, lookup, locate, with_proof, res);
+                if(req.frontier_bytes > 0 && res.status != TrieWalkResult::Failed){
+                    collectFrontier(req, lookup, locate, res);
+                }
+                return res;
+            }
+
+            /**
+            * @brief 用结果中的证明重放遍历，结论（状态、value、下一段起点）一致才算通过
+            *
+            * 证明中缺少的节点在重放时视为跨分区，因此对端省略了路径上的节点时，重放得到的是 Redirect 而不是 Found。
+            */
+            bool verifyWalk(TrieWalkRequest const& req, TrieWalkResult const& res) const {
+                if(res.status == TrieWalkResult::Failed){
+                    return false;
+                }
+                std::unordered_map<h256, DecodedNodePtr> nodes;
+                for(auto const& p : res.proof){
+                    nodes[sha3(p)] = std::make_shared<DecodedNode>(std::string(p.begin(), p.end()));
+                }
+                auto lookup = [&nodes](h256 const& hash){
+                    auto it = nodes.find(hash);
+                    return it == nodes.end() ? DecodedNodePtr() : it->second;
+                };
+                auto locate = [&nodes, &res](h256 const& hash){ return nodes.count(hash) ? -1 : res.owner; };
+                TrieWalkResult replay;
+                walkFrom(req, lookup, locate, false, replay);
+                if(replay.status != res.status || replay.value != res.value){
+                    return false;
+                }
+                return res.status != TrieWalkResult::Redirect || (replay.next == res.next && replay.depth == res.depth);
+            }
+
+            /**
+            * @brief 分布式查找
+            *
+            * 本节点分区内的部分在本地遍历；跨入其他节点的分区时把剩余的遍历交给该节点（每跨一次分区一次往返），
+            * 返回的结果用其证明校验后继续。未设置传输方式或本节点编号为 -1 时与 at 相同，全部在本地读取。
+            * 开启预取时，跨分区请求的结果（路径及对端预取的节点）放入 speculative，之后走到其中的节点时在本地继续。
+            *
+            * @param proof 非空时依次追加各段遍历读取过的节点
+            * @param speculative 批量查找共用的预取节点，为空时只在本次查找内缓存
+            * @return value，找不到、请求失败或校验失败时为空串
+            */
+            string distributedAt(h256 const& key, h256 const& root, ReadContext& ctx, std::vector<bytes>* proof = nullptr,
+                SpeculativeNodes* speculative = nullptr) const {
+                std::unique_ptr<SpeculativeNodes> own;
+                if(!speculative && m_prefetchBytes > 0){
+                    own.reset(new SpeculativeNodes(m_speculativeBytes));
+                    speculative = own.get();
+                }
+                TrieWalkRequest req;
+                req.node = root;
+                req.key = key;
+                // 每段至少匹配一个 nibble，段数不超过 key 的 nibble 数
+                for(unsigned hop = 0; hop <= h256::size * 2; hop++){
+                    TrieWalkResult res;
+                    int owner = ownerOf(req.node);
+                    if(!m_transport || m_localNode < 0 || owner < 0 || owner == m_localNode){
+                        res = walk(req, m_transport ? m_localNode : -1, ctx, proof != nullptr);
+                    }
+                    else if(!speculativeWalk(req, speculative, proof != nullptr, res)){
+                        ctx.remote_hops++;
+                        countRead(req.node, ctx);
+                        req.frontier_bytes = speculative ? m_prefetchBytes : 0;
+                        res = TrieWalkResult();
+                        if(!m_transport(owner, req, res) || !verifyWalk(req, res)){
+                            return std::string();
+                        }
+                        if(speculative){
+                            keepSpeculative(res, *speculative, ctx);
+                        }
+                    }
+                    else{
+                        ctx.speculative_hits++;
+                    }
+                    if(proof){
+                        proof->insert(proof->end(), res.proof.begin(), res.proof.end());
+                    }
+                    if(res.status != TrieWalkResult::Redirect){
+                        return res.status == TrieWalkResult::Found ? res.value : std::string();
+                    }
+                    if(res.next == req.node){
+                        return std::string();
+                    }
+                    req.node = res.next;
+                    req.depth = res.depth;
+                }
+                return std::string();
+            }
+
+            /**
+            * @brief 批量分布式查找，各个 key 共用一份预取节点
+            *
+            * key 按 nibble 路径排序后依次查找，相邻的 key 共享前缀，前一个 key 预取到的子树多半还在缓存中。
+            *
+            * @return 与 keys 顺序一致的 value，找不到为空串
+            */
+            vector<string> distributedMultiGet(vector<h256> const& keys, h256 const& root, ReadContext& ctx) const {
+                vector<size_t> order(keys.size());
+                for(size_t i = 0; i < keys.size(); i++){
+                    order[i] = i;
+                }
+                std::sort(order.begin(), order.end(), [&](size_t a, size_t b){ return keys[a] < keys[b]; });
+                SpeculativeNodes speculative(m_speculativeBytes);
+                vector<string> rlt(keys.size());
+                for(auto i : order){
+                    rlt[i] = distributedAt(keys[i], root, ctx, nullptr, m_prefetchBytes > 0 ? &speculative : nullptr);
+                }
+                return rlt;
+            }
+
+            string atAux(RLP _here, NibbleSlice _key, ReadContext& ctx) const {
+                DecodedNode here(_here.data());
+                return atNode(here, _key, ctx);
+            }
+
+            string atNode(DecodedNode const& _here, NibbleSlice _key, ReadContext& ctx) const {
                 // std::cout << "---Entry func atAux---Finding key word: " << _key <<std::endl;
-                // std::cout << "isEmpty?" << _here.isEmpty() 
-                //     << "isNull?" << _here.isNull() <<std::endl;
                 
-                if (_here.isEmpty() || _here.isNull())
+                if (_here.itemCount == 0)
                     // not found.
                     return std::string();
-                unsigned itemCount = _here.itemCount();
-                assert(_here.isList() && (itemCount == 2 || itemCount == 17));
 
-                if (itemCount == 2)
+                if (_here.itemCount == 2)
                 {
                     // std::cout << "2=: " << _key <<std::endl;
-                    auto k = keyOf(_here);
+                    auto k = _here.key;
                     // std::cout << "  k   = " << k << endl;
                     // std::cout << " _key = " << _key << endl;
-                    if (_key == k && isLeaf(_here)){
+                    if (_key == k && _here.leaf){
                         // reached leaf and it's us
                         // cout << "leaf here :" << _here << endl;
-                        return _here[1].toString();
+                        return _here.item(1).toString();
                     }
-                    else if (_key.contains(k) && !isLeaf(_here))
+                    else if (_key.contains(k) && !_here.leaf)
                         // not yet at leaf and it might yet be us. onwards...
-                        return atAux(_here[1].isList() ? _here[1] : RLP(node(_here[1].toHash<h256>())),
-                            _key.mid(k.size()));
+                        return atChild(_here.items[1], _key.mid(k.size()), ctx);
                     else{
                         // not us.
                         // cout << " not us ? yes" <<endl;
@@ -625,15 +1198,21 @@ class VersionManager {
                 {
                     // std::cout << "17=: " << _key <<std::endl;
                     if (_key.size() == 0)
-                        return _here[16].toString();
-                    auto n = _here[_key[0]];
-                    if (n.isEmpty())
+                        return _here.item(16).toString();
+                    if (_here.item(_key[0]).isEmpty())
                         return std::string();
                     else
-                        return atAux(n.isList() ? n : RLP(node(n.toHash<h256>())), _key.mid(1));
+                        return atChild(_here.items[_key[0]], _key.mid(1), ctx);
                 }
             }
 
+            string atAux(RLP _here, NibbleSlice _key){
+                ReadContext ctx = legacyContext();
+                auto rlt = atAux(_here, _key, ctx);
+                storeLegacyContext(ctx);
+                return rlt;
+            }
+
             // h256 recoverData(h256 target, NodeMetadata meta, BMT bmt){
             //     auto offset = meta.m_offset;
             //     auto len = meta.getDataLength() + meta.getMetaSize();
@@ -651,22 +1230,26 @@ class VersionManager {
             // }
 
             void printDataSet(){
-                for(auto t : dataSet){
-                    cout<< "hash:" << t.first
-                        << "value:" << RLP(t.second.first) << endl;
-                }
+                ReadGuard l(m_store.mutex());
+                m_store.forEach([this](h256 const& hash, NodeEntry const& e){
+                    if(e.hasValue()){
+                        cout<< "hash:" << hash
+                            << "value:" << RLP(m_store.valueRef(e)) << endl;
+                    }
+                });
             }
 
             StatePartition getStatePartition(){ return sp; }
 
             VersionManager() = default;
         
-            unordered_map<h256, int> m_nodeVersions;
-            unordered_map<h256, int> m_cache;
+            // 版本差、value、metadata、初始化标记以及子节点 metadata 都存放在 m_store 中
+            NodeStore m_store;
+            // 预解码节点缓存，节点内容寻址，跨查找、跨版本共享
+            mutable ShardedCache<h256, DecodedNodePtr> m_nodeCache{c_nodeCacheSize};
+            vector<pair<h256, int>> m_cache; // 本批次待合并的版本差
             int m_currentVersion;
             StatePartition sp;
-            unordered_map<h256, pair<std::string, NodeMetadata>> dataSet; // hash 值其对应的 value 和 metadata
-            unordered_map<h256, bool> dataSet_init;
             size_t execution_remote_read = 0;
 
             vector<h256>* least_state = nullptr;
@@ -684,33 +1267,376 @@ class VersionManager {
             //     }
             // }
 
-            unordered_map<h256, string> dataWithchildsNodeMetadata;
-
             int current_read = -1; // 记录现在正在遍历MPT节点属于的节点
             int read_count = 0; // 记录遍历过程访问了多少个节点
+            int m_localNode = -1; // 本节点编号（分布式查找）
+            TrieWalkTransport m_transport; // 把遍历请求发给其他节点
+            size_t m_prefetchBytes = 0; // 跨分区请求时的预取预算
+            size_t m_speculativeBytes = c_speculativeBytes; // 预取节点缓存的上限
             size_t not_in_cache = 0; // 记录访问了多少个 不再当前状态树 的节点
             OverlayDB *m_db = nullptr; // state DB for versionmanager
             void initDB(OverlayDB& db){
                 m_db = &db;
             }
 
+        private:
+            static const size_t c_multiGetGrain = 64; // 子树中的 key 至少这么多时才并行展开
+            static const size_t c_nodeCacheSize = 1 << 16; // 预解码节点缓存的条目数
+            static const size_t c_speculativeBytes = 8 << 20; // 预取节点缓存的默认字节数
+            static const size_t c_maxFrontierBytes = 1 << 20; // 响应其他节点时最多预取的字节数
+
+            struct BatchItem {
+                NibbleSlice key; // 尚未匹配的 nibble 路径
+                size_t index = 0; // 在 keys 中的位置
+            };
+
+            struct BatchGroup {
+                bytesConstRef child; // branch 中对应分支的 RLP 片段
+                BatchItem* begin;
+                BatchItem* end;
+            };
+
+            ReadContext legacyContext() const {
+                ReadContext ctx;
+                ctx.current_read = current_read;
+                ctx.read_count = read_count;
+                ctx.execution_remote_read = execution_remote_read;
+                return ctx;
+            }
+
+            void storeLegacyContext(ReadContext const& ctx){
+                current_read = ctx.current_read;
+                read_count = ctx.read_count;
+                execution_remote_read = ctx.execution_remote_read;
+            }
+
+            void countRead(h256 const& hash, ReadContext& ctx) const {
+                ReadGuard l(m_store.mutex());
+                countRead(m_store.find(hash), ctx);
+            }
+
+            // 只有记录过 metadata 的节点才能知道其所属节点，调用方持有 m_store 的读锁
+            void countRead(NodeEntry const* e, ReadContext& ctx) const {
+                if(!e){
+                    return;
+                }
+                int num = e->m_meta.getNodeNum();
+                // remote read times
+                if(ctx.current_read != num){
+                    if(ctx.current_read != -1){
+                        // std::this_thread::sleep_for(std::chrono::microseconds(10000 * 2));
+                        // cout << "Cross node reading ...... sleep 0.06ms "; microseconds(60 * 2)
+                    }
+                    ctx.current_read = num;
+                    ctx.read_count++;
+                }
+            }
+
+            // 内联的子节点就地解码，否则按 hash 取出（优先走缓存）后继续向下
+            string atChild(bytesConstRef child, NibbleSlice _key, ReadContext& ctx) const {
+                RLP r(child);
+                if(r.isList()){
+                    DecodedNode n(child);
+                    return atNode(n, _key, ctx);
+                }
+                auto n = decodedNode(r.toHash<h256>(), ctx);
+                return atNode(*n, _key, ctx);
+            }
+
+            /**
+            * @brief 遍历的公共部分，服务端遍历与证明重放共用
+            *
+            * lookup 按 hash 取出节点，取不到返回空指针；locate 返回 -1 表示在本地读取，否则为跨入的节点编号。
+            */
+            template <class Lookup, class Locate>
+            void walkFrom(TrieWalkRequest const& req, Lookup& lookup, Locate& locate, bool with_proof, TrieWalkResult& res) const {
+                auto n = lookup(req.node);
+                if(!n || n->raw.empty()){
+                    res.status = TrieWalkResult::Failed;
+                    return;
+                }
+                if(with_proof){
+                    res.proof.push_back(bytes(n->raw.begin(), n->raw.end()));
+                }
+                NibbleSlice key(bytesConstRef(req.key.data(), h256::size));
+                walkNode(*n, key.mid(req.depth), req.depth, lookup, locate, with_proof, res);
+            }
+
+            /**
+            * @brief 从 req.node 开始按层序收集 locate 判为本地的节点，放入 res.frontier，总字节数不超过预算
+            *
+            * 已在 proof 中的节点不重复放入，但仍向下展开。
+            */
+            template <class Lookup, class Locate>
+            void collectFrontier(TrieWalkRequest const& req, Lookup& lookup, Locate& locate, TrieWalkResult& res) const {
+                size_t budget = req.frontier_bytes < c_maxFrontierBytes ? req.frontier_bytes : c_maxFrontierBytes;
+                std::unordered_set<h256> in_proof;
+                for(auto const& p : res.proof){
+                    in_proof.insert(sha3(p));
+                }
+                std::unordered_set<h256> visited{req.node};
+                std::deque<DecodedNodePtr> queue;
+                auto start = lookup(req.node);
+                if(!start || start->raw.empty()){
+                    return;
+                }
+                queue.push_back(start);
+                size_t used = 0;
+                bool full = false;
+                auto visit = [&](h256 const& hash){
+                    if(full || locate(hash) >= 0 || !visited.insert(hash).second){
+                        return;
+                    }
+                    auto n = lookup(hash);
+                    if(!n || n->raw.empty()){
+                        return;
+                    }
+                    if(!in_proof.count(hash)){
+                        if(used + n->raw.size() > budget){
+                            full = true;
+                            return;
+                        }
+                        used += n->raw.size();
+                        res.frontier.push_back(bytes(n->raw.begin(), n->raw.end()));
+                    }
+                    queue.push_back(n);
+                };
+                while(!queue.empty() && !full){
+                    auto n = queue.front();
+                    queue.pop_front();
+                    forEachChild(*n, visit);
+                }
+            }
+
+            // 对节点的每个 hash 引用的子节点调用 f，内联的子节点展开
+            template <class F>
+            void forEachChild(DecodedNode const& n, F& f) const {
+                if(n.itemCount == 2){
+                    if(!n.leaf){
+                        forEachChildRef(n.items[1], f);
+                    }
+                    return;
+                }
+                if(n.itemCount == 17){
+                    for(unsigned i = 0; i < 16; i++){
+                        if(!n.item(i).isEmpty()){
+                            forEachChildRef(n.items[i], f);
+                        }
+                    }
+                }
+            }
+
+            template <class F>
+            void forEachChildRef(bytesConstRef child, F& f) const {
+                RLP r(child);
+                if(r.isList()){
+                    DecodedNode n(child);
+                    forEachChild(n, f);
+                    return;
+                }
+                f(r.toHash<h256>());
+            }
+
+            /**
+            * @brief 用预取的节点在本地从 req.node 继续遍历
+            *
+            * 走到未预取的节点时返回 Redirect，交给其所属节点（没有 metadata 的节点视为本节点，下一段在本地读取）。
+            * @return false 表示 req.node 不在预取节点中（或已被淘汰），需要发请求
+            */
+            bool speculativeWalk(TrieWalkRequest const& req, SpeculativeNodes* speculative, bool with_proof,
+                TrieWalkResult& res) const {
+                if(!speculative || !speculative->nodes.contains(req.node)){
+                    return false;
+                }
+                auto lookup = [speculative](h256 const& hash){
+                    DecodedNodePtr n;
+                    speculative->nodes.get(hash, n);
+                    return n;
+                };
+                auto locate = [this, speculative](h256 const& hash){
+                    if(speculative->nodes.contains(hash)){
+                        return -1;
+                    }
+                    int owner = ownerOf(hash);
+                    return owner < 0 ? m_localNode : owner;
+                };
+                res = TrieWalkResult();
+                walkFrom(req, lookup, locate, with_proof, res);
+                return res.status != TrieWalkResult::Failed;
+            }
+
+            // 把经过校验的结果中的路径节点与预取节点放入 speculative
+            void keepSpeculative(TrieWalkResult const& res, SpeculativeNodes& speculative, ReadContext& ctx) const {
+                for(auto const& p : res.proof){
+                    speculative.nodes.put(sha3(p), std::make_shared<DecodedNode>(std::string(p.begin(), p.end())));
+                }
+                for(auto const& f : res.frontier){
+                    speculative.nodes.put(sha3(f), std::make_shared<DecodedNode>(std::string(f.begin(), f.end())));
+                    ctx.prefetched_nodes++;
+                }
+            }
+
+            template <class Lookup, class Locate>
+            void walkNode(DecodedNode const& here, NibbleSlice key, unsigned depth, Lookup& lookup, Locate& locate,
+                bool with_proof, TrieWalkResult& res) const {
+                res.status = TrieWalkResult::NotFound;
+                if(here.itemCount == 0){
+                    return;
+                }
+                if(here.itemCount == 2){
+                    auto k = here.key;
+                    if(key == k && here.leaf){
+                        res.status = TrieWalkResult::Found;
+                        res.value = here.item(1).toString();
+                    }
+                    else if(key.contains(k) && !here.leaf){
+                        walkChild(here.items[1], key.mid(k.size()), depth + k.size(), lookup, locate, with_proof, res);
+                    }
+                    return;
+                }
+                if(key.size() == 0){
+                    res.value = here.item(16).toString();
+                    res.status = res.value.empty() ? TrieWalkResult::NotFound : TrieWalkResult::Found;
+                    return;
+                }
+                if(!here.item(key[0]).isEmpty()){
+                    walkChild(here.items[key[0]], key.mid(1), depth + 1, lookup, locate, with_proof, res);
+                }
+            }
+
+            template <class Lookup, class Locate>
+            void walkChild(bytesConstRef child, NibbleSlice key, unsigned depth, Lookup& lookup, Locate& locate,
+                bool with_proof, TrieWalkResult& res) const {
+                RLP r(child);
+                if(r.isList()){
+                    DecodedNode n(child);
+                    walkNode(n, key, depth, lookup, locate, with_proof, res);
+                    return;
+                }
+                auto hash = r.toHash<h256>();
+                int owner = locate(hash);
+                if(owner >= 0){
+                    res.status = TrieWalkResult::Redirect;
+                    res.next = hash;
+                    res.depth = depth;
+                    res.owner = owner;
+                    return;
+                }
+                auto n = lookup(hash);
+                if(!n || n->raw.empty()){
+                    res.status = TrieWalkResult::Failed;
+                    return;
+                }
+                if(with_proof){
+                    res.proof.push_back(bytes(n->raw.begin(), n->raw.end()));
+                }
+                walkNode(*n, key, depth, lookup, locate, with_proof, res);
+            }
+
+            void descend(bytesConstRef child, BatchItem* begin, BatchItem* end, vector<string>& rlt, ReadContext& ctx) const {
+                RLP r(child);
+                if(r.isList()){
+                    DecodedNode n(child);
+                    batchAux(n, begin, end, rlt, ctx);
+                    return;
+                }
+                auto n = decodedNode(r.toHash<h256>(), ctx);
+                batchAux(*n, begin, end, rlt, ctx);
+            }
+
+            // [begin, end) 已按剩余路径排序，且都经过 _here
+            void batchAux(DecodedNode const& _here, BatchItem* begin, BatchItem* end, vector<string>& rlt, ReadContext& ctx) const {
+                if (begin == end || _here.itemCount == 0)
+                    // not found.
+                    return;
+
+                if (_here.itemCount == 2)
+                {
+                    auto k = _here.key;
+                    if (_here.leaf){
+                        for(auto it = begin; it != end; ++it){
+                            if(it->key == k){
+                                rlt[it->index] = _here.item(1).toString();
+                            }
+                        }
+                        return;
+                    }
+                    // 以 k 为前缀的 key 在有序集合中是连续的一段
+                    auto first = begin;
+                    while(first != end && !first->key.contains(k)){
+                        ++first;
+                    }
+                    auto last = first;
+                    while(last != end && last->key.contains(k)){
+                        last->key = last->key.mid(k.size());
+                        ++last;
+                    }
+                    if(first != last){
+                        descend(_here.items[1], first, last, rlt, ctx);
+                    }
+                    return;
+                }
+
+                auto it = begin;
+                for(; it != end && it->key.size() == 0; ++it){
+                    rlt[it->index] = _here.item(16).toString();
+                }
+                vector<BatchGroup> groups;
+                while(it != end){
+                    auto nibble = it->key[0];
+                    auto groupEnd = it;
+                    for(; groupEnd != end && groupEnd->key[0] == nibble; ++groupEnd){
+                        groupEnd->key = groupEnd->key.mid(1);
+                    }
+                    if(!_here.item(nibble).isEmpty()){
+                        groups.push_back(BatchGroup{_here.items[nibble], it, groupEnd});
+                    }
+                    it = groupEnd;
+                }
+
+                if(groups.size() > 1 && size_t(end - begin) >= c_multiGetGrain){
+                    tbb::spin_mutex mergeLock;
+                    tbb::parallel_for(size_t(0), groups.size(), [&](size_t g){
+                        ReadContext local;
+                        local.current_read = ctx.current_read;
+                        descend(groups[g].child, groups[g].begin, groups[g].end, rlt, local);
+                        tbb::spin_mutex::scoped_lock l(mergeLock);
+                        ctx.merge(local);
+                    });
+                }
+                else{
+                    for(auto& g : groups){
+                        descend(g.child, g.begin, g.end, rlt, ctx);
+                    }
+                }
+            }
+
 };
 
 class ChunkBuilder {
 private:
     vector<string> m_data;
-    unordered_map<h256, pair<std::string, NodeMetadata>>& m_dataSet; // <key, <value, NodeMetaData>>
-    unordered_map<h256, bool>& m_dataSet_init;
-    unordered_map<h256, int>& m_nodeVersions;
-    unordered_map<h256, string>& m_dataWithchildsNodeMetadata;
+    NodeStore& m_store; // <key, <value, NodeMetaData, versionDiff, init>>
     unordered_map<h256, h256> fatherMap;
     queue<pair<h256, uint16_t>> ready_node;
     unordered_map<h256, uint16_t> partitions;
     int TotalMetaSize = 0;
 public:
+    // processBatch / handleDataSet / handleDataSetWithReadyQueue 整体持 m_store 的写锁，
+    // 下面几个读取表项的函数只在其中调用
 
-    void setDataSet(unordered_map<h256, pair<std::string, NodeMetadata>>& dataSet){
-        m_dataSet = dataSet;
+    bool isInit(h256 const& hash) const {
+        auto e = m_store.find(hash);
+        return e && e->isInit();
+    }
+
+    // 子节点的 Nodemeta 和 nodeVersion
+    pair<NodeMetadata, int> childMetaAndVersion(h256 const& hash) const {
+        auto e = m_store.find(hash);
+        if(!e){
+            return make_pair(NodeMetadata(), 0);
+        }
+        return make_pair(e->m_meta, e->hasVersion() ? e->m_version : 0);
     }
 
     string serializeMetadata(const NodeMetadata& metadata) {
@@ -795,6 +1721,7 @@ public:
     }
     
     vector<string> handleDataSet(unordered_map<h256, uint16_t> partitions, int cnt){
+        WriteGuard l(m_store.mutex());
         
         // 所有元素和其分组压入 partitions 
         // unordered_map<h256, uint16_t> partitions;
@@ -816,8 +1743,14 @@ public:
                 
                 auto hash = it->first; 
                 auto group = it->second; // 所属节点编号 
-                auto value = m_dataSet[hash].first;
-                auto& meta = m_dataSet[hash].second;
+                auto entry = m_store.find(hash);
+                if(!entry){
+                    // 没有版本记录的节点不会写入 chunk
+                    it = partitions.erase(it);
+                    continue;
+                }
+                auto value = m_store.value(*entry);
+                auto& meta = entry->m_meta;
                 
                 
                 // cout << "Handledataset hash:" << hash 
@@ -842,7 +1775,7 @@ public:
                     // cout << "succees insert leaf:" << hash;
                     // meta.printNodeMetadata();
 
-                    m_dataSet_init[hash] = true;
+                    entry->setInit(true);
                     it = partitions.erase(it);
                     continue;
                 }
@@ -854,7 +1787,7 @@ public:
                         auto childHash = rlp[1].toHash<h256>();
                         // cout << "We are detect(cnt=2) " << childHash << endl;
                         // 如果子节点哈希 不 存在于 doneset 这意味着其 Metadata并没有初始化好，直接中止操作
-                        if (m_dataSet_init[childHash] != true) {
+                        if (!isInit(childHash)) {
                             // cout << "Not in " << childHash << endl;
                             childrenMeta.clear();
                             can_build = false;
@@ -862,7 +1795,7 @@ public:
                         }
                         else{
                             // 将对应子节点的 Nodemeta 和 nodeVersion 塞进一个 tmp 中
-                            auto tmp = make_pair(m_dataSet[childHash].second, m_nodeVersions[childHash]);
+                            auto tmp = childMetaAndVersion(childHash);
                             childrenMeta.push_back(tmp);
                         }
                     }
@@ -873,7 +1806,7 @@ public:
                             h256 childHash = rlp[i].toHash<h256>(); // 获取子节点哈希
                             // cout << "We are detect(cnt=n) " << childHash << endl;
                             // 如果子节点哈希 不 存在于 doneset 这意味着其 Metadata并没有初始化好，直接中止操作
-                            if (m_dataSet_init[childHash] != true) {
+                            if (!isInit(childHash)) {
                                 // cout << "Not in   " << childHash << endl;
                                 childrenMeta.clear();
                                 can_build = false;
@@ -881,7 +1814,7 @@ public:
                             }
                             else{
                                 // 将对应子节点的 Nodemeta 和 nodeVersion 塞进一个 tmp 中
-                                auto tmp = make_pair(m_dataSet[childHash].second, m_nodeVersions[childHash]);
+                                auto tmp = childMetaAndVersion(childHash);
                                 childrenMeta.push_back(tmp);
                             }
                         }
@@ -921,12 +1854,12 @@ public:
                         
                         // 成功插入一个 hash
                         // cout << "succees insert No-leaf:" << hash;
-                        m_dataWithchildsNodeMetadata[hash] = str;
+                        m_store.setChildMeta(*entry, str);
                         // meta.printNodeMetadata();
                         
 
                         // 插入以后 该数据的 metaData也是可以使用了
-                        m_dataSet_init[hash] = true;
+                        entry->setInit(true);
                         it = partitions.erase(it);
                         continue;
                     }
@@ -967,8 +1900,11 @@ public:
         }
 
         auto hash = fatherMap[_hash];
-        auto value = m_dataSet[hash].first;
-        auto& meta = m_dataSet[hash].second;
+        auto entry = m_store.find(hash);
+        if(!entry){
+            return false;
+        }
+        auto value = m_store.value(*entry);
         RLP rlp(value);
         // cout << "Checking Father:" << rlp.itemCount() << endl;
         
@@ -978,7 +1914,7 @@ public:
             h256 childHash = rlp[i].toHash<h256>(); // 获取子节点哈希
             // cout << "We are detect(cnt=" << i << ") " << childHash << endl;
             // 如果子节点哈希 不 存在于 doneset 这意味着其 Metadata并没有初始化好，直接中止操作
-            if (m_dataSet_init[childHash] != true) {
+            if (!isInit(childHash)) {
                 // cout << "Not in " << childHash << endl;
                 // return false;
             }
@@ -989,6 +1925,7 @@ public:
     }
 
     vector<string> handleDataSetWithReadyQueue(int cnt){
+        WriteGuard l(m_store.mutex());
         
         // 初始化每个分组对应的 chunk 
         vector<string> parts(cnt);
@@ -1001,8 +1938,12 @@ public:
                 ready_node.pop();
                 auto hash = it.first; 
                 auto group = it.second; // 所属节点编号 
-                auto value = m_dataSet[hash].first;
-                auto& meta = m_dataSet[hash].second;
+                auto entry = m_store.find(hash);
+                if(!entry){
+                    continue;
+                }
+                auto value = m_store.value(*entry);
+                auto& meta = entry->m_meta;
                 
                 
                 // cout << "+++++++++++++   Handledataset hash:" << hash 
@@ -1026,7 +1967,7 @@ public:
                     // cout << "succees insert leaf:" << hash;
                     // meta.printNodeMetadata();
 
-                    m_dataSet_init[hash] = true;
+                    entry->setInit(true);
                     // it = partitions.erase(it);
                     // partitions.erase(hash);
                     // continue;
@@ -1039,7 +1980,7 @@ public:
                         auto childHash = rlp[1].toHash<h256>();
                         // cout << "We are detect(cnt=2) " << childHash << endl;
                         // 如果子节点哈希 不 存在于 doneset 这意味着其 Metadata并没有初始化好，直接中止操作
-                        if (m_dataSet_init[childHash] != true) {
+                        if (!isInit(childHash)) {
                             // cout << "Not in " << childHash << endl;
                             childrenMeta.clear();
                             can_build = false;
@@ -1047,7 +1988,7 @@ public:
                         }
                         else{
                             // 将对应子节点的 Nodemeta 和 nodeVersion 塞进一个 tmp 中
-                            auto tmp = make_pair(m_dataSet[childHash].second, m_nodeVersions[childHash]);
+                            auto tmp = childMetaAndVersion(childHash);
                             childrenMeta.push_back(tmp);
                         }
                     }
@@ -1058,7 +1999,7 @@ public:
                             h256 childHash = rlp[i].toHash<h256>(); // 获取子节点哈希
                             // cout << "We are detect(cnt=n) " << childHash << endl;
                             // 如果子节点哈希 不 存在于 doneset 这意味着其 Metadata并没有初始化好，直接中止操作
-                            if (m_dataSet_init[childHash] != true) {
+                            if (!isInit(childHash)) {
                                 // cout << "Not in   " << childHash << endl;
                                 childrenMeta.clear();
                                 can_build = false;
@@ -1066,7 +2007,7 @@ public:
                             }
                             else{
                                 // 将对应子节点的 Nodemeta 和 nodeVersion 塞进一个 tmp 中
-                                auto tmp = make_pair(m_dataSet[childHash].second, m_nodeVersions[childHash]);
+                                auto tmp = childMetaAndVersion(childHash);
                                 childrenMeta.push_back(tmp);
                             }
                         }
@@ -1100,12 +2041,12 @@ public:
                         
                         // 成功插入一个 hash
                         // cout << "succees insert No-leaf:" << hash;
-                        m_dataWithchildsNodeMetadata[hash] = str;
+                        m_store.setChildMeta(*entry, str);
                         // meta.printNodeMetadata();
                         
 
                         // 插入以后 该数据的 metaData也是可以使用了
-                        m_dataSet_init[hash] = true;
+                        entry->setInit(true);
                         // partitions.erase(hash);
                         // continue; 
                     }
@@ -1155,7 +2096,8 @@ public:
         partitions = _partitions;
     }
 
-    void processBatch(std::unordered_map<h256, std::string> batch, unordered_map<h256, int>& m_nodeVersions) {
+    void processBatch(const std::unordered_map<h256, std::string>& batch) {
+        WriteGuard l(m_store.mutex());
         // 2. 解析每个字符串 RLP，处理指向的节点
         for (const auto& pair : batch) {
             auto hash = pair.first;
@@ -1173,10 +2115,12 @@ public:
                 // }
 
                 // auto childHash = rlp[1].toHash<h256>();
-                if(m_nodeVersions.find(hash) != m_nodeVersions.end()){
+                auto entry = m_store.find(hash);
+                if(entry && entry->hasVersion()){
                     // meta.m_versionDiffs.push_back(m_nodeVersions[hash]);
-                    m_dataSet[hash] = make_pair(rlpStr, meta);
-                    m_dataSet_init[hash] = false;
+                    m_store.setValue(*entry, rlpStr);
+                    entry->m_meta = meta;
+                    entry->setInit(false);
                 }
 
                 // 初始化一个 孩子-父亲 的映射
@@ -1218,14 +2162,15 @@ public:
 
     void printDataSet(){
         cout << "= = = Data Set = = =" << endl;
-        for(auto& ele : m_dataSet){
-            auto hash = ele.first;
-            auto pair = ele.second;
-            auto value = pair.first;
-            auto meta = pair.second;
-            cout << "Hash[" << hash << "]" << " Value[" << dev::RLP(value) << "] ";
+        ReadGuard l(m_store.mutex());
+        m_store.forEach([this](h256 const& hash, NodeEntry const& e){
+            if(!e.hasValue()){
+                return;
+            }
+            auto meta = e.m_meta;
+            cout << "Hash[" << hash << "]" << " Value[" << dev::RLP(m_store.valueRef(e)) << "] ";
             meta.printNodeMetadata();
-        }
+        });
         cout << "= = = = = = = = = =" << endl;
     }
 
@@ -1261,6 +2206,5 @@ public:
     // ChunkBuilder(unordered_map<h256, pair<std::string, NodeMetadata>>& dataSet, unordered_map<h256, bool>& dataSet_init) : 
     //     m_dataSet(dataSet), m_dataSet_init(dataSet_init) {}
 
-    ChunkBuilder(VersionManager& vm) : m_dataSet(vm.dataSet), m_dataSet_init(vm.dataSet_init), 
-        m_nodeVersions(vm.m_nodeVersions), m_dataWithchildsNodeMetadata(vm.dataWithchildsNodeMetadata) {}
+    ChunkBuilder(VersionManager& vm) : m_store(vm.m_store) {}
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+/**
+ * @chunk 帧往返测试
+ *功能包括：
+ * 1. 可压缩的 chunk 以 snappy 模式成帧，不可压缩或关闭压缩时保留原文
+ * 2. 帧末尾的 0 被解码去掉、或被补齐到块长时，unframeChunk 按帧头的长度还原
+ * 3. 空 chunk 与全 0 chunk（解码后帧头也被截短）
+ *
+ * @file chunkframe-roundtrip.cpp
+ * @author qqf
+ * @date 2025-03-26
+ */
+#include "Eurasure.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace dev;
+
+static bool roundTrip(std::string const& chunk, bool compress, int expected_mode, char const* name)
+{
+	bytes frame = ec::Eurasure::frameChunk(bytesConstRef(&chunk), compress);
+	std::string framed(frame.begin(), frame.end());
+	if (frame.size() < 5 || (expected_mode >= 0 && frame[0] != expected_mode))
+	{
+		std::cout << name << ": unexpected frame mode " << (frame.empty() ? -1 : (int)frame[0]) << std::endl;
+		return false;
+	}
+
+	// 编码时帧被补齐到块长
+	std::string padded = framed + std::string(37, '\0');
+	// 解码结果去掉了末尾的 0
+	std::string trimmed = framed;
+	while (!trimmed.empty() && trimmed.back() == '\0')
+		trimmed.pop_back();
+
+	if (ec::Eurasure::unframeChunk(framed) != chunk || ec::Eurasure::unframeChunk(padded) != chunk ||
+		ec::Eurasure::unframeChunk(trimmed) != chunk)
+	{
+		std::cout << name << ": round trip mismatch" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	bool ok = true;
+
+	std::string compressible;
+	for (int i = 0; i < 4096; i++)
+		compressible += "account-" + std::to_string(i % 16);
+
+	std::mt19937 rng(7);
+	std::string random(4096, '\0');
+	for (auto& c : random)
+		c = (char)(rng() & 0xFF);
+
+	std::string zeros_tail = "leaf" + std::string(300, '\0');
+
+	ok = roundTrip(compressible, true, 1, "compressible") && ok;
+	ok = roundTrip(compressible, false, 0, "uncompressed") && ok;
+	ok = roundTrip(random, true, 0, "incompressible") && ok;
+	ok = roundTrip(zeros_tail, false, 0, "trailing zeros") && ok;
+	ok = roundTrip(zeros_tail, true, -1, "trailing zeros compressed") && ok;
+	ok = roundTrip(std::string(), true, 0, "empty") && ok;
+	// 全 0 的原文帧解码后只剩空串
+	ok = roundTrip(std::string(64, '\0'), false, 0, "all zero") && ok;
+	ok = roundTrip(std::string(64, '\0'), true, -1, "all zero compressed") && ok;
+
+	std::cout << (ok ? "chunkframe-roundtrip passed" : "chunkframe-roundtrip failed") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/**
+ * @批量 chunk 响应包的解析测试
+ *功能包括：
+ * 1. SyncECResponseChunksPacket 编码后经 EurasureP2P::parseChunksResponse（processChunksResponse 使用的解析）还原
+ * 2. 每项的 (epoch, group, pos, data)，以及按共享 hashes 还原的默克尔证明
+ * 3. 证明下标越界的项被标记为失败，不影响同包中的其他项
+ *
+ * @file chunkspacket-layout.cpp
+ * @author qqf
+ * @date 2025-03-26
+ */
+#include "Eurasure-P2P.h"
+
+#include <libsync/SyncMsgPacket.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dev;
+using namespace dev::sync;
+
+// 编码并按 SyncMsgPacket::decode 的方式取出包体，返回的 RLP 引用 buffer
+static RLP encodeBody(std::vector<std::vector<unsigned int>> const& ids, std::vector<std::string> const& datas,
+	std::vector<std::vector<unsigned int>> const& proofs, std::vector<std::string> const& hashes,
+	std::shared_ptr<bytes>& buffer)
+{
+	SyncECResponseChunksPacket packet;
+	packet.encode(ids, datas, proofs, hashes);
+	buffer = packet.toMessage(0)->buffer();
+	bytesConstRef frame = ref(*buffer);
+	if (frame.size() < 2 || RLP(frame.cropped(0, 1)).toInt<unsigned>() - c_syncPacketIDBase != ECResponseChunksPacket)
+	{
+		std::cout << "wrong packet id" << std::endl;
+		return RLP();
+	}
+	return RLP(frame.cropped(1));
+}
+
+int main()
+{
+	bool ok = true;
+
+	std::vector<std::vector<unsigned int>> ids = {{3, 1, 0}, {3, 1, 2}, {4, 0, 5}};
+	std::vector<std::string> datas = {std::string(300, 'a'), std::string(64, 'b'), std::string()};
+	std::vector<std::vector<unsigned int>> proofs = {{0, 1}, {1, 2}, {}};
+	std::vector<std::string> hashes = {std::string(32, 'x'), std::string(32, 'y'), std::string(32, 'z')};
+
+	std::shared_ptr<bytes> buffer;
+	RLP body = encodeBody(ids, datas, proofs, hashes, buffer);
+	if (body.itemCount() != 2)
+	{
+		std::cout << "body should be [items, hashes]" << std::endl;
+		return 1;
+	}
+	auto responses = ec::EurasureP2P::parseChunksResponse(body);
+	if (responses.size() != ids.size())
+	{
+		std::cout << "parsed " << responses.size() << " items" << std::endl;
+		return 1;
+	}
+	for (size_t i = 0; i < ids.size(); ++i)
+	{
+		auto const& r = responses[i];
+		std::vector<std::string> merkle_list{datas[i]};
+		for (auto idx : proofs[i])
+			merkle_list.push_back(hashes[idx]);
+		if (!r.ok || r.id.coding_epoch != ids[i][0] || r.id.group_id != ids[i][1] ||
+			r.id.chunk_pos != ids[i][2] || r.merkle_list != merkle_list)
+		{
+			std::cout << "item " << i << " mismatch" << std::endl;
+			ok = false;
+		}
+	}
+
+	// 第二项的证明下标越界
+	std::vector<std::vector<unsigned int>> bad_proofs = {{0}, {0, 3}, {2}};
+	body = encodeBody(ids, datas, bad_proofs, hashes, buffer);
+	responses = ec::EurasureP2P::parseChunksResponse(body);
+	if (responses.size() != ids.size() || !responses[0].ok || responses[1].ok || !responses[2].ok ||
+		responses[2].merkle_list.size() != 2 || responses[2].merkle_list[1] != hashes[2])
+	{
+		std::cout << "out-of-range proof index not isolated" << std::endl;
+		ok = false;
+	}
+
+	std::cout << (ok ? "chunkspacket-layout passed" : "chunkspacket-layout failed") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+/**
+ * @NodeStore 往返测试
+ *功能包括：
+ * 1. 插入足够多的节点触发多次 rehash，之后每个 hash 仍能找到且 value / 版本差 / metadata 不变
+ * 2. 构造前 8 字节相同的 hash，验证线性探测按完整 hash 区分
+ * 3. 同一 hash 重复插入不增加表项，value 只写入一次
+ *
+ * @file nodestore-roundtrip.cpp
+ * @author qqf
+ * @date 2025-03-26
+ */
+#include "NodeStore.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace dev;
+
+static h256 keyOf(unsigned i)
+{
+	// 前缀取 i 的乘法散列，与真实 hash 一样均匀分布
+	uint64_t mixed = (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL;
+	h256 h;
+	for (unsigned j = 0; j < 8; j++)
+		h[j] = (byte)(mixed >> (8 * j));
+	for (unsigned j = 0; j < 4; j++)
+		h[31 - j] = (byte)(i >> (8 * j));
+	return h;
+}
+
+// 前 8 字节全部相同，只有末尾不同
+static h256 collidingKey(unsigned i)
+{
+	h256 h;
+	for (unsigned j = 0; j < 8; j++)
+		h[j] = 0xab;
+	h[31] = (byte)i;
+	h[30] = (byte)(i >> 8);
+	return h;
+}
+
+static std::string valueOf(unsigned i)
+{
+	return "node-" + std::to_string(i) + std::string(i % 7, 'x');
+}
+
+int main()
+{
+	bool ok = true;
+	NodeStore store;
+
+	// 初始容量 1 << 16，负载因子 0.7，200000 个节点会扩容两次
+	const unsigned count = 200000;
+	for (unsigned i = 0; i < count; i++)
+	{
+		WriteGuard l(store.mutex());
+		auto& e = store.insert(keyOf(i));
+		store.setValue(e, valueOf(i));
+		e.setVersion(i % 100);
+		e.m_meta.m_offset = i;
+		e.m_meta.m_node = (uint8_t)(i % 4);
+	}
+	const unsigned collisions = 300;
+	for (unsigned i = 0; i < collisions; i++)
+	{
+		WriteGuard l(store.mutex());
+		auto& e = store.insert(collidingKey(i));
+		store.setValue(e, "collide-" + std::to_string(i));
+	}
+
+	ReadGuard l(store.mutex());
+	if (store.size() != count + collisions)
+	{
+		std::cout << "size " << store.size() << " != " << count + collisions << std::endl;
+		ok = false;
+	}
+	for (unsigned i = 0; i < count && ok; i++)
+	{
+		auto e = store.find(keyOf(i));
+		if (!e || store.value(*e) != valueOf(i) || !e->hasVersion() || e->m_version != (int)(i % 100) ||
+			e->m_meta.m_offset != i || e->m_meta.getNodeNum() != i % 4 || store.key(*e) != keyOf(i))
+		{
+			std::cout << "node " << i << " lost after rehash" << std::endl;
+			ok = false;
+		}
+	}
+	for (unsigned i = 0; i < collisions && ok; i++)
+	{
+		auto e = store.find(collidingKey(i));
+		if (!e || store.value(*e) != "collide-" + std::to_string(i))
+		{
+			std::cout << "colliding node " << i << " not distinguished" << std::endl;
+			ok = false;
+		}
+	}
+	if (store.find(collidingKey(collisions)) || store.find(keyOf(count)))
+	{
+		std::cout << "found a key that was never inserted" << std::endl;
+		ok = false;
+	}
+
+	size_t visited = 0;
+	store.forEach([&](h256 const&, NodeEntry const& e) {
+		if (e.hasValue())
+			++visited;
+	});
+	if (visited != count + collisions)
+	{
+		std::cout << "forEach visited " << visited << std::endl;
+		ok = false;
+	}
+	l.unlock();
+
+	{
+		// 重复插入返回同一表项，value 保持第一次写入的内容
+		WriteGuard w(store.mutex());
+		auto& e = store.insert(keyOf(7));
+		store.setValue(e, "other");
+		if (store.size() != count + collisions || store.value(e) != valueOf(7))
+		{
+			std::cout << "duplicate insert changed the store" << std::endl;
+			ok = false;
+		}
+	}
+
+	std::cout << (ok ? "nodestore-roundtrip passed" : "nodestore-roundtrip failed") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -88,6 +88,10 @@ enum SyncPacketType : byte
     ECReponseChunkPacket = 0x0C,
     ECProofPacket = 0x0D,
     HeartTest = 0x0E,
+    ECRequestChunksPacket = 0x0F,
+    ECResponseChunksPacket = 0x10,
+    ECRequestTrieWalkPacket = 0x11,
+    ECResponseTrieWalkPacket = 0x12,
     PacketCount
 };
 
@@ -205,6 +205,39 @@ void SyncECReponseChunkPacket::encode(
     auto& retRlp = prep(m_rlpStream, ECReponseChunkPacket, 4);
     retRlp << coding_epoch << group_id<<chunk_pos  << merklelist;
 }
+void SyncECRequestChunksPacket::encode(std::vector<std::vector<unsigned int>> const& chunks)
+{
+    m_rlpStream.clear();
+    auto& retRlp = prep(m_rlpStream, ECRequestChunksPacket, 1);
+    retRlp << chunks;
+}
+void SyncECResponseChunksPacket::encode(std::vector<std::vector<unsigned int>> const& ids,
+    std::vector<std::string> const& datas, std::vector<std::vector<unsigned int>> const& proofs,
+    std::vector<std::string> const& hashes)
+{
+    m_rlpStream.clear();
+    auto& retRlp = prep(m_rlpStream, ECResponseChunksPacket, 2);
+    retRlp.appendList(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        retRlp.appendList(5) << ids[i][0] << ids[i][1] << ids[i][2] << datas[i] << proofs[i];
+    }
+    retRlp << hashes;
+}
+void SyncECRequestTrieWalkPacket::encode(
+    h256 const& node, h256 const& key, unsigned int const& depth, size_t const& frontier_bytes)
+{
+    m_rlpStream.clear();
+    auto& retRlp = prep(m_rlpStream, ECRequestTrieWalkPacket, 4);
+    retRlp << node << key << depth << frontier_bytes;
+}
+void SyncECResponseTrieWalkPacket::encode(
+    h256 const& node, h256 const& key, unsigned int const& depth, bytes const& result)
+{
+    m_rlpStream.clear();
+    auto& retRlp = prep(m_rlpStream, ECResponseTrieWalkPacket, 4);
+    retRlp << node << key << depth << result;
+}
 void SyncECProofPacket::encode(unsigned int const& pos,std::string const& proof)
 {
      m_rlpStream.clear();
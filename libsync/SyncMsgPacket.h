@@ -148,6 +148,39 @@ public:
 };
 
 
+// 批量请求：chunks 中每一项为 (coding_epoch, group_id, chunk_pos)
+class SyncECRequestChunksPacket : public SyncMsgPacket
+{
+public:
+    SyncECRequestChunksPacket() { packetType = ECRequestChunksPacket; }
+    void encode(std::vector<std::vector<unsigned int>> const& chunks);
+};
+// 批量响应：chunks 中每一项为 (coding_epoch, group_id, chunk_pos, data, proof)，
+// proof 为默克尔证明各节点在 hashes 中的下标，同一响应中相同的证明节点只发送一次
+class SyncECResponseChunksPacket : public SyncMsgPacket
+{
+public:
+    SyncECResponseChunksPacket() { packetType = ECResponseChunksPacket; }
+    void encode(std::vector<std::vector<unsigned int>> const& ids,
+        std::vector<std::string> const& datas, std::vector<std::vector<unsigned int>> const& proofs,
+        std::vector<std::string> const& hashes);
+};
+
+// 分布式 MPT 查找：请从 node 开始继续查找 key，key 的前 depth 个 nibble 已匹配，并预取至多 frontier_bytes 字节的节点
+class SyncECRequestTrieWalkPacket : public SyncMsgPacket
+{
+public:
+    SyncECRequestTrieWalkPacket() { packetType = ECRequestTrieWalkPacket; }
+    void encode(h256 const& node, h256 const& key, unsigned int const& depth, size_t const& frontier_bytes);
+};
+// 分布式 MPT 查找的结果：回显请求的 (node, key, depth)，result 为 TrieWalkResult::rlp()
+class SyncECResponseTrieWalkPacket : public SyncMsgPacket
+{
+public:
+    SyncECResponseTrieWalkPacket() { packetType = ECResponseTrieWalkPacket; }
+    void encode(h256 const& node, h256 const& key, unsigned int const& depth, bytes const& result);
+};
+
 class SyncECProofPacket : public SyncMsgPacket
 {
 public:
@@ -16,6 +16,7 @@
 #include <libinitializer/P2PInitializer.h>
 #include <libinitializer/SecureInitializer.h>
 #include <libmptstate/MPTState.h>
+#include <libmptstate/EncodingPipeline.h>
 #include <librpc/Rpc.h>
 #include <stdlib.h>
 #include <sys/time.h>
@@ -1003,7 +1004,7 @@ void test_BMT(){
     auto bmt = BMT(data_list);
     int fault_tolerance = 2;
     int encoding_level = 2;
-    state_erasure->makeECFromMPT(1, bmt, fault_tolerance, encoding_level);
+    state_erasure->makeECFromMPT(1, bmt, state_erasure->policy().withLevels(fault_tolerance, encoding_level));
     // std::cout << "查找的状态hash为" << b.search(1) << std::endl;
     // std::cout << "查找的状态叶子节点的祖先节点" << std::endl;
     // b.findAncestorsAndLeaves(b.search(1));
@@ -1022,13 +1023,13 @@ void test_encodingStates(dev::mptstate::MPTState& mptState){
     // mptState.state_erasure = new ec::Eurasure();
     int fault_tolerance = 2;
     int encoding_level = 2;
-    mptState.state_erasure->makeECFromMPT(1, bmt, fault_tolerance, encoding_level);
+    mptState.state_erasure->makeECFromMPT(1, bmt, mptState.state_erasure->policy().withLevels(fault_tolerance, encoding_level));
     /* 2024/10/23 状态编码 end */
 }
 
 void test_EC(){
     
-    auto ec_ptr = new ec::Eurasure();
+    auto ec_ptr = new ec::Eurasure(ec::CodingPolicy(3, 1));
     std::string a = "howhowhow";
     std::string b = "areare";
     std::string c = "you";
@@ -1042,8 +1043,6 @@ void test_EC(){
 
     std::string abc = "howareyou";
     auto max_len = a.size();
-    ec_ptr->setK(3);
-    ec_ptr->setM(1);
     uint8_t* data = new uint8_t[max_len * 4 * sizeof(uint8_t)]();
     memset(data, 0, max_len * 4 * sizeof(uint8_t));
     int64_t count = 0;
@@ -1122,6 +1121,32 @@ int main(int argc, char* argv[])
     int nodes_number = ini.getInt("general", "nodes_number", 4);
     int fault_tolerance = ini.getInt("general", "fault_tolerance", 2);
     int encoding_level = ini.getInt("general", "encoding_level", 2);
+    int partition_mode = ini.getInt("general", "partition_mode", 1);
+    int pipeline_mode = ini.getInt("general", "pipeline", 0);
+    std::string chunk_db_path = ini.get("general", "chunk_db", "");
+    std::string chunk_store_path = ini.get("general", "chunk_store", "");
+    bool compress_chunks = ini.getInt("general", "compress_chunks", 0) != 0;
+    bool size_aware_groups = ini.getInt("general", "size_aware_groups", 0) != 0;
+    ec::CodingPolicy coding_policy;
+    coding_policy.m = fault_tolerance;
+    coding_policy.levels = encoding_level;
+    coding_policy.chunk_size = ini.getInt("general", "coding_chunk_size", 0);
+    coding_policy.compress = compress_chunks;
+    dev::mptstate::RetentionConfig retention_config;
+    retention_config.hot_window = ini.getInt("general", "retention_hot", 0);
+    retention_config.archive_after = ini.getInt("general", "retention_archive", 0);
+    retention_config.node_number = nodes_number;
+    retention_config.node_index = ini.getInt("general", "node_index", 0);
+    dev::mptstate::ScrubConfig scrub_config;
+    scrub_config.bytes_per_second = ini.getInt("general", "scrub_rate", 0) * 1024;
+    scrub_config.parity_sample = ini.getInt("general", "scrub_parity_sample", 8);
+    scrub_config.pass_interval = ini.getInt("general", "scrub_interval", 60);
+    size_t recover_cache_bytes = (size_t)ini.getInt("general", "recover_cache_mb", 64) << 20;
+    int rebuild_node = ini.getInt("general", "rebuild_node", -1);
+    int rebuild_concurrency = ini.getInt("general", "rebuild_concurrency", 8);
+    int byzantine_percent = ini.getInt("general", "byzantine_percent", 0);
+    bool distributed_reads = ini.getInt("general", "distributed_reads", 0) != 0;
+    size_t prefetch_bytes = (size_t)ini.getInt("general", "prefetch_kb", 0) << 10;
 
     int _block_num = ini.getInt("general", "block_num", 1);
     int _account_num = ini.getInt("general", "tx_num", 1000);
@@ -1135,7 +1160,32 @@ int main(int argc, char* argv[])
 
     int account_size = 1000000;
     dev::mptstate::MPTState mptState(u256(0), dev::mptstate::MPTState::openDB("./", sha3("0x1234")), dev::mptstate::BaseState::Empty);
-    mptState.state_erasure = new ec::Eurasure();
+    mptState.state_erasure = new ec::Eurasure(coding_policy);
+    mptState.sizeAwareGroups = size_aware_groups;
+    if(!chunk_db_path.empty()){
+        mptState.chunkDB = std::make_shared<dev::mptstate::ChunkDB>();
+        if(!mptState.chunkDB->open(chunk_db_path)){
+            mptState.chunkDB.reset();
+        }
+    }
+    if(!chunk_store_path.empty()){
+        mptState.chunkStore = std::make_shared<dev::mptstate::ChunkStore>();
+        if(mptState.chunkStore->open(chunk_store_path)){
+            mptState.state_erasure->setChunkStore(mptState.chunkStore);
+            if(retention_config.hot_window > 0){
+                mptState.retention = std::make_shared<dev::mptstate::ChunkRetention>(mptState.chunkStore,
+                    chunk_store_path + "/archive", mptState.state_erasure, retention_config);
+            }
+        }
+        else{
+            mptState.chunkStore.reset();
+        }
+    }
+    if(scrub_config.bytes_per_second > 0 && (mptState.chunkStore || mptState.chunkDB)){
+        mptState.scrubber = std::make_shared<dev::mptstate::ChunkScrubber>(mptState.chunkStore, mptState.chunkDB,
+            mptState.state_erasure, scrub_config);
+        mptState.scrubber->start();
+    }
 
     {
         MyTimer timer("WRITE");
@@ -1185,6 +1235,13 @@ int main(int argc, char* argv[])
         
         std::vector<h256> execute_data_set;
 
+        // 流水线编码：区块提交后即返回，编码在后台线程中完成
+        std::unique_ptr<dev::mptstate::EncodingPipeline> pipeline;
+        if(pipeline_mode){
+            vector<int> _config = {nodes_number, fault_tolerance, encoding_level, partition_mode};
+            pipeline.reset(new dev::mptstate::EncodingPipeline(mptState, _config));
+        }
+
         for (int i = 1; i <= _block_num; i++) {
             // std::cout << i << std::endl;
             std::vector<h256> data_set;
@@ -1224,11 +1281,22 @@ int main(int argc, char* argv[])
             // 2. 编码   3. 划分状态
             mptState.getState().get_m_state().leftOvers(data_set); 
             data_map[i] = data_set; // 窃取一些h256
-            vector<int> _config = {nodes_number, fault_tolerance, encoding_level};
-            auto tmp = mptState.makeECFromMPT(i, _config);
+            if(pipeline){
+                pipeline->submit(i);
+            }
+            else{
+                vector<int> _config = {nodes_number, fault_tolerance, encoding_level, partition_mode};
+                auto tmp = mptState.makeECFromMPT(i, _config);
 
-            // 4. 提交至DB（与编码块
-            mptState.getState().db().commit(tmp);
+                // 4. 提交至DB（编码块已写入 chunkStore / chunkDB 时只提交状态节点）
+                if(mptState.chunkStore || mptState.chunkDB){
+                    mptState.getState().db().commit();
+                }
+                else{
+                    mptState.getState().db().commit(tmp);
+                    mptState.state_erasure->setCompleteCodingEpoch(i);
+                }
+            }
 
             // mptState.getState().get_m_state().debugStructure(std::cout);  
 
@@ -1241,6 +1309,9 @@ int main(int argc, char* argv[])
             build_time+=std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0;
             write_time+=std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() / 1000.0;
             if (i % 10 == 0) {
+                if(pipeline){
+                    pipeline->drain(); // 存储统计由持久化阶段更新
+                }
                 size_t ttsize = 0;
                 for(const auto& k : data_set) {
                     std::string rlpDate = mptState.getState().get_m_state().db()->lookup(k);
@@ -1260,7 +1331,16 @@ int main(int argc, char* argv[])
         }
         // mptState.versionManager.printDataSet();
         // return 0;
-
+        if(pipeline){
+            pipeline->stop();
+        }
+        if(mptState.scrubber){
+            auto m = mptState.scrubber->metrics();
+            writeToLog("Scrub: " + toString(m.passes) + " passes, " + toString(m.chunks_checked) + " chunks / "
+                + toString(m.parity_checked) + " parity checked, " + printMemorySize(m.bytes_checked) + " at "
+                + printMemorySize((size_t)m.bytes_per_second) + "/s, repaired " + toString(m.repaired)
+                + ", unrepairable " + toString(m.unrepairable), "ouput_log.txt");
+        }
 
         auto output = "Total State Size: " + printMemorySize(mptState.t_state_size) 
             + ", Total ExtraInfo Size: " + printMemorySize(mptState.t_extraInfo_size) 
@@ -1269,7 +1349,12 @@ int main(int argc, char* argv[])
 
         // sleep(2);
         // 初始化Mediator
-        Mediator mediator(mptState);
+        Mediator mediator(mptState, recover_cache_bytes);
+        mediator.byzantine_ratio = byzantine_percent / 100.0;
+        if(rebuild_node >= 0){
+            // 模拟替换失效节点：按编码组批量重建其负责的全部 chunk
+            mediator.rebuildNode(rebuild_node, nodes_number, rebuild_concurrency);
+        }
 
         // return 0;
         
@@ -1301,6 +1386,65 @@ int main(int argc, char* argv[])
                 << " Min: "<< min_time << "ms." 
                 << " AVG remote read per state: " << (double)mptState.versionManager.read_count / _cnt << endl;
         }
+
+        // 并发批量读取
+        if(true){
+            vector<h256> keys;
+            keys.reserve(processed_data.size());
+            for(auto &id: processed_data){
+                keys.push_back(sha3(Address(id)));
+            }
+            ReadContext ctx;
+            auto t4 = std::chrono::steady_clock::now();
+            auto values = mptState.versionManager.multiGet(keys, mptState.rootHash(), ctx);
+            auto t5 = std::chrono::steady_clock::now();
+            auto read_time = std::chrono::duration_cast<std::chrono::microseconds>(t5 - t4).count() / 1000.0;
+            auto output = "MultiGet " + dev::toString(values.size()) + " states in " + dev::toString(read_time) + "ms"
+                + ", AVG remote read per state: " + dev::toString((double)ctx.read_count / max<size_t>(keys.size(), 1))
+                + ", fetched nodes: " + dev::toString(ctx.nodes_fetched)
+                + ", decoded cache hits: " + dev::toString(ctx.cache_hits);
+            writeToLog(output, "ouput_log.txt");
+        }
+
+        // 分布式查找：跨分区的部分交给所属节点遍历
+        if(distributed_reads){
+            mptState.enableDistributedReads(retention_config.node_index, nullptr, prefetch_bytes);
+            ReadContext ctx;
+            size_t found = 0;
+            auto t4 = std::chrono::steady_clock::now();
+            for(auto &id: processed_data){
+                if(!mptState.versionManager.distributedAt(sha3(Address(id)), mptState.rootHash(), ctx).empty()){
+                    found++;
+                }
+            }
+            auto t5 = std::chrono::steady_clock::now();
+            auto read_time = std::chrono::duration_cast<std::chrono::microseconds>(t5 - t4).count() / 1000.0;
+            auto cnt = max<size_t>(processed_data.size(), 1);
+            auto output = "Distributed read " + dev::toString(found) + "/" + dev::toString(processed_data.size())
+                + " states in " + dev::toString(read_time) + "ms"
+                + ", AVG remote hops per state: " + dev::toString((double)ctx.remote_hops / cnt)
+                + ", AVG remote read per state (node-by-node): " + dev::toString((double)ctx.read_count / cnt)
+                + ", prefetched nodes: " + dev::toString(ctx.prefetched_nodes)
+                + ", speculative hits: " + dev::toString(ctx.speculative_hits);
+            writeToLog(output, "ouput_log.txt");
+
+            // 同一批次共用预取的节点
+            vector<h256> keys;
+            keys.reserve(processed_data.size());
+            for(auto &id: processed_data){
+                keys.push_back(sha3(Address(id)));
+            }
+            ReadContext batch_ctx;
+            t4 = std::chrono::steady_clock::now();
+            mptState.versionManager.distributedMultiGet(keys, mptState.rootHash(), batch_ctx);
+            t5 = std::chrono::steady_clock::now();
+            read_time = std::chrono::duration_cast<std::chrono::microseconds>(t5 - t4).count() / 1000.0;
+            output = "Distributed multiGet " + dev::toString(keys.size()) + " states in " + dev::toString(read_time) + "ms"
+                + ", AVG remote hops per state: " + dev::toString((double)batch_ctx.remote_hops / cnt)
+                + ", prefetched nodes: " + dev::toString(batch_ctx.prefetched_nodes)
+                + ", speculative hits: " + dev::toString(batch_ctx.speculative_hits);
+            writeToLog(output, "ouput_log.txt");
+        }
         // return 0;
 
         // 解码